@@ -240,6 +240,8 @@ static const char *help =
 "    --raw-pcm-skip=begin[,end]\n"
 "                            skip <begin> bytes before encoding (i.e., a header)\n"
 "                             and <end> bytes at the end-of-file (i.e., a trailer)\n"
+"    --seek-table            store a table of block positions in the first block\n"
+"                             for faster seeking (not available with stdout)\n"
 "    -s<n>                   override default noise shaping where n is a float\n"
 "                             value between -1.0 and 1.0; negative values move noise\n"
 "                             lower in freq, positive values move noise higher\n"
@@ -368,6 +370,7 @@ int main (int argc, char **argv)
     char selfname [PATH_MAX];
     char **argv_fn = NULL;
     char **matches = NULL;
+    WavpackThreadPool *thread_pool = NULL;
     WavpackConfig config;
     int result, argi, i;
     int warnings = 0;
@@ -474,6 +477,8 @@ int main (int argc, char **argv)
                 config.flags |= CONFIG_MERGE_BLOCKS;
             else if (!strcmp (long_option, "pair-unassigned-chans"))    // --pair-unassigned-chans
                 config.flags |= CONFIG_PAIR_UNDEF_CHANS;
+            else if (!strcmp (long_option, "seek-table"))               // --seek-table
+                config.flags |= CONFIG_SEEK_TABLE;
             else if (!strcmp (long_option, "force-even-byte-depth"))    // --force-even-byte_depth
                 config.qmode |= QMODE_EVEN_BYTE_DEPTH;
             else if (!strcmp (long_option, "import-id3"))               // --import-id3
@@ -1007,6 +1012,11 @@ int main (int argc, char **argv)
         ++error_count;
     }
 
+    if ((config.flags & CONFIG_SEEK_TABLE) && use_stdout) {
+        error_line ("can't write seek table when using stdout!");
+        ++error_count;
+    }
+
     if (config.flags & CONFIG_HYBRID_FLAG) {
         if ((config.flags & CONFIG_OPTIMIZE_32BIT) && !(config.flags & CONFIG_CREATE_WVC)) {
             error_line ("--optimize-int32 option is for lossless mode only!");
@@ -1373,6 +1383,12 @@ int main (int argc, char **argv)
 
         addext = !outfilename || outpath || !filespec_ext (outfilename);
 
+        // when processing multiple files with worker threads, share one pool of threads between
+        // them all rather than starting and stopping a new set of threads for each file
+
+        if (num_files > 1 && worker_threads)
+            WavpackSetThreadPool (thread_pool = WavpackCreateThreadPool (worker_threads));
+
         // loop through and process files in list
 
         for (file_index = 0; file_index < num_files; ++file_index) {
@@ -1483,6 +1499,7 @@ int main (int argc, char **argv)
             }
         }
 
+        WavpackDestroyThreadPool (thread_pool);
         free (matches);
     }
     else {
@@ -2230,9 +2247,11 @@ static int pack_file (char *infilename, char *outfilename, char *out2filename, c
     // If we're ignoring the length in the header, or we were not able to determine the length of
     // a "raw" file in advance, then we'll need to back up and read the first frame written and
     // update the length stored there and potentially fix the header stored from the source file.
+    // We also do this to fill in the seek table (if requested), which is only in the .wv file.
 
-    if (result == WAVPACK_NO_ERROR &&
-        ((loc_config.qmode & QMODE_IGNORE_LENGTH) || WavpackGetNumSamples64 (wpc) == -1)) {
+    if (result == WAVPACK_NO_ERROR && ((loc_config.flags & CONFIG_SEEK_TABLE) ||
+        (loc_config.qmode & QMODE_IGNORE_LENGTH) || WavpackGetNumSamples64 (wpc) == -1)) {
+            int update_length = (loc_config.qmode & QMODE_IGNORE_LENGTH) || WavpackGetNumSamples64 (wpc) == -1;
             char *block_buff = malloc (wv_file.first_block_size);
             int update_error = 0;
 
@@ -2245,7 +2264,8 @@ static int pack_file (char *infilename, char *outfilename, char *out2filename, c
                     // longer strictly lossless, but the user essentially told us the length in the header was
                     // wrong, so we're fixing it.
 
-                    if (!(loc_config.qmode & (QMODE_NO_STORE_WRAPPER | QMODE_RAW_PCM)) && WavpackGetWrapperLocation (block_buff, NULL)) {
+                    if (update_length && !(loc_config.qmode & (QMODE_NO_STORE_WRAPPER | QMODE_RAW_PCM)) &&
+                        WavpackGetWrapperLocation (block_buff, NULL)) {
                         uint32_t wrapper_size;
                         unsigned char *wrapper_location = WavpackGetWrapperLocation (block_buff, &wrapper_size);
                         int64_t data_size = WavpackGetSampleIndex64 (wpc) * WavpackGetNumChannels (wpc) * WavpackGetBytesPerSample (wpc);
@@ -2283,7 +2303,7 @@ static int pack_file (char *infilename, char *outfilename, char *out2filename, c
             if (block_buff)
                 free (block_buff);
 
-            if (!update_error && wvc_file.file) {
+            if (!update_error && update_length && wvc_file.file) {
                 block_buff = malloc (wvc_file.first_block_size);
 
                 if (block_buff && !DoSetFilePositionAbsolute (wvc_file.file, 0) &&
@@ -3364,6 +3384,35 @@ static int repack_file (char *infilename, char *outfilename, char *out2filename,
 
     WavpackCloseFile (infile);     // we're now done with input file, so close
 
+    // if we're writing a seek table, then back up and read the first block written so that the
+    // library can fill in the table, and then rewrite it (this is only in the .wv file)
+
+    if (result == WAVPACK_NO_ERROR && (loc_config.flags & CONFIG_SEEK_TABLE)) {
+        char *block_buff = malloc (wv_file.first_block_size);
+        int update_error = 1;
+        uint32_t bcount;
+
+        if (block_buff && !DoSetFilePositionAbsolute (wv_file.file, 0) &&
+            DoReadFile (wv_file.file, block_buff, wv_file.first_block_size, &bcount) &&
+            bcount == wv_file.first_block_size && !strncmp (block_buff, "wvpk", 4)) {
+
+                WavpackUpdateNumSamples (outfile, block_buff);
+
+                if (!DoSetFilePositionAbsolute (wv_file.file, 0) &&
+                    DoWriteFile (wv_file.file, block_buff, wv_file.first_block_size, &bcount) &&
+                    bcount == wv_file.first_block_size)
+                        update_error = 0;
+        }
+
+        if (block_buff)
+            free (block_buff);
+
+        if (update_error) {
+            error_line ("couldn't update WavPack seek table!!");
+            result = WAVPACK_SOFT_ERROR;
+        }
+    }
+
     // at this point we're completely done with the files, so close 'em whether there
     // were any other errors or not
 
@@ -4090,6 +4139,9 @@ static void make_settings_string (char *settings, WavpackConfig *config)
     if (config->flags & CONFIG_PAIR_UNDEF_CHANS)
         strcat (settings, " --pair-unassigned-chans");
 
+    if (config->flags & CONFIG_SEEK_TABLE)
+        strcat (settings, " --seek-table");
+
     if (allow_huge_tags)
         strcat (settings, " --allow-huge-tags");
 }
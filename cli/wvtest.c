@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <math.h>
+#include <float.h>
 
 // Threading support is required for wvtest (although it can still test
 // a libwavpack that's NOT built with threading support).
@@ -52,6 +53,9 @@ static const char *usage =
 "          --no-lossy          = skip the lossy modes\n"
 "          --no-speeds         = skip the speed modes (fast, high, etc.)\n"
 "          --help              = display this message\n"
+"          --mapped            = open seektest files memory-mapped\n"
+"          --pool[=n]          = run worker threads from a shared pool of\n"
+"                                 'n' threads (implies --threads)\n"
 "          --version           = write the version to stdout\n"
 "          --threads[=n]       = use multiple threads, optional 'n' must\n"
 "                                 be 1 - 12, 1 = single thread only\n"
@@ -74,17 +78,23 @@ static const char *usage =
 #define TEST_FLAG_IGNORE_WVC            0x4000
 #define TEST_FLAG_NO_DECODE             0x8000
 #define TEST_FLAG_INT32_FILL_LOW_BITS   0x10000
+#define TEST_FLAG_API_FILE              0x20000
+#define TEST_FLAG_FLOAT_EXP_120         0x40000
+#define TEST_FLAG_CENTER_LFE            0x80000
+#define TEST_FLAG_MERGE_BLOCKS          0x100000
 
 static int run_test_size_modes (int wpconfig_flags, int test_flags, int base_minutes);
 static int run_test_speed_modes (int wpconfig_flags, int test_flags, int bits, int num_chans, int num_seconds);
 static int run_test_extra_modes (int wpconfig_flags, int test_flags, int bits, int num_chans, int num_seconds);
 static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans, int num_seconds);
+static int run_test_decoding_apis (int wpconfig_flags, int test_flags);
 
 #define NUM_WRITE_RANGES 10
 static struct { int start, stop; } write_ranges [NUM_WRITE_RANGES];
 int number_of_ranges;
 
 static int worker_threads;
+static WavpackContext *(*open_file_input) (const char *infilename, char *error, int flags, int norm_offset) = WavpackOpenFileInput;
 
 enum generator_type { noise, tone };
 
@@ -106,6 +116,9 @@ struct audio_generator {
 };
 
 static int seeking_test (char *filename, int32_t test_count);
+static int channel_selection_test (char *filename, int open_flags, int num_chans);
+static int push_decoder_test (char *filename, int open_flags, int num_chans, int bps, int qmode, unsigned char *md5_expected);
+static int normalize_test (char *filename, int open_flags, int num_chans);
 static void tone_generator_init (struct audio_generator *cxt, int sample_rate, int low_freq, int high_freq);
 static void noise_generator_init (struct audio_generator *cxt, double factor);
 static void audio_generator_run (struct audio_generator *cxt, float *samples, int num_samples);
@@ -113,6 +126,7 @@ static void mix_samples_with_gain (float *destin, float *source, int num_samples
 static void truncate_float_samples (float *samples, int num_samples, int bits);
 static void float_to_integer_samples (float *samples, int num_samples, int bits);
 static void float_to_32bit_integer_samples (float *samples, int num_samples, int test_flags);
+static void add_wasted_bits (int32_t *samples, int num_samples, int num_chans, uint32_t first_sample);
 static void *store_samples (void *dst, int32_t *src, int qmode, int bps, int count);
 static double frandom (void);
 
@@ -143,7 +157,8 @@ static WavpackStreamReader freader;
 int main (argc, argv) int argc; char **argv;
 {
     int wpconfig_flags = CONFIG_MD5_CHECKSUM | CONFIG_OPTIMIZE_MONO, test_flags = 0, base_minutes = 2, res = 0;
-    int seektest = 0;
+    int seektest = 0, pool_threads = 0;
+    WavpackThreadPool *thread_pool = NULL;
 
     // loop through command-line arguments
 
@@ -194,6 +209,21 @@ int main (argc, argv) int argc; char **argv;
             else if (!strcmp (long_option, "no-decode")) {              // --no-decode
                 test_flags |= TEST_FLAG_NO_DECODE;
             }
+            else if (!strcmp (long_option, "mapped")) {                 // --mapped
+                open_file_input = WavpackOpenFileInputMapped;
+            }
+            else if (!strncmp (long_option, "pool", 4)) {               // --pool
+                if (isdigit ((unsigned char)*long_param)) {
+                    pool_threads = strtol (long_param, &long_param, 10);
+
+                    if (pool_threads < 1 || pool_threads > 64) {
+                        printf ("specified pool thread count must be 1 - 64!\n");
+                        return 1;
+                    }
+                }
+                else
+                    pool_threads = 4;
+            }
             else if (!strncmp (long_option, "write", 5)) {              // --write
                 for (number_of_ranges = 0; *long_param && isdigit ((unsigned char)*long_param) && number_of_ranges < NUM_WRITE_RANGES;) {
                     write_ranges [number_of_ranges].start = strtol (long_param, &long_param, 10);
@@ -266,6 +296,18 @@ int main (argc, argv) int argc; char **argv;
         return 1;
     }
 
+    if (pool_threads) {
+        if (!worker_threads)
+            worker_threads = 4;
+
+        if (!(thread_pool = WavpackCreateThreadPool (pool_threads))) {
+            printf ("can't create thread pool!\n");
+            return 1;
+        }
+
+        WavpackSetThreadPool (thread_pool);
+    }
+
     if (seektest) {
         while (--argc)
             if ((res = seeking_test (*++argv, seektest)))
@@ -292,9 +334,17 @@ int main (argc, argv) int argc; char **argv;
                 if (res) goto done;
             }
         }
+
+        if (!(test_flags & TEST_FLAG_NO_DECODE)) {
+            printf ("\n\n                          ****** decoding APIs ******\n");
+            res = run_test_decoding_apis (wpconfig_flags, test_flags);
+            if (res) goto done;
+        }
     }
 
 done:
+    WavpackDestroyThreadPool (thread_pool);
+
     if (res)
         printf ("\ntest failed!\n\n");
     else
@@ -316,7 +366,7 @@ static int seeking_test (char *filename, int32_t test_count)
     int64_t min_chunk_size = 256, total_samples, sample_count = 0;
     char md5_string1 [] = "????????????????????????????????";
     char md5_string2 [] = "????????????????????????????????";
-    int32_t *decoded_samples, num_chans, bps, test_index, qmode;
+    int32_t *decoded_samples, num_chans, bps, test_index, qmode, unpack_format = 0;
     unsigned char md5_initial [16], md5_stored [16];
     MD5_CTX md5_global, md5_local;
     unsigned char *chunked_md5;
@@ -325,7 +375,7 @@ static int seeking_test (char *filename, int32_t test_count)
     if (worker_threads)
         open_flags |= worker_threads << OPEN_THREADS_SHFT;
 
-    wpc = WavpackOpenFileInput (filename, error, open_flags, 0);
+    wpc = open_file_input (filename, error, open_flags, 0);
 
     printf ("\n-------------------- file: %s %s--------------------\n",
         filename, (WavpackGetMode (wpc) & MODE_WVC) ? "(+wvc) " : "");
@@ -350,6 +400,20 @@ static int seeking_test (char *filename, int32_t test_count)
         return -1;
     }
 
+    // For signed little-endian audio we can also verify WavpackUnpackSamplesFormat(), which should
+    // return exactly what store_samples() generates (16-bit and float only on little-endian hosts)
+
+    if (!(qmode & (QMODE_BIG_ENDIAN | QMODE_UNSIGNED_WORDS | QMODE_DSD_AUDIO))) {
+        int16_t native = 1;
+
+        if (bps == 3)
+            unpack_format = UNPACK_INT24_LE;
+        else if (*(char *) &native && bps == 2)
+            unpack_format = UNPACK_INT16;
+        else if (*(char *) &native && bps == 4 && (WavpackGetMode (wpc) & MODE_FLOAT))
+            unpack_format = UNPACK_FLOAT32;
+    }
+
     // For very short files, reduce the minimum chunk size
 
     while (min_chunk_size > 1 && total_samples / min_chunk_size < 256)
@@ -431,6 +495,44 @@ static int seeking_test (char *filename, int32_t test_count)
                     printf ("seeking_test(): MD5 does not match MD5 stored in file!\n");
                     return -1;
                 }
+
+            // Probing the file (without opening it) must agree with what the open context reports
+
+            if (open_file_input == WavpackOpenFileInput) {
+                WavpackProbeInfo info;
+
+                if (!WavpackProbeFile (filename, &info, error, open_flags)) {
+                    printf ("seeking_test(): error \"%s\" probing input file \"%s\"\n", error, filename);
+                    return -1;
+                }
+
+                if (info.num_samples != total_samples || info.num_channels != num_chans ||
+                    info.bytes_per_sample != bps || info.qualify_mode != qmode ||
+                    info.sample_rate != WavpackGetSampleRate (wpc) || info.mode != WavpackGetMode (wpc) ||
+                    info.file_size != WavpackGetFileSize64 (wpc) || info.md5_read != file_has_md5 ||
+                    (file_has_md5 && memcmp (info.md5_sum, md5_stored, sizeof (md5_stored)))) {
+                        printf ("seeking_test(): WavpackProbeFile() does not match open file!\n");
+                        return -1;
+                }
+            }
+
+            // Decoding only some of the channels of a multichannel file must return exactly those channels
+            // (this includes center + LFE files, which are stored as two mono streams)
+
+            if ((num_chans > 2 || (num_chans == 2 && WavpackGetChannelMask (wpc) == 0xc)) &&
+                channel_selection_test (filename, open_flags, num_chans))
+                    return -1;
+
+            // Feeding the file to a push-mode decoder in random pieces must decode identically
+            // (except with correction files, which it can't use)
+
+            if (!(WavpackGetMode (wpc) & MODE_WVC) && push_decoder_test (filename, open_flags, num_chans, bps, qmode, md5_initial))
+                return -1;
+
+            // Float audio normalized by WavpackUnpackSamplesFormat() must match OPEN_NORMALIZE
+
+            if ((WavpackGetMode (wpc) & MODE_FLOAT) && normalize_test (filename, open_flags, num_chans))
+                return -1;
         }
         else {
             unsigned char md5_subsequent [16];
@@ -444,18 +546,59 @@ static int seeking_test (char *filename, int32_t test_count)
         }
 
         // Half the time, reopen the file. This lets us catch errors caused by seeking to locations
-        // that have never been decoded (at least not for this open call).
+        // that have never been decoded (at least not for this open call). Sometimes we carry the
+        // block index over to the new context, or build a complete one, so that's tested too. And
+        // sometimes, instead of reopening, we clone the context (with new file handles).
 
         if (frandom() < 0.5) {
-            WavpackCloseFile (wpc);
-            wpc = WavpackOpenFileInput (filename, error, open_flags, 0);
+            int32_t index_size = 0;
+            char *index_data = NULL;
+
+            if (frandom() < 0.5 && (index_size = WavpackExportBlockIndex (wpc, NULL, 0)) && (index_data = malloc (index_size)))
+                WavpackExportBlockIndex (wpc, index_data, index_size);
+
+            if (open_file_input == WavpackOpenFileInput && frandom() < 0.25) {
+                char *wvc_filename = malloc (strlen (filename) + 10);
+                WavpackContext *clone;
+
+                strcpy (wvc_filename, filename);
+                strcat (wvc_filename, "c");
+                clone = WavpackCloneContext (wpc, NULL, fopen (filename, "rb"),
+                    (WavpackGetMode (wpc) & MODE_WVC) ? fopen (wvc_filename, "rb") : NULL, error);
+                free (wvc_filename);
+                WavpackCloseFile (wpc);
+                wpc = clone;
+            }
+            else {
+                WavpackCloseFile (wpc);
+                wpc = open_file_input (filename, error, open_flags | (frandom() < 0.5 ? OPEN_LAZY : 0), 0);
+            }
 
             if (!wpc) {
                 printf ("seeking_test(): error \"%s\" reopening input file \"%s\"\n", error, filename);
                 return -1;
             }
+
+            if (index_data) {
+                if (!WavpackImportBlockIndex (wpc, index_data, index_size)) {
+                    printf ("seeking_test(): can't import block index!\n");
+                    return -1;
+                }
+
+                free (index_data);
+            }
+            else if (frandom() < 0.5 && !WavpackBuildBlockIndex (wpc)) {
+                printf ("seeking_test(): can't build block index!\n");
+                return -1;
+            }
         }
 
+        // Sometimes turn the decoded-block cache on (with a random size) or off, so that seeking
+        // into (and reading out of) cached blocks is tested, along with the transitions.
+
+        if (frandom() < 0.5)
+            WavpackSetBlockCache (wpc, frandom() < 0.25 ? 0 : (uint32_t) (frandom() * (1 << 22)));
+
         chunk_count *= 4;       // decode each chunk 4 times, on average
 
         while (chunk_count) {
@@ -481,16 +624,42 @@ static int seeking_test (char *filename, int32_t test_count)
             }
 
             for (current_chunk = start_chunk; current_chunk <= stop_chunk; ++current_chunk) {
-                int samples = WavpackUnpackSamples (wpc, decoded_samples, chunk_samples);
                 unsigned char md5_chunk [16];
+                int samples;
+
+                // occasionally decode some other chunk with WavpackReadRange(), which must not disturb
+                // the current position (and that's verified when this chunk is decoded right after)
+
+                if (frandom () < 0.1) {
+                    int range_chunk = (int) floor (frandom () * total_chunks);
+
+                    if (range_chunk == total_chunks) range_chunk--;
+
+                    if ((samples = WavpackReadRange (wpc, (int64_t) range_chunk * chunk_samples, chunk_samples, decoded_samples)))
+                        store_samples (decoded_samples, decoded_samples, qmode, bps, samples * num_chans);
+
+                    MD5_Init (&md5_local);
+                    MD5_Update (&md5_local, (unsigned char *) decoded_samples, bps * samples * num_chans);
+                    MD5_Final (md5_chunk, &md5_local);
+
+                    if (!samples || memcmp (chunked_md5 + range_chunk * 16, md5_chunk, sizeof (md5_chunk))) {
+                        printf ("seeking_test(): range read error at %lld!\n", (long long int) range_chunk * chunk_samples);
+                        return -1;
+                    }
+                }
+
+                // half the time (when possible) have the library convert directly to the stored format
+
+                if (unpack_format && frandom () < 0.5)
+                    samples = WavpackUnpackSamplesFormat (wpc, decoded_samples, chunk_samples, unpack_format);
+                else if ((samples = WavpackUnpackSamples (wpc, decoded_samples, chunk_samples)))
+                    store_samples (decoded_samples, decoded_samples, qmode, bps, samples * num_chans);
 
                 if (!samples) {
                     printf ("seeking_test(): seek error!\n");
                     return -1;
                 }
 
-                store_samples (decoded_samples, decoded_samples, qmode, bps, samples * num_chans);
-
                 // if (frandom() < 0.0001)
                 //     decoded_samples [(int) floor (samples * frandom())] ^= 1;
 
@@ -535,6 +704,220 @@ static int seeking_test (char *filename, int32_t test_count)
     return 0;
 }
 
+#define SELECTION_SAMPLES 3333      // not a factor of common block sizes, so blocks are split
+
+// Decode the specified multichannel file twice in parallel, once with a random subset of the channels
+// selected with WavpackSelectChannels(), and verify that the selected channels are returned exactly.
+// The selection is made after decoding a random amount of the file (usually partway through a block
+// and with samples in the read-ahead buffer). A return value of -1 indicates an error.
+
+static int channel_selection_test (char *filename, int open_flags, int num_chans)
+{
+    int *channels = malloc (num_chans * sizeof (int)), num_selected = 0, result = 0, chan;
+    int skip_chunks = (int) floor (frandom () * 16.0) + 1;
+    WavpackContext *wpc_all, *wpc_selected;
+    int32_t *all_samples, *selected_samples;
+    char error [80];
+
+    wpc_all = open_file_input (filename, error, open_flags, 0);
+    wpc_selected = open_file_input (filename, error, open_flags, 0);
+    all_samples = malloc (sizeof (int32_t) * SELECTION_SAMPLES * num_chans);
+    selected_samples = malloc (sizeof (int32_t) * SELECTION_SAMPLES * num_chans);
+
+    if (!wpc_all || !wpc_selected || !channels || !all_samples || !selected_samples) {
+        printf ("channel_selection_test(): can't open file or allocate memory!\n");
+        return -1;
+    }
+
+    for (chan = 0; chan < num_chans; ++chan)
+        if (frandom () < 0.333)
+            channels [num_selected++] = chan;
+
+    if (!num_selected)
+        channels [num_selected++] = (int) floor (frandom () * num_chans);
+
+    while (skip_chunks--)
+        if (WavpackUnpackSamples (wpc_all, all_samples, SELECTION_SAMPLES) != WavpackUnpackSamples (wpc_selected, selected_samples, SELECTION_SAMPLES)) {
+            printf ("channel_selection_test(): sample count does not match!\n");
+            result = -1;
+            break;
+        }
+
+    if (!result && (!WavpackSelectChannels (wpc_selected, channels, num_selected) || WavpackGetReducedChannels (wpc_selected) != num_selected)) {
+        printf ("channel_selection_test(): error \"%s\" selecting channels!\n", WavpackGetErrorMessage (wpc_selected));
+        result = -1;
+    }
+
+    while (!result) {
+        int samples = WavpackUnpackSamples (wpc_all, all_samples, SELECTION_SAMPLES), i, j;
+
+        if (WavpackUnpackSamples (wpc_selected, selected_samples, SELECTION_SAMPLES) != samples) {
+            printf ("channel_selection_test(): sample count does not match!\n");
+            result = -1;
+        }
+        else if (!samples)
+            break;
+
+        for (i = 0; i < samples && !result; ++i)
+            for (j = 0; j < num_selected; ++j)
+                if (selected_samples [i * num_selected + j] != all_samples [i * num_chans + channels [j]]) {
+                    printf ("channel_selection_test(): selected channel %d does not match!\n", channels [j]);
+                    result = -1;
+                    break;
+                }
+    }
+
+    if (!result && WavpackGetNumErrors (wpc_selected)) {
+        printf ("channel_selection_test(): decoder reported %d errors!\n", WavpackGetNumErrors (wpc_selected));
+        result = -1;
+    }
+
+    if (!result)
+        printf ("decoded %d of %d channels selected\n", num_selected, num_chans);
+
+    WavpackCloseFile (wpc_selected);
+    WavpackCloseFile (wpc_all);
+    free (selected_samples);
+    free (all_samples);
+    free (channels);
+    return result;
+}
+
+#define NORMALIZE_SAMPLES 4096
+#define NORMALIZE_OFFSET 4
+
+// Decode the specified float file three ways in parallel and verify that they all agree: opened normally
+// and returned normalized by WavpackUnpackSamplesFormat(), opened with OPEN_NORMALIZE and returned by
+// WavpackUnpackSamples(), and opened with OPEN_NORMALIZE and a norm_offset, in which case the offset
+// must be applied exactly once (i.e., UNPACK_NORMALIZE must not scale the audio again). A return value
+// of -1 indicates an error.
+
+static int normalize_test (char *filename, int open_flags, int num_chans)
+{
+    float *format_samples = malloc (sizeof (float) * NORMALIZE_SAMPLES * num_chans);
+    float *normal_samples = malloc (sizeof (float) * NORMALIZE_SAMPLES * num_chans);
+    float *offset_samples = malloc (sizeof (float) * NORMALIZE_SAMPLES * num_chans);
+    WavpackContext *wpc_format, *wpc_normal, *wpc_offset;
+    int result = 0;
+    char error [80];
+
+    wpc_format = open_file_input (filename, error, open_flags, 0);
+    wpc_normal = open_file_input (filename, error, open_flags | OPEN_NORMALIZE, 0);
+    wpc_offset = open_file_input (filename, error, open_flags | OPEN_NORMALIZE, NORMALIZE_OFFSET);
+
+    if (!wpc_format || !wpc_normal || !wpc_offset || !format_samples || !normal_samples || !offset_samples) {
+        printf ("normalize_test(): can't open file or allocate memory!\n");
+        return -1;
+    }
+
+    while (!result) {
+        int samples = WavpackUnpackSamples (wpc_normal, (int32_t *) normal_samples, NORMALIZE_SAMPLES), i;
+
+        if (WavpackUnpackSamplesFormat (wpc_format, format_samples, NORMALIZE_SAMPLES, UNPACK_FLOAT32 | UNPACK_NORMALIZE) != samples ||
+            WavpackUnpackSamplesFormat (wpc_offset, offset_samples, NORMALIZE_SAMPLES, UNPACK_FLOAT32 | UNPACK_NORMALIZE) != samples) {
+                printf ("normalize_test(): sample count does not match!\n");
+                result = -1;
+        }
+        else if (!samples)
+            break;
+
+        // (denormals are flushed to zero when the exponent is adjusted, so the offset can't restore them)
+
+        for (i = 0; i < samples * num_chans && !result; ++i)
+            if (format_samples [i] != normal_samples [i] || (offset_samples [i] != ldexp (normal_samples [i], NORMALIZE_OFFSET) &&
+                (offset_samples [i] != 0.0 || fabs (normal_samples [i]) >= FLT_MIN))) {
+                    printf ("normalize_test(): normalized samples do not match!\n");
+                    result = -1;
+            }
+    }
+
+    if (!result)
+        printf ("normalized float audio matches (exponent %d)\n", WavpackGetFloatNormExp (wpc_format));
+
+    WavpackCloseFile (wpc_offset);
+    WavpackCloseFile (wpc_normal);
+    WavpackCloseFile (wpc_format);
+    free (offset_samples);
+    free (normal_samples);
+    free (format_samples);
+    return result;
+}
+
+#define PUSH_SAMPLES 4096
+
+// Decode the specified file with a push-mode decoder (see WavpackCreateDecoder()), feeding it the file
+// in pieces of random size (from a single byte up to 64K) and draining the decoded samples after each,
+// and verify that the MD5 sum of the decoded audio matches the one specified. A return value of -1
+// indicates an error.
+
+static int push_decoder_test (char *filename, int open_flags, int num_chans, int bps, int qmode, unsigned char *md5_expected)
+{
+    unsigned char *data = malloc (65536), md5_actual [16];
+    int32_t *decoded_samples = malloc (sizeof (int32_t) * PUSH_SAMPLES * num_chans);
+    WavpackStreamDecoder *dec = WavpackCreateDecoder (open_flags, 0);
+    FILE *infile = fopen (filename, "rb");
+    int64_t sample_count = 0;
+    int result = 0, pieces = 0;
+    MD5_CTX md5_context;
+
+    if (!data || !decoded_samples || !dec || !infile) {
+        printf ("push_decoder_test(): can't open file or allocate memory!\n");
+        return -1;
+    }
+
+    MD5_Init (&md5_context);
+
+    while (!result) {
+        int piece_size = (frandom () < 0.5) ? (int) floor (frandom () * 100) + 1 : (int) floor (frandom () * 65536) + 1;
+        int bcount = (int) fread (data, 1, piece_size, infile);
+        uint32_t samples;
+
+        if (bcount && !WavpackDecoderFeed (dec, data, bcount)) {
+            printf ("push_decoder_test(): error \"%s\" feeding decoder!\n", WavpackDecoderGetErrorMessage (dec));
+            result = -1;
+            break;
+        }
+
+        pieces++;
+
+        while ((samples = WavpackDecoderDrain (dec, decoded_samples, PUSH_SAMPLES)) != 0) {
+            if (WavpackGetReducedChannels (WavpackDecoderGetContext (dec)) != num_chans) {
+                printf ("push_decoder_test(): channel count does not match!\n");
+                result = -1;
+                break;
+            }
+
+            store_samples (decoded_samples, decoded_samples, qmode, bps, samples * num_chans);
+            MD5_Update (&md5_context, (unsigned char *) decoded_samples, bps * samples * num_chans);
+            sample_count += samples;
+        }
+
+        if (!bcount)
+            break;
+    }
+
+    MD5_Final (md5_actual, &md5_context);
+
+    if (!result && (!WavpackDecoderGetContext (dec) || WavpackGetNumErrors (WavpackDecoderGetContext (dec)))) {
+        printf ("push_decoder_test(): decoder failed or reported errors!\n");
+        result = -1;
+    }
+
+    if (!result && memcmp (md5_actual, md5_expected, sizeof (md5_actual))) {
+        printf ("push_decoder_test(): MD5 does not match MD5 read initially!\n");
+        result = -1;
+    }
+
+    if (!result)
+        printf ("push decoded %lld samples from %d pieces\n", (long long int) sample_count, pieces);
+
+    WavpackDestroyDecoder (dec);
+    free (decoded_samples);
+    free (data);
+    fclose (infile);
+    return result;
+}
+
 // Given a WavPack configuration and test flags, run the various combinations of
 // bit-depth and channel configurations. A return value of FALSE indicates an error.
 
@@ -556,6 +939,12 @@ static int run_test_size_modes (int wpconfig_flags, int test_flags, int base_min
     res = run_test_speed_modes (wpconfig_flags, test_flags, 16, 2, base_minutes*3*60);
     if (res) return res;
 
+    if (!(wpconfig_flags & CONFIG_HYBRID_FLAG)) {
+        printf ("\n   *** 16-bit, stereo, merged blocks (varying wasted bits) ***\n");
+        res = run_test_speed_modes (wpconfig_flags, test_flags | TEST_FLAG_MERGE_BLOCKS, 16, 2, base_minutes*60);
+        if (res) return res;
+    }
+
     if ((test_flags & TEST_FLAG_EXHAUSTIVE) && !(test_flags & TEST_FLAG_NO_FLOATS)) {
         printf ("\n   *** 16-bit (converted to float), stereo ***\n");
         res = run_test_speed_modes (wpconfig_flags, test_flags | TEST_FLAG_FLOAT_DATA, 16, 2, base_minutes*3*60);
@@ -573,6 +962,12 @@ static int run_test_size_modes (int wpconfig_flags, int test_flags, int base_min
             if (res) return res;
         }
  
+        if (!(wpconfig_flags & CONFIG_HYBRID_FLAG)) {
+            printf ("\n   *** 24-bit, 5.1 channels, merged blocks (varying wasted bits) ***\n");
+            res = run_test_speed_modes (wpconfig_flags, test_flags | TEST_FLAG_MERGE_BLOCKS, 24, 6, base_minutes*30);
+            if (res) return res;
+        }
+
         printf ("\n   *** 32-bit integer (converted from float), 5.1 channels ***\n");
         res = run_test_speed_modes (wpconfig_flags, test_flags, 32, 6, base_minutes*60);
         if (res) return res;
@@ -679,6 +1074,46 @@ static int run_test_extra_modes (int wpconfig_flags, int test_flags, int bits, i
     return 0;
 }
 
+// Run the decoding API tests. These write short files of a few different types to disk and then run
+// the seeking test on each (see seeking_test()), which exercises block indexes, seek tables, the block
+// cache, WavpackReadRange(), WavpackCloneContext(), OPEN_LAZY, probing, channel selection and the
+// push decoder, and verifies each against the audio returned by WavpackUnpackSamples().
+
+static int run_test_decoding_apis (int wpconfig_flags, int test_flags)
+{
+    int res;
+
+    test_flags = (test_flags & TEST_FLAG_NO_FLOATS) | TEST_FLAG_API_FILE;
+
+    printf ("\n   *** 16-bit, stereo (with seek table) ***\n");
+    res = run_test (wpconfig_flags | CONFIG_SEEK_TABLE, test_flags, 16, 2, 20);
+    if (res) return res;
+
+    printf ("\n   *** 16-bit, mono ***\n");
+    res = run_test (wpconfig_flags, test_flags, 16, 1, 20);
+    if (res) return res;
+
+    printf ("\n   *** 16-bit, center + LFE ***\n");
+    res = run_test (wpconfig_flags, test_flags | TEST_FLAG_CENTER_LFE, 16, 2, 20);
+    if (res) return res;
+
+    printf ("\n   *** 24-bit, 5.1 channels, hybrid lossless ***\n");
+    res = run_test (wpconfig_flags | CONFIG_HYBRID_FLAG | CONFIG_CREATE_WVC, test_flags, 24, 6, 10);
+    if (res) return res;
+
+    if (!(test_flags & TEST_FLAG_NO_FLOATS)) {
+        printf ("\n   *** 32-bit float, 5.1 channels ***\n");
+        res = run_test (wpconfig_flags, test_flags | TEST_FLAG_FLOAT_DATA, 32, 6, 10);
+        if (res) return res;
+
+        printf ("\n   *** 32-bit float, stereo, exponent 120 ***\n");
+        res = run_test (wpconfig_flags, test_flags | TEST_FLAG_FLOAT_DATA | TEST_FLAG_FLOAT_EXP_120, 32, 2, 10);
+        if (res) return res;
+    }
+
+    return 0;
+}
+
 // Given a WavPack configuration and test flags, actually run the specified test. This entails
 // generating the actual audio test data, creating the "virtual" WavPack file and writing to it,
 // and spawning the thread that will read the "virtual" file and do the decoding (which is obviously
@@ -697,6 +1132,7 @@ struct audio_channel {
 #define SAMPLE_RATE 44100
 #define ENCODE_SAMPLES 128
 #define DESTIN_SAMPLES (220672)     // multiple of ENCODE_SAMPLES, long enough for temporal multithreading
+#define MERGE_BOUNDARY 882          // block boundary for CONFIG_MERGE_BLOCKS tests (20 ms)
 #define NOISE_GAIN 0.6667
 #define TONE_GAIN 0.3333
 
@@ -717,6 +1153,7 @@ static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans
     uint32_t total_encoded_bytes, total_encoded_samples;
     struct audio_generator generators [NUM_GENERATORS];
     int seconds = 0, samples = 0, wc = 0, chan_mask;
+    uint32_t samples_packed = 0;
     char *filename = NULL, mode_string [32] = "-";
     struct audio_channel *channels;
     float *source, *destin;
@@ -736,6 +1173,11 @@ static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans
     else if (wpconfig_flags & CONFIG_VERY_HIGH_FLAG)
         strcat (mode_string, "hh");
 
+    if (test_flags & TEST_FLAG_MERGE_BLOCKS) {
+        strcat (mode_string, "m");
+        wpconfig_flags |= CONFIG_MERGE_BLOCKS;
+    }
+
     printf ("test %04d...", ++test_number); fflush (stdout);
     MD5_Init (&md5_context);
 
@@ -769,6 +1211,12 @@ static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans
             break;
 
         case 2:
+            if (test_flags & TEST_FLAG_CENTER_LFE) {
+                channels [1].lfe_flag = 1;
+                chan_mask = 0xC;
+                break;
+            }
+
             channels [0].angle_offset -= M_PI / 24.0;
             channels [1].angle_offset += M_PI / 24.0;
             chan_mask = 0x3;
@@ -803,11 +1251,13 @@ static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans
     else
         initialize_stream (&wv_stream, 0);
 
-    if (test_flags & TEST_FLAG_WRITE_FILE) {
+    // the decoding API tests always write a file (which is deleted once it has been tested)
+
+    if (test_flags & (TEST_FLAG_WRITE_FILE | TEST_FLAG_API_FILE)) {
         int i;
 
-        for (i = 0; i < number_of_ranges; ++i)
-            if (test_number >= write_ranges [i].start && test_number <= write_ranges [i].stop) {
+        for (i = 0; i < number_of_ranges || (test_flags & TEST_FLAG_API_FILE); ++i)
+            if ((test_flags & TEST_FLAG_API_FILE) || (test_number >= write_ranges [i].start && test_number <= write_ranges [i].stop)) {
                 filename = malloc (32);
 
                 if (!filename) {
@@ -858,7 +1308,7 @@ static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans
         wp_thread_create (thread, decode_thread, (void *) &wv_decoder);
 
     if (test_flags & (TEST_FLAG_FLOAT_DATA | TEST_FLAG_STORE_INT32_AS_FLOAT)) {
-        wpconfig.float_norm_exp = 127;
+        wpconfig.float_norm_exp = (test_flags & TEST_FLAG_FLOAT_EXP_120) ? 120 : 127;
         wpconfig.bytes_per_sample = 4;
         wpconfig.bits_per_sample = 32;
     }
@@ -882,6 +1332,11 @@ static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans
     wpconfig.channel_mask = chan_mask;
     wpconfig.flags = wpconfig_flags;
 
+    // for merged blocks, the block boundary is deliberately not a factor of the normal block size
+
+    if (wpconfig_flags & CONFIG_MERGE_BLOCKS)
+        wpconfig.block_samples = MERGE_BOUNDARY;
+
     if (wpconfig_flags & CONFIG_HYBRID_FLAG) {
         if (wpconfig_flags & CONFIG_CREATE_WVC) {
             if (test_flags & TEST_FLAG_IGNORE_WVC) {
@@ -967,6 +1422,15 @@ static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans
                 printf ("invalid bits configuration\n");
                 exit (-1);
             }
+
+            // scale the audio to full scale for float_norm_exp of 120 (i.e., +/- 2^-7)
+
+            if (test_flags & TEST_FLAG_FLOAT_EXP_120) {
+                int i;
+
+                for (i = 0; i < destin_samples * num_chans; ++i)
+                    destin [i] = ldexpf (destin [i], -7);
+            }
         }
         else if (!(test_flags & TEST_FLAG_STORE_FLOAT_AS_INT32)) {
             if (bits < 32)
@@ -977,9 +1441,13 @@ static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans
                 printf ("invalid bits configuration\n");
                 exit (-1);
             }
+
+            if (test_flags & TEST_FLAG_MERGE_BLOCKS)
+                add_wasted_bits ((int32_t *) destin, destin_samples, num_chans, samples_packed);
         }
 
         WavpackPackSamples (out_wpc, (int32_t *) destin, destin_samples);
+        samples_packed += destin_samples;
         store_samples (destin, (int32_t *) destin, 0, wpconfig.bytes_per_sample, destin_samples * num_chans);
         MD5_Update (&md5_context, (unsigned char *) destin, wpconfig.bytes_per_sample * destin_samples * num_chans);
     }
@@ -1036,6 +1504,27 @@ static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans
 
     printf ("pass (%8s, %.2f%%, %.2f bps, %s)\n", mode_string, 100.0 - ratio * 100.0, bps, md5_string2);
 
+    // for the decoding API tests, run the seeking test on the file we just wrote (which verifies all
+    // the decoding APIs against WavpackUnpackSamples()), and then delete it
+
+    if (test_flags & TEST_FLAG_API_FILE) {
+        char *filename_c = malloc (strlen (filename) + 10);
+        int res = seeking_test (filename, 1);
+
+        strcpy (filename_c, filename);
+        strcat (filename_c, "c");
+        remove (filename);
+
+        if (wpconfig_flags & CONFIG_CREATE_WVC)
+            remove (filename_c);
+
+        free (filename_c);
+        free (filename);
+
+        if (res)
+            return 1;
+    }
+
     return 0;
 }
 
@@ -1043,6 +1532,7 @@ static int run_test (int wpconfig_flags, int test_flags, int bits, int num_chans
 // decoded audio data.
 
 #define DECODE_SAMPLES 200000       // long enough for temporal multithreading
+#define SMALL_DECODE_SAMPLES 4095   // short enough to require read-ahead for multithreading
 
 #ifdef _WIN32
 static unsigned WINAPI decode_thread (LPVOID threadid)
@@ -1053,7 +1543,8 @@ static void *decode_thread (void *threadid)
     WavpackDecoder *wd = (WavpackDecoder *) threadid;
     char error [80];
     WavpackContext *wpc;
-    int32_t *decoded_samples, num_chans, bps;
+    int32_t *decoded_samples, *planar_samples, **planes, num_chans, bps, chan;
+    uint32_t decode_calls = 0;
     MD5_CTX md5_context;
     int open_flags = 0;
 
@@ -1073,14 +1564,32 @@ static void *decode_thread (void *threadid)
     bps = WavpackGetBytesPerSample (wpc);
 
     decoded_samples = malloc (sizeof (int32_t) * DECODE_SAMPLES * num_chans);
+    planar_samples = malloc (sizeof (int32_t) * DECODE_SAMPLES * num_chans);
+    planes = malloc (sizeof (int32_t *) * num_chans);
 
-    if (!decoded_samples) {
+    if (!decoded_samples || !planar_samples || !planes) {
         printf ("decode_thread(): can't allocate memory!\n");
         exit (-1);
     }
 
+    for (chan = 0; chan < num_chans; ++chan)
+        planes [chan] = planar_samples + chan * DECODE_SAMPLES;
+
     while (1) {
-        int samples = WavpackUnpackSamples (wpc, decoded_samples, DECODE_SAMPLES);
+        // alternate between large and small requests so both decoding paths get exercised
+        int request = (decode_calls & 1) ? SMALL_DECODE_SAMPLES : DECODE_SAMPLES, samples, i;
+
+        // every fourth call decodes into planes (which we interleave here) to exercise that path too
+
+        if ((decode_calls++ & 3) == 2) {
+            samples = WavpackUnpackSamplesPlanar (wpc, planes, request);
+
+            for (chan = 0; chan < num_chans; ++chan)
+                for (i = 0; i < samples; ++i)
+                    decoded_samples [i * num_chans + chan] = planes [chan] [i];
+        }
+        else
+            samples = WavpackUnpackSamples (wpc, decoded_samples, request);
 
         if (!samples)
             break;
@@ -1093,6 +1602,8 @@ static void *decode_thread (void *threadid)
     MD5_Final (wd->md5_decoded, &md5_context);
     wd->num_errors = WavpackGetNumErrors (wpc);
     free (decoded_samples);
+    free (planar_samples);
+    free (planes);
     WavpackCloseFile (wpc);
     wp_thread_exit (0);
     return 0;
@@ -1399,6 +1910,24 @@ static void truncate_float_samples (float *samples, int num_samples, int bits)
     } 
 }
 
+// Clear the low bits of integer samples (like lossyWAV does) so that the number of wasted bits changes
+// every few MERGE_BOUNDARY pieces, except for long stretches where it stays the same, which exercises
+// both the block shortening and the full-length blocks of CONFIG_MERGE_BLOCKS. The "first_sample" is
+// the index of the first sample (i.e., frame) so that the pieces stay aligned across calls.
+
+static void add_wasted_bits (int32_t *samples, int num_samples, int num_chans, uint32_t first_sample)
+{
+    int i, j;
+
+    for (i = 0; i < num_samples; ++i) {
+        uint32_t piece = (first_sample + i) / MERGE_BOUNDARY;
+        int wasted_bits = (piece & 64) ? 2 : piece * 37 / 100 % 4;
+
+        for (j = 0; j < num_chans; ++j)
+            *samples++ &= ~((1 << wasted_bits) - 1);
+    }
+}
+
 static void float_to_integer_samples (float *samples, int num_samples, int bits)
 {
     int isample, imin = -(1 << (bits - 1)), imax = (1 << (bits - 1)) - 1;
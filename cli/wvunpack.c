@@ -294,6 +294,7 @@ int main(int argc, char **argv)
     int verify_only = 0, error_count = 0, add_extension = 0, output_spec = 0, c_count = 0, x_count = 0;
     char outpath, **matches = NULL, *outfilename = NULL, **argv_fn = NULL, selfname [PATH_MAX];
     int use_stdin = 0, use_stdout = 0, argc_fn = 0, argi, result;
+    WavpackThreadPool *thread_pool = NULL;
 
 #if defined(_WIN32)
     if (!GetModuleFileName (NULL, selfname, sizeof (selfname)))
@@ -908,6 +909,12 @@ int main(int argc, char **argv)
 
         add_extension = !outfilename || outpath || !filespec_ext (outfilename);
 
+        // when processing multiple files with worker threads, share one pool of threads between
+        // them all rather than starting and stopping a new set of threads for each file
+
+        if (num_files > 1 && worker_threads)
+            WavpackSetThreadPool (thread_pool = WavpackCreateThreadPool (worker_threads));
+
         // loop through and process files in list
 
         for (file_index = 0; file_index < num_files; ++file_index) {
@@ -978,6 +985,7 @@ int main(int argc, char **argv)
             }
         }
 
+        WavpackDestroyThreadPool (thread_pool);
         free (matches);
     }
     else {
@@ -1573,7 +1581,8 @@ static int do_tag_extractions (WavpackContext *wpc, char *outfilename);
 static void *store_samples (void *dst, int32_t *src, int qmode, int bps, int count);
 static void dump_summary (WavpackContext *wpc, char *name, FILE *dst);
 static int dump_tag_item_to_file (WavpackContext *wpc, const char *tag_item, FILE *dst, char *fn);
-static void dump_file_info (WavpackContext *wpc, char *name, FILE *dst, int parameter);
+static void dump_file_info (WavpackProbeInfo *info, char *name, FILE *dst, int parameter);
+static void get_file_info (WavpackContext *wpc, WavpackProbeInfo *info);
 static void unreorder_channels (int32_t *data, unsigned char *order, int num_chans, int num_samples);
 
 static int unpack_file (char *infilename, char *outfilename, int add_extension)
@@ -1630,6 +1639,18 @@ static int unpack_file (char *infilename, char *outfilename, int add_extension)
     if (worker_threads)
         open_flags |= worker_threads << OPEN_THREADS_SHFT;
 
+    // the file info (-f) is all available from probing the file, which is much cheaper than opening it
+    // (if that fails, as it does for legacy files, we open the file to get the info or report the error)
+
+    if (file_info && *infilename != '-' && !skip.value_is_valid && !until.value_is_valid) {
+        WavpackProbeInfo info;
+
+        if (WavpackProbeFile (infilename, &info, NULL, open_flags)) {
+            dump_file_info (&info, infilename, stdout, file_info - 1);
+            return WAVPACK_NO_ERROR;
+        }
+    }
+
     wpc = WavpackOpenFileInput (infilename, error, open_flags, 0);
 
     if (!wpc) {
@@ -1792,8 +1813,12 @@ static int unpack_file (char *infilename, char *outfilename, int add_extension)
         }
     }
 
-    if (file_info)
-        dump_file_info (wpc, infilename, stdout, file_info - 1);
+    if (file_info) {
+        WavpackProbeInfo info;
+
+        get_file_info (wpc, &info);
+        dump_file_info (&info, infilename, stdout, file_info - 1);
+    }
     else if (summary)
         dump_summary (wpc, infilename, stdout);
     else if (tag_extract_stdout) {
@@ -3068,9 +3093,9 @@ static void dump_summary (WavpackContext *wpc, char *name, FILE *dst)
 // 9. encoding mode (in hex because it's a bitfield, always prefixed with "0x")
 // 10. filename (if available)
 
-static void dump_file_item (WavpackContext *wpc, char *str, int size, int item_id);
+static void dump_file_item (WavpackProbeInfo *info, char *str, int size, int item_id);
 
-static void dump_file_info (WavpackContext *wpc, char *name, FILE *dst, int parameter)
+static void dump_file_info (WavpackProbeInfo *info, char *name, FILE *dst, int parameter)
 {
     char str [100];
     int item_id;
@@ -3079,7 +3104,7 @@ static void dump_file_info (WavpackContext *wpc, char *name, FILE *dst, int para
 
     if (parameter == 0) {
         for (item_id = 1; item_id <= 9; ++item_id) {
-            dump_file_item (wpc, str, sizeof (str), item_id);
+            dump_file_item (info, str, sizeof (str), item_id);
             snprintf (str + strlen (str), sizeof (str) - strlen (str), ";");
         }
 
@@ -3089,7 +3114,7 @@ static void dump_file_info (WavpackContext *wpc, char *name, FILE *dst, int para
             fprintf (dst, "%s\n", str);
     }
     else if (parameter < 10) {
-        dump_file_item (wpc, str, sizeof (str), parameter);
+        dump_file_item (info, str, sizeof (str), parameter);
         fprintf (dst, "%s\n", str);
     }
     else if (parameter == 10 && name && *name != '-')
@@ -3098,45 +3123,43 @@ static void dump_file_info (WavpackContext *wpc, char *name, FILE *dst, int para
         fprintf (dst, "\n");
 }
 
-static void dump_file_item (WavpackContext *wpc, char *str, int size, int item_id)
+static void dump_file_item (WavpackProbeInfo *info, char *str, int size, int item_id)
 {
-    unsigned char md5_sum [16];
-
     switch (item_id) {
         case 1:
-            snprintf (str + strlen (str), size - strlen (str), "%d", raw_pcm ? WavpackGetSampleRate (wpc) : WavpackGetNativeSampleRate (wpc));
+            snprintf (str + strlen (str), size - strlen (str), "%d", raw_pcm ? info->sample_rate : info->native_sample_rate);
             break;
 
         case 2:
-            snprintf (str + strlen (str), size - strlen (str), "%d", ((WavpackGetQualifyMode (wpc) & QMODE_DSD_AUDIO) && !raw_pcm) ? 1 : WavpackGetBitsPerSample (wpc));
+            snprintf (str + strlen (str), size - strlen (str), "%d", ((info->qualify_mode & QMODE_DSD_AUDIO) && !raw_pcm) ? 1 : info->bits_per_sample);
             break;
 
         case 3:
-            snprintf (str + strlen (str), size - strlen (str), "%s", (WavpackGetMode (wpc) & MODE_FLOAT) ? "float" : "int");
+            snprintf (str + strlen (str), size - strlen (str), "%s", (info->mode & MODE_FLOAT) ? "float" : "int");
             break;
 
         case 4:
-            snprintf (str + strlen (str), size - strlen (str), "%d", WavpackGetNumChannels (wpc));
+            snprintf (str + strlen (str), size - strlen (str), "%d", info->num_channels);
             break;
 
         case 5:
-            snprintf (str + strlen (str), size - strlen (str), "0x%x", WavpackGetChannelMask (wpc));
+            snprintf (str + strlen (str), size - strlen (str), "0x%x", info->channel_mask);
             break;
 
         case 6:
-            if (WavpackGetNumSamples64 (wpc) != -1)
+            if (info->num_samples != -1)
                 snprintf (str + strlen (str), size - strlen (str), "%lld",
-                    (long long int) WavpackGetNumSamples64 (wpc) * (WavpackGetQualifyMode (wpc) & QMODE_DSD_AUDIO ? 8 : 1));
+                    (long long int) info->num_samples * (info->qualify_mode & QMODE_DSD_AUDIO ? 8 : 1));
 
             break;
 
         case 7:
-            if (WavpackGetMD5Sum (wpc, md5_sum)) {
+            if (info->md5_read) {
                 char md5_string [] = "00000000000000000000000000000000";
                 int i;
 
                 for (i = 0; i < 16; ++i)
-                    sprintf (md5_string + (i * 2), "%02x", md5_sum [i]);
+                    sprintf (md5_string + (i * 2), "%02x", info->md5_sum [i]);
 
                 snprintf (str + strlen (str), size - strlen (str), "%s", md5_string);
             }
@@ -3144,11 +3167,11 @@ static void dump_file_item (WavpackContext *wpc, char *str, int size, int item_i
             break;
 
         case 8:
-            snprintf (str + strlen (str), size - strlen (str), "%d", WavpackGetVersion (wpc));
+            snprintf (str + strlen (str), size - strlen (str), "%d", info->version);
             break;
 
         case 9:
-            snprintf (str + strlen (str), size - strlen (str), "0x%x", WavpackGetMode (wpc));
+            snprintf (str + strlen (str), size - strlen (str), "0x%x", info->mode);
             break;
 
         default:
@@ -3156,6 +3179,24 @@ static void dump_file_item (WavpackContext *wpc, char *str, int size, int item_i
     }
 }
 
+// Get the information used by dump_file_info() from an open file (for files that
+// WavpackProbeFile() can't handle). Only the fields used here are filled in.
+
+static void get_file_info (WavpackContext *wpc, WavpackProbeInfo *info)
+{
+    memset (info, 0, sizeof (*info));
+    info->sample_rate = WavpackGetSampleRate (wpc);
+    info->native_sample_rate = WavpackGetNativeSampleRate (wpc);
+    info->bits_per_sample = WavpackGetBitsPerSample (wpc);
+    info->qualify_mode = WavpackGetQualifyMode (wpc);
+    info->mode = WavpackGetMode (wpc);
+    info->num_channels = WavpackGetNumChannels (wpc);
+    info->channel_mask = WavpackGetChannelMask (wpc);
+    info->num_samples = WavpackGetNumSamples64 (wpc);
+    info->md5_read = WavpackGetMD5Sum (wpc, info->md5_sum);
+    info->version = WavpackGetVersion (wpc);
+}
+
 // Dump the specified tag field to the specified stream. Both text and binary tags may be written,
 // and in Windows the appropriate file mode will be set. If the tag is not found then 0 is returned,
 // otherwise the length of the data is returned, and this is true even when the file pointer is NULL
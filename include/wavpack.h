@@ -189,6 +189,7 @@ typedef struct {
 #define ID_ALT_MD5_CHECKSUM     (ID_OPTIONAL_DATA | 0x9)
 #define ID_NEW_CONFIG_BLOCK     (ID_OPTIONAL_DATA | 0xa)
 #define ID_CHANNEL_IDENTITIES   (ID_OPTIONAL_DATA | 0xb)
+#define ID_SEEK_TABLE           (ID_OPTIONAL_DATA | 0xd)
 #define ID_WVX_NEW_BITSTREAM    (ID_OPTIONAL_DATA | ID_WVX_BITSTREAM)
 #define ID_BLOCK_CHECKSUM       (ID_OPTIONAL_DATA | 0xf)
 
@@ -212,6 +213,7 @@ typedef struct {
 #define CONFIG_JOINT_STEREO     0x10    // joint stereo
 #define CONFIG_CROSS_DECORR     0x20    // no-delay cross decorrelation
 #define CONFIG_HYBRID_SHAPE     0x40    // noise shape (hybrid mode only)
+#define CONFIG_SEEK_TABLE       0x100   // store seek table in first block
 #define CONFIG_FAST_FLAG        0x200   // fast mode
 #define CONFIG_HIGH_FLAG        0x800   // high quality mode
 #define CONFIG_VERY_HIGH_FLAG   0x1000  // very high
@@ -310,6 +312,8 @@ WavpackContext *WavpackOpenRawDecoder (
 WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *wv_id, void *wvc_id, char *error, int flags, int norm_offset);
 WavpackContext *WavpackOpenFileInputEx (WavpackStreamReader *reader, void *wv_id, void *wvc_id, char *error, int flags, int norm_offset);
 WavpackContext *WavpackOpenFileInput (const char *infilename, char *error, int flags, int norm_offset);
+WavpackContext *WavpackOpenFileInputMemory (void *wv_data, int64_t wv_size, void *wvc_data, int64_t wvc_size, char *error, int flags, int norm_offset);
+WavpackContext *WavpackOpenFileInputMapped (const char *infilename, char *error, int flags, int norm_offset);
 
 #define OPEN_WVC        0x1     // open/read "correction" file
 #define OPEN_TAGS       0x2     // read ID3v1 / APEv2 tags (seekable file)
@@ -335,6 +339,57 @@ WavpackContext *WavpackOpenFileInput (const char *infilename, char *error, int f
 #define OPEN_THREADS_SHFT 12     // specify number of additional worker threads here for
 #define OPEN_THREADS_MASK 0xF000 // decode; 0 to disable, otherwise 1-15 added threads
 
+#define OPEN_LAZY       0x10000 // defer scanning end of file (for length) and reading tags
+                                // until first needed (e.g., WavpackGetNumSamples64() or seeks)
+
+// new for wide multichannel files (these are the upper 8 bits of the worker thread count above,
+// allowing up to 4095 added threads; use OPEN_THREADS() to specify any count in the open flags)
+
+#define OPEN_THREADS_HIGH_SHFT 20
+#define OPEN_THREADS_HIGH_MASK 0xFF00000
+#define OPEN_THREADS_MAX       4095
+
+#define OPEN_THREADS(n) ((((n) & 0xF) << OPEN_THREADS_SHFT) | ((((n) >> 4) & 0xFF) << OPEN_THREADS_HIGH_SHFT))
+
+// new for probing files without opening them (each field is what the corresponding WavpackGet*()
+// function would return after opening the file with the same flags; see WavpackProbeFile())
+
+typedef struct {
+    int64_t num_samples;            // total samples, or -1 if unknown
+    int64_t file_size;              // including any correction file
+    int64_t tag_position;           // file position and total length of the ID3v1 or APEv2 tag
+    int32_t tag_length, tag_items;  //   and APEv2 item count from the tag header (not parsed)
+    uint32_t sample_rate, native_sample_rate;
+    int num_channels, channel_mask, bits_per_sample, bytes_per_sample, float_norm_exp;
+    int version, mode, qualify_mode, file_format;
+    char file_extension [8];
+    unsigned char md5_sum [16];     // MD5 sum of the audio, only if md5_read is set
+    int md5_read;
+} WavpackProbeInfo;
+
+int WavpackProbeFile (const char *infilename, WavpackProbeInfo *info, char *error, int flags);
+int WavpackProbeBuffer (void *wv_data, int64_t wv_size, void *wvc_data, int64_t wvc_size, WavpackProbeInfo *info, char *error, int flags);
+int WavpackProbeFiles (char **infilenames, int num_files, WavpackProbeInfo *info, int flags);
+
+// new for sharing one set of worker threads among all contexts (see WavpackSetThreadPool())
+
+typedef struct WavpackThreadPool WavpackThreadPool;
+
+WavpackThreadPool *WavpackCreateThreadPool (int num_threads);
+void WavpackSetThreadPool (WavpackThreadPool *pool);
+void WavpackDestroyThreadPool (WavpackThreadPool *pool);
+
+// new for push-mode decoding of streams that arrive incrementally (see WavpackCreateDecoder())
+
+typedef struct WavpackStreamDecoder WavpackStreamDecoder;
+
+WavpackStreamDecoder *WavpackCreateDecoder (int flags, int norm_offset);
+int WavpackDecoderFeed (WavpackStreamDecoder *dec, const void *data, int32_t bcount);
+uint32_t WavpackDecoderDrain (WavpackStreamDecoder *dec, int32_t *buffer, uint32_t samples);
+WavpackContext *WavpackDecoderGetContext (WavpackStreamDecoder *dec);
+char *WavpackDecoderGetErrorMessage (WavpackStreamDecoder *dec);
+WavpackStreamDecoder *WavpackDestroyDecoder (WavpackStreamDecoder *dec);
+
 int WavpackGetMode (WavpackContext *wpc);
 
 #define MODE_WVC        0x1
@@ -359,15 +414,38 @@ int WavpackGetVersion (WavpackContext *wpc);
 char *WavpackGetFileExtension (WavpackContext *wpc);
 unsigned char WavpackGetFileFormat (WavpackContext *wpc);
 uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t samples);
+uint32_t WavpackUnpackSamplesFormat (WavpackContext *wpc, void *buffer, uint32_t samples, int format);
+uint32_t WavpackUnpackSamplesPlanar (WavpackContext *wpc, int32_t **buffers, uint32_t samples);
+int WavpackSelectChannels (WavpackContext *wpc, const int *channels, int count);
+
+#define UNPACK_INT16        0x1     // 16-bit signed integers (native endian)
+#define UNPACK_INT24_LE     0x2     // 24-bit signed integers, packed little-endian
+#define UNPACK_INT24_BE     0x3     // 24-bit signed integers, packed big-endian
+#define UNPACK_FLOAT32      0x4     // 32-bit floats (native endian)
+#define UNPACK_FORMAT_MASK  0xff
+#define UNPACK_NORMALIZE    0x100   // return floats normalized to +/- 1.0
+
 uint32_t WavpackGetNumSamples (WavpackContext *wpc);
 int64_t WavpackGetNumSamples64 (WavpackContext *wpc);
 uint32_t WavpackGetNumSamplesInFrame (WavpackContext *wpc);
 uint32_t WavpackGetSampleIndex (WavpackContext *wpc);
 int64_t WavpackGetSampleIndex64 (WavpackContext *wpc);
 int WavpackGetNumErrors (WavpackContext *wpc);
+void WavpackGetBlockBufferStats (WavpackContext *wpc, int64_t *allocations, int64_t *reuses);
 int WavpackLossyBlocks (WavpackContext *wpc);
 int WavpackSeekSample (WavpackContext *wpc, uint32_t sample);
 int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample);
+int WavpackBuildBlockIndex (WavpackContext *wpc);
+int32_t WavpackExportBlockIndex (WavpackContext *wpc, void *data, int32_t size);
+int WavpackImportBlockIndex (WavpackContext *wpc, const void *data, int32_t size);
+int WavpackSetBlockCache (WavpackContext *wpc, uint32_t max_bytes);
+void WavpackGetBlockCacheStats (WavpackContext *wpc, int64_t *hits, int64_t *misses);
+
+// WavpackReadRange() may be called from several threads at once on the same context only if the
+// library was built with ENABLE_THREADS; otherwise, like all the other calls, it must be serialized
+
+uint32_t WavpackReadRange (WavpackContext *wpc, int64_t start_sample, uint32_t samples, int32_t *buffer);
+WavpackContext *WavpackCloneContext (WavpackContext *wpc, WavpackStreamReader64 *reader, void *wv_id, void *wvc_id, char *error);
 WavpackContext *WavpackCloseFile (WavpackContext *wpc);
 uint32_t WavpackGetSampleRate (WavpackContext *wpc);
 uint32_t WavpackGetNativeSampleRate (WavpackContext *wpc);
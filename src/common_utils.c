@@ -96,6 +96,9 @@ int WavpackGetMode (WavpackContext *wpc)
                 mode |= MODE_DNS;
 
 #ifndef NO_TAGS
+        if (wpc->lazy_pending)
+            finish_lazy_open (wpc, LAZY_TAGS);
+
         if (valid_tag (&wpc->m_tag)) {
             mode |= MODE_VALID_TAG;
 
@@ -151,6 +154,9 @@ uint32_t WavpackGetNumSamples (WavpackContext *wpc)
 
 int64_t WavpackGetNumSamples64 (WavpackContext *wpc)
 {
+    if (wpc && wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TOTAL_SAMPLES);
+
     return wpc ? wpc->total_samples : -1;
 }
 
@@ -167,8 +173,15 @@ int64_t WavpackGetSampleIndex64 (WavpackContext *wpc)
 #ifdef ENABLE_LEGACY
         if (wpc->stream3)
             return get_sample_index3 (wpc);
-        else if (wpc->streams && wpc->streams [0])
-            return wpc->streams [0]->sample_index;
+#endif
+        // if we're reading from a cached block, the decoder might be anywhere
+        if (wpc->block_cache.current)
+            return wpc->block_cache.current->block_index + wpc->block_cache.current_pos;
+
+#ifdef ENABLE_THREADS
+        // the stream is ahead of the application by whatever remains in the read-ahead buffer
+        if (wpc->streams && wpc->streams [0])
+            return wpc->streams [0]->sample_index - (wpc->readahead_count - wpc->readahead_pos);
 #else
         if (wpc->streams && wpc->streams [0])
             return wpc->streams [0]->sample_index;
@@ -198,6 +211,9 @@ int WavpackLossyBlocks (WavpackContext *wpc)
 
 double WavpackGetProgress (WavpackContext *wpc)
 {
+    if (wpc && wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TOTAL_SAMPLES);
+
     if (wpc && wpc->total_samples != -1 && wpc->total_samples != 0)
         return (double) WavpackGetSampleIndex64 (wpc) / wpc->total_samples;
     else
@@ -222,7 +238,12 @@ int64_t WavpackGetFileSize64 (WavpackContext *wpc)
 
 static int64_t actual_total_samples (WavpackContext *wpc)
 {
-    int64_t total_samples = wpc->total_samples;
+    int64_t total_samples;
+
+    if (wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TOTAL_SAMPLES);
+
+    total_samples = wpc->total_samples;
 
     if (wpc->wv_out && wpc->streams && wpc->streams [0] && wpc->streams [0]->sample_index)
         total_samples = wpc->streams [0]->sample_index;
@@ -282,11 +303,17 @@ double WavpackGetInstantBitrate (WavpackContext *wpc)
         int si;
 
         for (si = 0; si < wpc->num_streams; ++si) {
-            if (wpc->streams [si]->blockbuff)
-                input_size += ((WavpackHeader *) wpc->streams [si]->blockbuff)->ckSize;
+            WavpackHeader wphdr;
 
-            if (wpc->streams [si]->block2buff)
-                input_size += ((WavpackHeader *) wpc->streams [si]->block2buff)->ckSize;
+            if (wpc->streams [si]->blockbuff) {
+                memcpy (&wphdr, wpc->streams [si]->blockbuff, sizeof (WavpackHeader));
+                input_size += wphdr.ckSize;
+            }
+
+            if (wpc->streams [si]->block2buff) {
+                memcpy (&wphdr, wpc->streams [si]->block2buff, sizeof (WavpackHeader));
+                input_size += wphdr.ckSize;
+            }
         }
 
         if (output_time > 0.0 && input_size >= 1.0)
@@ -362,28 +389,521 @@ void WavpackGetChannelIdentities (WavpackContext *wpc, unsigned char *identities
 
 #ifdef ENABLE_THREADS
 
+static void thread_pool_detach (WavpackThreadPool *pool);
+
 static void worker_threads_destroy (WavpackContext *wpc)
 {
     if (wpc->workers) {
         int i;
 
-        for (i = 0; i < wpc->num_workers; ++i) {
+        // with a shared thread pool we just have to wait for any jobs still running to
+        // complete, otherwise we tell our own threads to quit and wait for them to exit
+
+        if (wpc->thread_pool) {
             wp_mutex_obtain (wpc->mutex);
-            wpc->workers [i].state = Quit;
-            wp_condvar_signal (wpc->workers [i].worker_cond);
+
+            for (i = 0; i < wpc->num_workers; ++i)
+                while (wpc->workers [i].state == Running)
+                    wp_condvar_wait (wpc->global_cond, wpc->mutex);
+
             wp_mutex_release (wpc->mutex);
-            wp_thread_join (wpc->workers [i].thread);
-            wp_thread_delete (wpc->workers [i].thread);
+            thread_pool_detach (wpc->thread_pool);
+            wpc->thread_pool = NULL;
+        }
+        else
+            for (i = 0; i < wpc->num_workers; ++i) {
+                wp_mutex_obtain (wpc->mutex);
+                wpc->workers [i].state = Quit;
+                wp_condvar_signal (wpc->workers [i].worker_cond);
+                wp_mutex_release (wpc->mutex);
+                wp_thread_join (wpc->workers [i].thread);
+                wp_thread_delete (wpc->workers [i].thread);
+            }
+
+        for (i = 0; i < wpc->num_workers; ++i) {
             wp_condvar_delete (wpc->workers [i].worker_cond);
+            free (wpc->workers [i].temp_buffer);
         }
 
         free (wpc->workers);
         wpc->workers = NULL;
         wp_mutex_delete (wpc->mutex);
     }
+
+    free (wpc->stream_jobs);
+    free (wpc->stream_job_ranges);
+    wpc->stream_jobs = NULL;
+    wpc->stream_job_ranges = NULL;
+}
+
+// The shared thread pool installed with WavpackSetThreadPool(), if any. This and the user counts
+// and destroyed flags of all pools are protected by thread_pool_mutex, which is initialized on
+// first use (it can't be statically initialized on Windows).
+
+static WavpackThreadPool *shared_thread_pool;
+static wp_mutex_t thread_pool_mutex;
+
+static void thread_pool_mutex_init (void)
+{
+    wp_mutex_init (thread_pool_mutex);
+}
+
+static void thread_pool_lock (void)
+{
+    static wp_once_t thread_pool_once = WP_ONCE_INIT;
+
+    wp_call_once (&thread_pool_once, thread_pool_mutex_init);
+    wp_mutex_obtain (thread_pool_mutex);
+}
+
+// This is the thread function for the shared thread pool. Each thread takes the oldest job
+// from the queue, runs it, and then moves the worker to its "done" state and signals the
+// owning context (which must not be touched after that because it may be closing).
+
+#ifdef _WIN32
+static unsigned WINAPI thread_pool_thread (LPVOID param)
+#else
+static void *thread_pool_thread (void *param)
+#endif
+{
+    WavpackThreadPool *pool = param;
+
+    wp_mutex_obtain (pool->mutex);
+
+    while (1) {
+        WorkerInfo *cxt;
+
+        while (!pool->queue_head && !pool->quit)    // wait for something to do
+            wp_condvar_wait (pool->cond, pool->mutex);
+
+        if (!(cxt = pool->queue_head))              // break out if we're done
+            break;
+
+        if (!(pool->queue_head = cxt->next_job))
+            pool->queue_tail = NULL;
+
+        wp_mutex_release (pool->mutex);
+
+        cxt->job (cxt);                             // this is where the work is done
+
+        wp_mutex_obtain (*cxt->mutex);
+
+        if ((cxt->state = cxt->done_state) == Ready)
+            (*cxt->workers_ready)++;
+
+        wp_condvar_signal (*cxt->global_cond);      // signal completion
+        wp_mutex_release (*cxt->mutex);
+
+        wp_mutex_obtain (pool->mutex);
+    }
+
+    wp_mutex_release (pool->mutex);
+    wp_thread_exit (0);
+    return 0;
+}
+
+// Queue the specified worker's job to the shared thread pool. The worker's context must
+// already be in the Running state (and the caller may be holding the context mutex).
+
+void thread_pool_submit (WavpackThreadPool *pool, WorkerInfo *cxt)
+{
+    wp_mutex_obtain (pool->mutex);
+    cxt->next_job = NULL;
+
+    if (pool->queue_tail)
+        pool->queue_tail->next_job = cxt;
+    else
+        pool->queue_head = cxt;
+
+    pool->queue_tail = cxt;
+    wp_condvar_signal (pool->cond);
+    wp_mutex_release (pool->mutex);
+}
+
+// Stop all the threads in the pool and free it (there must be no users and no jobs)
+
+static void thread_pool_free (WavpackThreadPool *pool)
+{
+    int i;
+
+    wp_mutex_obtain (pool->mutex);
+    pool->quit = TRUE;
+    wp_condvar_broadcast (pool->cond);
+    wp_mutex_release (pool->mutex);
+
+    for (i = 0; i < pool->num_threads; ++i) {
+        wp_thread_join (pool->threads [i]);
+        wp_thread_delete (pool->threads [i]);
+    }
+
+    wp_condvar_delete (pool->cond);
+    wp_mutex_delete (pool->mutex);
+    free (pool->threads);
+    free (pool);
+}
+
+// Return the shared thread pool (if one is installed) for use by a context that's starting its
+// worker threads, or NULL if the context should start its own. Contexts that get a pool hold it
+// until they're closed, so a pool that's destroyed while in use is freed when the last one closes.
+
+WavpackThreadPool *thread_pool_attach (void)
+{
+    WavpackThreadPool *pool;
+
+    thread_pool_lock ();
+
+    if ((pool = shared_thread_pool))
+        pool->users++;
+
+    wp_mutex_release (thread_pool_mutex);
+    return pool;
+}
+
+static void thread_pool_detach (WavpackThreadPool *pool)
+{
+    int free_pool;
+
+    thread_pool_lock ();
+    free_pool = !--pool->users && pool->destroyed;
+    wp_mutex_release (thread_pool_mutex);
+
+    if (free_pool)
+        thread_pool_free (pool);
+}
+
+// Add a stream to the jobs for the current multichannel block (see run_stream_jobs()). Returns
+// FALSE if memory can't be allocated, in which case the caller should just do the job itself.
+
+int add_stream_job (WavpackContext *wpc, WavpackStream *wps, int32_t *outbuf, int32_t **outplanes, uint32_t offset, uint32_t samcnt)
+{
+    StreamJob *job;
+
+    if (wpc->num_stream_jobs == wpc->max_stream_jobs) {
+        int new_max = wpc->max_stream_jobs ? wpc->max_stream_jobs * 2 : 16;
+        StreamJob *new_jobs = realloc (wpc->stream_jobs, new_max * sizeof (StreamJob));
+
+        if (!new_jobs)
+            return FALSE;
+
+        wpc->stream_jobs = new_jobs;
+        wpc->max_stream_jobs = new_max;
+    }
+
+    job = wpc->stream_jobs + wpc->num_stream_jobs++;
+    job->wps = wps;
+    job->outbuf = outbuf;
+    job->outplanes = outplanes;
+    job->offset = offset;
+    job->samcnt = samcnt;
+    job->result = TRUE;
+    return TRUE;
+}
+
+// Take the next stream job for the specified participant, which is the first one left in its own
+// range, or when that's empty, the last one in the range with the most jobs left (i.e., we steal
+// from the other end so that the owner keeps working through its streams in order). Returns -1
+// when there are no jobs left anywhere.
+
+static int stream_job_claim (WavpackContext *wpc, int index)
+{
+    StreamJobRange *range = wpc->stream_job_ranges + index, *victim = NULL;
+    int job = -1, i;
+
+    wp_mutex_obtain (wpc->mutex);
+
+    if (range->head < range->tail)
+        job = range->head++;
+    else {
+        for (i = 0; i < wpc->num_stream_job_ranges; ++i)
+            if (wpc->stream_job_ranges [i].tail - wpc->stream_job_ranges [i].head > (victim ? victim->tail - victim->head : 0))
+                victim = wpc->stream_job_ranges + i;
+
+        if (victim)
+            job = --victim->tail;
+    }
+
+    wp_mutex_release (wpc->mutex);
+
+    return job;
+}
+
+// This is the job given to each worker participating in run_stream_jobs()
+
+static void stream_jobs_worker (WorkerInfo *cxt)
+{
+    WavpackContext *wpc = cxt->wpc;
+    int job;
+
+    while ((job = stream_job_claim (wpc, cxt->index)) >= 0)
+        wpc->stream_job_func (cxt, wpc->stream_jobs + job);
+}
+
+// Run all the stream jobs added for the current multichannel block and return when they're all done.
+// Rather than handing the streams to the workers one at a time, which needs a handshake for each
+// stream and leaves balancing the load to chance, the jobs are divided into contiguous ranges with
+// about the same number of channels, one for each worker and one for the calling thread, and they all
+// start at once. When one runs out of jobs it steals from the range with the most left, so the load
+// balances itself even when the costs of the streams vary a lot. The job function is passed the
+// WorkerInfo of the thread doing the job (for its temp buffer and error count), and for the calling
+// thread that has the specified temp buffer (which must be big enough for any of the jobs). The
+// jobs are left in the context for the caller.
+
+void run_stream_jobs (WavpackContext *wpc, void (*job_func) (WorkerInfo *cxt, StreamJob *job), int32_t *temp_buffer, uint32_t temp_samples)
+{
+    int participants = wpc->num_workers + 1, total_chans = 0, chans = 0, job, i;
+    WorkerInfo caller;
+
+    memset (&caller, 0, sizeof (caller));
+    caller.mutex = &wpc->mutex;
+    caller.worker_errors = &wpc->worker_errors;
+    caller.temp_buffer = temp_buffer;
+    caller.temp_samples = temp_samples;
+
+    if (participants > wpc->num_stream_jobs)
+        participants = wpc->num_stream_jobs;
+
+    if (!wpc->stream_job_ranges)
+        wpc->stream_job_ranges = malloc ((wpc->num_workers + 1) * sizeof (StreamJobRange));
+
+    // if there's nothing to share (or no memory) we just do all the jobs ourselves
+
+    if (participants < 2 || !wpc->stream_job_ranges) {
+        for (job = 0; job < wpc->num_stream_jobs; ++job)
+            job_func (&caller, wpc->stream_jobs + job);
+
+        return;
+    }
+
+    // divide the jobs into ranges by channel count (the calling thread gets the last range)
+
+    for (job = 0; job < wpc->num_stream_jobs; ++job)
+        total_chans += (wpc->stream_jobs [job].wps->wphdr.flags & MONO_FLAG) ? 1 : 2;
+
+    for (i = 0; i < participants; ++i)
+        wpc->stream_job_ranges [i].head = wpc->stream_job_ranges [i].tail = 0;
+
+    for (job = 0; job < wpc->num_stream_jobs; ++job) {
+        StreamJobRange *range = wpc->stream_job_ranges + (int)((int64_t) chans * participants / total_chans);
+
+        if (range->head == range->tail)
+            range->head = job;
+
+        range->tail = job + 1;
+        chans += (wpc->stream_jobs [job].wps->wphdr.flags & MONO_FLAG) ? 1 : 2;
+    }
+
+    wpc->num_stream_job_ranges = participants;
+    wpc->stream_job_func = job_func;
+
+    // start the workers, which should all be ready (because no other jobs are pending)
+
+    wp_mutex_obtain (wpc->mutex);
+
+    while (wpc->workers_ready < wpc->num_workers)
+        wp_condvar_wait (wpc->global_cond, wpc->mutex);
+
+    for (i = 0; i < participants - 1; ++i) {
+        wpc->workers [i].job = stream_jobs_worker;
+        wpc->workers [i].done_state = Ready;
+        wpc->workers [i].state = Running;
+        wpc->workers_ready--;
+
+        if (wpc->thread_pool)
+            thread_pool_submit (wpc->thread_pool, &wpc->workers [i]);
+        else
+            wp_condvar_signal (wpc->workers [i].worker_cond);
+    }
+
+    wp_mutex_release (wpc->mutex);
+
+    // now we do our share (and whatever we can steal), then wait for the workers to finish theirs
+
+    while ((job = stream_job_claim (wpc, participants - 1)) >= 0)
+        job_func (&caller, wpc->stream_jobs + job);
+
+    wp_mutex_obtain (wpc->mutex);
+
+    while (wpc->workers_ready < wpc->num_workers)
+        wp_condvar_wait (wpc->global_cond, wpc->mutex);
+
+    wp_mutex_release (wpc->mutex);
+}
+
+// Take the next job for run_parallel_jobs(), or return -1 if they've all been taken
+
+static int parallel_job_claim (WavpackContext *wpc)
+{
+    int job = -1;
+
+    wp_mutex_obtain (wpc->mutex);
+
+    if (wpc->parallel_jobs_next < wpc->parallel_jobs_total)
+        job = wpc->parallel_jobs_next++;
+
+    wp_mutex_release (wpc->mutex);
+
+    return job;
+}
+
+// This is the job given to each worker helping with run_parallel_jobs()
+
+static void parallel_jobs_worker (WorkerInfo *cxt)
+{
+    WavpackContext *wpc = cxt->wpc;
+    int job;
+
+    while ((job = parallel_job_claim (wpc)) >= 0)
+        wpc->parallel_job_func (wpc->parallel_job_data, job);
+}
+
+// Run the specified number of independent jobs (numbered from zero) and return when they're all done.
+// The calling thread does them along with whichever of the context's workers are ready right now; busy
+// workers are not waited for, so this can be used while other blocks are being packed in the background
+// (and with no workers ready, the calling thread simply does all the jobs in order). The jobs are taken
+// one at a time, so they should be about the same size and large enough to be worth the handoff. This
+// may only be called from the thread that owns the context (never from a job running on a worker).
+
+void run_parallel_jobs (WavpackContext *wpc, void (*job_func) (void *data, int job), void *data, int num_jobs)
+{
+    int helpers = 0, job, i;
+
+    if (!wpc->workers || num_jobs < 2) {
+        for (job = 0; job < num_jobs; ++job)
+            job_func (data, job);
+
+        return;
+    }
+
+    wp_mutex_obtain (wpc->mutex);
+    wpc->parallel_job_func = job_func;
+    wpc->parallel_job_data = data;
+    wpc->parallel_jobs_next = 0;
+    wpc->parallel_jobs_total = num_jobs;
+
+    for (i = 0; i < wpc->num_workers && helpers < num_jobs - 1; ++i)
+        if (wpc->workers [i].state == Ready) {
+            wpc->workers [i].job = parallel_jobs_worker;
+            wpc->workers [i].done_state = Ready;
+            wpc->workers [i].state = Running;
+            wpc->workers_ready--;
+            helpers++;
+
+            if (wpc->thread_pool)
+                thread_pool_submit (wpc->thread_pool, &wpc->workers [i]);
+            else
+                wp_condvar_signal (wpc->workers [i].worker_cond);
+        }
+
+    wp_mutex_release (wpc->mutex);
+
+    while ((job = parallel_job_claim (wpc)) >= 0)
+        job_func (data, job);
+
+    // wait for the helpers to finish the jobs they took (they go back to ready when done)
+
+    wp_mutex_obtain (wpc->mutex);
+
+    for (i = 0; i < wpc->num_workers; ++i)
+        while (wpc->workers [i].job == parallel_jobs_worker && wpc->workers [i].state == Running)
+            wp_condvar_wait (wpc->global_cond, wpc->mutex);
+
+    wp_mutex_release (wpc->mutex);
+}
+
+#endif
+
+// Create a pool of worker threads that can be shared by all contexts instead of each context starting
+// (and later stopping) its own. This is useful for applications that decode (or encode) many files
+// at once, or many short files in sequence, because it avoids creating and destroying threads for
+// every file and bounds the total number of threads. The pool is not used until it is installed with
+// WavpackSetThreadPool(). Returns NULL if threads are not enabled in the library or can't be started.
+
+WavpackThreadPool *WavpackCreateThreadPool (int num_threads)
+{
+#ifdef ENABLE_THREADS
+    WavpackThreadPool *pool;
+
+    if (num_threads < 1 || !(pool = calloc (1, sizeof (WavpackThreadPool))))
+        return NULL;
+
+    if (!(pool->threads = calloc (num_threads, sizeof (wp_thread_t)))) {
+        free (pool);
+        return NULL;
+    }
+
+    wp_mutex_init (pool->mutex);
+    wp_condvar_init (pool->cond);
+
+    // gracefully handle failures in creating threads (but we need at least one)
+
+    while (pool->num_threads < num_threads) {
+        wp_thread_create (pool->threads [pool->num_threads], thread_pool_thread, pool);
+
+        if (!pool->threads [pool->num_threads])
+            break;
+
+        pool->num_threads++;
+    }
+
+    if (!pool->num_threads) {
+        thread_pool_free (pool);
+        return NULL;
+    }
+
+    return pool;
+#else
+    (void) num_threads;
+    return NULL;
+#endif
+}
+
+// Install the specified thread pool as the one shared by all contexts, or pass NULL to go back to
+// each context starting its own threads. This affects contexts that start their worker threads
+// afterward (i.e., that are opened with OPEN_THREADS_MASK or configured with worker_threads), and
+// those still start no more than the number of workers they request, so that remains the limit on
+// how many of their jobs can be running at once. This may be called at any time from any thread
+// (contexts already using the previous pool keep using it until they're closed).
+
+void WavpackSetThreadPool (WavpackThreadPool *pool)
+{
+#ifdef ENABLE_THREADS
+    thread_pool_lock ();
+    shared_thread_pool = pool;
+    wp_mutex_release (thread_pool_mutex);
+#else
+    (void) pool;
+#endif
 }
 
+// Destroy a thread pool created with WavpackCreateThreadPool(). If the pool is installed it
+// is removed first, and if contexts are still using it then it's freed when the last closes.
+// This may be called at any time from any thread, but of course not more than once per pool.
+
+void WavpackDestroyThreadPool (WavpackThreadPool *pool)
+{
+#ifdef ENABLE_THREADS
+    int free_pool;
+
+    if (!pool)
+        return;
+
+    thread_pool_lock ();
+
+    if (shared_thread_pool == pool)
+        shared_thread_pool = NULL;
+
+    pool->destroyed = TRUE;
+    free_pool = !pool->users;
+    wp_mutex_release (thread_pool_mutex);
+
+    if (free_pool)
+        thread_pool_free (pool);
+#else
+    (void) pool;
 #endif
+}
+
+static void block_buffers_free (WavpackContext *wpc);
 
 // For local use only. Install a callback to be executed when WavpackCloseFile() is called,
 // usually used to dump some statistics accumulated during encode or decode.
@@ -439,6 +959,9 @@ WavpackContext *WavpackCloseFile (WavpackContext *wpc)
     if (wpc->channel_reordering)
         free (wpc->channel_reordering);
 
+    if (wpc->channel_map)
+        free (wpc->channel_map);
+
 #ifndef NO_TAGS
     free_tag (&wpc->m_tag);
 #endif
@@ -450,8 +973,36 @@ WavpackContext *WavpackCloseFile (WavpackContext *wpc)
 
 #ifdef ENABLE_THREADS
     worker_threads_destroy (wpc);
+
+    if (wpc->readahead_buffer)
+        free (wpc->readahead_buffer);
+
+    wp_mutex_delete (wpc->reader_mutex);
 #endif
 
+    block_buffers_free (wpc);
+
+    if (wpc->format_buffer)
+        free (wpc->format_buffer);
+
+    if (wpc->plane_pointers)
+        free (wpc->plane_pointers);
+
+    if (wpc->wv_index.entries)
+        free (wpc->wv_index.entries);
+
+    if (wpc->wvc_index.entries)
+        free (wpc->wvc_index.entries);
+
+    if (wpc->block_cache.blocks) {
+        int i;
+
+        for (i = 0; i < wpc->block_cache.count; ++i)
+            free (wpc->block_cache.blocks [i].samples);
+
+        free (wpc->block_cache.blocks);
+    }
+
     free (wpc);
 
     return NULL;
@@ -554,7 +1105,8 @@ int WavpackGetBytesPerSample (WavpackContext *wpc)
 // will return the actual number of channels decoded from the file (which may
 // or may not be less than the actual number of channels, but will always be
 // 1 or 2). Normally, this will be the front left and right channels of a
-// multichannel file.
+// multichannel file. If channels have been selected with WavpackSelectChannels()
+// then this is the number of channels selected.
 
 int WavpackGetReducedChannels (WavpackContext *wpc)
 {
@@ -588,13 +1140,15 @@ void free_streams (WavpackContext *wpc)
 void free_single_stream (WavpackStream *wps)
 {
     if (wps->blockbuff) {
-        free (wps->blockbuff);
+        block_buffer_release ((WavpackContext *) wps->wpc, wps->blockbuff, wps->blockbuff_size);
         wps->blockbuff = NULL;
+        wps->blockbuff_size = 0;
     }
 
     if (wps->block2buff) {
-        free (wps->block2buff);
+        block_buffer_release ((WavpackContext *) wps->wpc, wps->block2buff, wps->block2buff_size);
         wps->block2buff = NULL;
+        wps->block2buff_size = 0;
     }
 
     if (wps->sample_buffer) {
@@ -617,6 +1171,191 @@ void free_single_stream (WavpackStream *wps)
 #endif
 }
 
+// Obtain a buffer of at least the specified number of bytes for holding a WavPack block. Rather than
+// allocating a new buffer for every block, we keep a pool of released buffers in the context and hand
+// those out again. All buffers are allocated to the size of the largest block seen so far (rounded up
+// to 4K), so a pooled buffer is almost always big enough. The actual size of the returned buffer is
+// stored at "size" (this must be passed back in the release). Because streams may be freed from worker
+// threads, the pool is protected by the context mutex when worker threads are running.
+
+unsigned char *block_buffer_obtain (WavpackContext *wpc, uint32_t bytes, uint32_t *size)
+{
+    unsigned char *buffer = NULL;
+
+#ifdef ENABLE_THREADS
+    if (wpc->workers)
+        wp_mutex_obtain (wpc->mutex);
+#endif
+
+    if (bytes > wpc->block_pool_bytes)
+        wpc->block_pool_bytes = (bytes + 4095) & ~4095;
+
+    if (wpc->block_pool_count) {
+        BlockBuffer *entry = wpc->block_pool + --wpc->block_pool_count;
+
+        if (entry->size >= bytes) {
+            buffer = entry->buffer;
+            *size = entry->size;
+            wpc->block_pool_reuses++;
+        }
+        else
+            free (entry->buffer);
+    }
+
+    if (!buffer) {
+        buffer = malloc (*size = wpc->block_pool_bytes);
+
+        if (buffer)
+            wpc->block_pool_allocs++;
+        else
+            *size = 0;
+    }
+
+#ifdef ENABLE_THREADS
+    if (wpc->workers)
+        wp_mutex_release (wpc->mutex);
+#endif
+
+    return buffer;
+}
+
+// Return a block buffer to the context pool so that it can be used again. A size of zero indicates that
+// the buffer did not come from the pool (e.g., during encoding) and it is simply freed.
+
+void block_buffer_release (WavpackContext *wpc, unsigned char *buffer, uint32_t size)
+{
+    if (size == BLOCK_BUFFER_BORROWED)      // points into the caller's data, so nothing to do
+        return;
+
+    if (!wpc || !size) {
+        free (buffer);
+        return;
+    }
+
+#ifdef ENABLE_THREADS
+    if (wpc->workers)
+        wp_mutex_obtain (wpc->mutex);
+#endif
+
+    if (wpc->block_pool_count == wpc->block_pool_max) {
+        BlockBuffer *new_pool = realloc (wpc->block_pool, (wpc->block_pool_max + 8) * sizeof (BlockBuffer));
+
+        if (new_pool) {
+            wpc->block_pool = new_pool;
+            wpc->block_pool_max += 8;
+        }
+    }
+
+    if (wpc->block_pool_count < wpc->block_pool_max) {
+        wpc->block_pool [wpc->block_pool_count].buffer = buffer;
+        wpc->block_pool [wpc->block_pool_count++].size = size;
+    }
+    else
+        free (buffer);
+
+#ifdef ENABLE_THREADS
+    if (wpc->workers)
+        wp_mutex_release (wpc->mutex);
+#endif
+}
+
+// Free all the block buffers in the context pool (must be called single-threaded)
+
+static void block_buffers_free (WavpackContext *wpc)
+{
+    while (wpc->block_pool_count)
+        free (wpc->block_pool [--wpc->block_pool_count].buffer);
+
+    free (wpc->block_pool);
+    wpc->block_pool = NULL;
+    wpc->block_pool_max = 0;
+}
+
+// Return the number of block buffers that have actually been allocated during decoding, and the
+// number of times a pooled buffer was reused instead (i.e., the number of allocations avoided).
+
+void WavpackGetBlockBufferStats (WavpackContext *wpc, int64_t *allocations, int64_t *reuses)
+{
+    if (allocations)
+        *allocations = wpc ? wpc->block_pool_allocs : 0;
+
+    if (reuses)
+        *reuses = wpc ? wpc->block_pool_reuses : 0;
+}
+
+// Add an entry for an initial block to the specified block index, keeping the entries sorted. Entries
+// for blocks already indexed (or that would overlap an existing entry) are ignored.
+
+void block_index_add (BlockIndex *index, int64_t block_index, int64_t file_pos, uint32_t block_samples)
+{
+    int low = 0, high = index->count;
+
+    // binary search for the first entry past the new block (the common case of appending is checked first)
+
+    if (!high || index->entries [high - 1].block_index < block_index)
+        low = high;
+    else
+        while (low < high) {
+            int mid = (low + high) >> 1;
+
+            if (index->entries [mid].block_index <= block_index)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+
+    if ((low && index->entries [low - 1].block_index + index->entries [low - 1].block_samples > block_index) ||
+        (low < index->count && block_index + block_samples > index->entries [low].block_index))
+            return;
+
+    if (index->count == index->max) {
+        int new_max = index->max ? index->max * 2 : 256;
+        BlockIndexEntry *new_entries = realloc (index->entries, new_max * sizeof (BlockIndexEntry));
+
+        if (!new_entries)
+            return;
+
+        index->entries = new_entries;
+        index->max = new_max;
+    }
+
+    if (low < index->count)
+        memmove (index->entries + low + 1, index->entries + low, (index->count - low) * sizeof (BlockIndexEntry));
+
+    index->entries [low].block_index = block_index;
+    index->entries [low].file_pos = file_pos;
+    index->entries [low].block_samples = block_samples;
+    index->count++;
+}
+
+// Call the specified function exactly once for the specified wp_once_t (which must be statically
+// initialized to WP_ONCE_INIT), even if several threads get here at once. Any thread that arrives
+// while the function is running waits for it to finish, so on return the initialization is done.
+
+#if defined(ENABLE_THREADS) && defined(_WIN32)
+static BOOL CALLBACK call_once_callback (PINIT_ONCE once, PVOID param, PVOID *context)
+{
+    (*(void (**) (void)) param) ();
+    return TRUE;
+}
+#endif
+
+void wp_call_once (wp_once_t *once, void (*init_func) (void))
+{
+#ifdef ENABLE_THREADS
+#ifdef _WIN32
+    InitOnceExecuteOnce (once, call_once_callback, &init_func, NULL);
+#else
+    pthread_once (once, init_func);
+#endif
+#else
+    if (!*once) {
+        *once = 1;
+        init_func ();
+    }
+#endif
+}
+
 // Free all DSD-related resources associated with the specified stream
 
 void free_dsd_tables (WavpackStream *wps)
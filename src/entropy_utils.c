@@ -64,7 +64,9 @@ const char nbits_table [] = {
     8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8      // 240 - 255
 };
 
-static const unsigned char log2_table [] = {
+// The log2 table has 3 bytes of padding so that it can be read as 32-bit words (see pack_simd.c)
+
+const unsigned char log2_table [256 + 3] = {
     0x00, 0x01, 0x03, 0x04, 0x06, 0x07, 0x09, 0x0a, 0x0b, 0x0d, 0x0e, 0x10, 0x11, 0x12, 0x14, 0x15,
     0x16, 0x18, 0x19, 0x1a, 0x1c, 0x1d, 0x1e, 0x20, 0x21, 0x22, 0x24, 0x25, 0x26, 0x28, 0x29, 0x2a,
     0x2c, 0x2d, 0x2e, 0x2f, 0x31, 0x32, 0x33, 0x34, 0x36, 0x37, 0x38, 0x39, 0x3b, 0x3c, 0x3d, 0x3e,
@@ -321,6 +323,55 @@ uint32_t log2buffer (int32_t *samples, uint32_t num_samples, int limit)
 
 #endif
 
+// These functions calculate the checksums that are stored in each block header
+// for a buffer of mono or stereo samples (in the latter case num_samples is the
+// number of stereo pairs). These are defined as crc = crc * 3 + sample for mono
+// and crc = crc * 9 + left * 3 + right for stereo, which is a long serial chain
+// of multiplies. However, because the function is linear it can be split into
+// four independent "lanes" that each handle every fourth sample (multiplying by
+// 3^4 or 9^4 each step) and then be combined at the end with the appropriate
+// powers of 3 (or 9). The lanes can execute in parallel and are easily handled
+// by the compiler's vectorizer, and the results are identical. Note that the
+// running crc is placed in the last lane because it gets a multiplier of 1.
+
+uint32_t crc_mono_samples (uint32_t crc, const int32_t *samples, uint32_t num_samples)
+{
+    uint32_t lane0 = 0, lane1 = 0, lane2 = 0, lane3 = crc;
+
+    for (; num_samples >= 4; num_samples -= 4, samples += 4) {
+        lane0 = lane0 * 81 + samples [0];
+        lane1 = lane1 * 81 + samples [1];
+        lane2 = lane2 * 81 + samples [2];
+        lane3 = lane3 * 81 + samples [3];
+    }
+
+    crc = lane0 * 27 + lane1 * 9 + lane2 * 3 + lane3;
+
+    while (num_samples--)
+        crc = crc * 3 + *samples++;
+
+    return crc;
+}
+
+uint32_t crc_stereo_samples (uint32_t crc, const int32_t *samples, uint32_t num_samples)
+{
+    uint32_t lane0 = 0, lane1 = 0, lane2 = 0, lane3 = crc;
+
+    for (; num_samples >= 4; num_samples -= 4, samples += 8) {
+        lane0 = lane0 * 6561 + (uint32_t) samples [0] * 3 + samples [1];
+        lane1 = lane1 * 6561 + (uint32_t) samples [2] * 3 + samples [3];
+        lane2 = lane2 * 6561 + (uint32_t) samples [4] * 3 + samples [5];
+        lane3 = lane3 * 6561 + (uint32_t) samples [6] * 3 + samples [7];
+    }
+
+    crc = lane0 * 729 + lane1 * 81 + lane2 * 9 + lane3;
+
+    for (; num_samples--; samples += 2)
+        crc = crc * 9 + (uint32_t) samples [0] * 3 + samples [1];
+
+    return crc;
+}
+
 // This function returns the log2 for the specified 32-bit signed value.
 // All input values are valid and the return values are in the range of
 // +/- 8192.
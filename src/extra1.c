@@ -32,6 +32,10 @@
 
 #define LOG_LIMIT 6912
 
+// This is the most terms that recurse_mono() tries at each depth (1 to 8, 17 and 18)
+
+#define MAX_SEARCH_TERMS 10
+
 //#define EXTRA_DUMP        // dump generated filter data  error_line()
 
 #ifdef OPT_ASM_X86
@@ -46,13 +50,32 @@
     void ASMCALL PACK_DECORR_MONO_PASS_CONT (int32_t *out_buffer, int32_t *in_buffer,  struct decorr_pass *dpp, int32_t sample_count);
 #endif
 
+// The log2buffer() used for the search is selected at runtime from the available assembly and
+// SIMD versions by extra_mono_init_dispatch(). There are no SIMD versions of the mono passes because
+// each sample depends on the weight from the previous one (see pack_simd.c).
+
+typedef uint32_t (ASMCALL *log2buffer_func) (int32_t *samples, uint32_t num_samples, int limit);
+static log2buffer_func log2buffer_best = LOG2BUFFER;
+
 typedef struct {
     int32_t *sampleptrs [MAX_NTERMS+2];
     struct decorr_pass dps [MAX_NTERMS];
     int nterms, log_limit;
     uint32_t best_bits;
+    int32_t *termptrs [MAX_SEARCH_TERMS];   // for parallel_search, one output buffer per term tried
 } WavpackExtraInfo;
 
+// This holds the terms tried at one depth of recurse_mono() so that they can be evaluated
+// independently (and in parallel), each from its own copy of the decorrelation pass
+
+typedef struct {
+    WavpackStream *wps;
+    WavpackExtraInfo *info;
+    int depth, num_terms;
+    struct decorr_pass dps [MAX_SEARCH_TERMS];
+    uint32_t bits [MAX_SEARCH_TERMS];
+} SearchTerms;
+
 static void decorr_mono_pass (int32_t *in_samples, int32_t *out_samples, uint32_t num_samples, struct decorr_pass *dpp, int dir)
 {
     int32_t cont_samples = 0;
@@ -184,9 +207,9 @@ static void reverse_mono_decorr (struct decorr_pass *dpp)
     }
 }
 
-static void decorr_mono_buffer (int32_t *samples, int32_t *outsamples, uint32_t num_samples, struct decorr_pass *dpp, int tindex)
+static void decorr_mono_buffer (int32_t *samples, int32_t *outsamples, uint32_t num_samples, struct decorr_pass *dppi, int tindex)
 {
-    struct decorr_pass dp, *dppi = dpp + tindex;
+    struct decorr_pass dp;
     int delta = dppi->delta, pre_delta, term = dppi->term;
 
     if (delta == 7)
@@ -236,11 +259,38 @@ static int log2overhead (int first_term, int num_terms)
 #endif
 }
 
+#ifdef ENABLE_THREADS
+
+// Evaluate one of the terms set up by recurse_mono(). This only reads the shared info and
+// writes the term's own pass, bit count and buffer, so any number can be running at once.
+
+static void search_mono_term (void *data, int index)
+{
+    SearchTerms *terms = data;
+    WavpackStream *wps = terms->wps;
+    WavpackExtraInfo *info = terms->info;
+    struct decorr_pass *dpp = terms->dps + index;
+    int32_t *outsamples = info->termptrs [index];
+    uint32_t bits;
+
+    decorr_mono_buffer (info->sampleptrs [terms->depth], outsamples, wps->wphdr.block_samples, dpp, terms->depth);
+    bits = log2buffer_best (outsamples, wps->wphdr.block_samples, info->log_limit);
+
+    if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
+        bits += log2overhead (terms->depth ? info->dps [0].term : dpp->term, terms->depth + 1);
+
+    terms->bits [index] = bits;
+}
+
+#endif
+
 static void recurse_mono (WavpackStream *wps, WavpackExtraInfo *info, int depth, int delta, uint32_t input_bits)
 {
     int term, branches = ((wps->extra_flags & EXTRA_BRANCHES) >> 6) - depth;
     int32_t *samples, *outsamples;
     uint32_t term_bits [22], bits;
+    SearchTerms terms;
+    int index;
 
     if (branches < 1 || depth + 1 == info->nterms)
         branches = 1;
@@ -248,6 +298,12 @@ static void recurse_mono (WavpackStream *wps, WavpackExtraInfo *info, int depth,
     CLEARA (term_bits);
     samples = info->sampleptrs [depth];
     outsamples = info->sampleptrs [depth + 1];
+#ifdef ENABLE_THREADS
+    terms.wps = wps;
+    terms.info = info;
+    terms.depth = depth;
+#endif
+    terms.num_terms = 0;
 
     for (term = 1; term <= 18; ++term) {
         if (term == 17 && branches == 1 && depth + 1 < info->nterms)
@@ -259,22 +315,44 @@ static void recurse_mono (WavpackStream *wps, WavpackExtraInfo *info, int depth,
         if ((wps->wpc->config.flags & CONFIG_FAST_FLAG) && (term > 4 && term < 17))
             continue;
 
-        info->dps [depth].term = term;
-        info->dps [depth].delta = delta;
-        decorr_mono_buffer (samples, outsamples, wps->wphdr.block_samples, info->dps, depth);
-        bits = LOG2BUFFER (outsamples, wps->wphdr.block_samples, info->log_limit);
+        terms.dps [terms.num_terms] = info->dps [depth];
+        terms.dps [terms.num_terms].term = term;
+        terms.dps [terms.num_terms++].delta = delta;
+    }
 
-        if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
-            bits += log2overhead (info->dps [0].term, depth + 1);
+    // With term buffers we evaluate all the terms first (using whatever workers are idle) and
+    // then pick the best in the same order as the serial search, so the result is identical.
+
+#ifdef ENABLE_THREADS
+    if (info->termptrs [0])
+        run_parallel_jobs ((WavpackContext *) wps->wpc, search_mono_term, &terms, terms.num_terms);
+#endif
+
+    for (index = 0; index < terms.num_terms; ++index) {
+        int32_t *termsamples = outsamples;
+
+        info->dps [depth] = terms.dps [index];
+
+        if (info->termptrs [0]) {
+            termsamples = info->termptrs [index];
+            bits = terms.bits [index];
+        }
+        else {
+            decorr_mono_buffer (samples, outsamples, wps->wphdr.block_samples, info->dps + depth, depth);
+            bits = log2buffer_best (outsamples, wps->wphdr.block_samples, info->log_limit);
+
+            if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
+                bits += log2overhead (info->dps [0].term, depth + 1);
+        }
 
         if (bits < info->best_bits) {
             info->best_bits = bits;
             CLEARA (wps->decorr_passes);
             memcpy (wps->decorr_passes, info->dps, sizeof (info->dps [0]) * (depth + 1));
-            memcpy (info->sampleptrs [info->nterms + 1], info->sampleptrs [depth + 1], wps->wphdr.block_samples * 4);
+            memcpy (info->sampleptrs [info->nterms + 1], termsamples, wps->wphdr.block_samples * 4);
         }
 
-        term_bits [term + 3] = bits;
+        term_bits [info->dps [depth].term + 3] = bits;
     }
 
     while (depth + 1 < info->nterms && branches--) {
@@ -295,7 +373,7 @@ static void recurse_mono (WavpackStream *wps, WavpackExtraInfo *info, int depth,
 
         info->dps [depth].term = best_term;
         info->dps [depth].delta = delta;
-        decorr_mono_buffer (samples, outsamples, wps->wphdr.block_samples, info->dps, depth);
+        decorr_mono_buffer (samples, outsamples, wps->wphdr.block_samples, info->dps + depth, depth);
 
 //      if (log2buffer (outsamples, wps->wphdr.block_samples * 2, 0) != local_best_bits)
 //          error_line ("data doesn't match!");
@@ -323,10 +401,10 @@ static void delta_mono (WavpackStream *wps, WavpackExtraInfo *info)
         for (i = 0; i < info->nterms && wps->decorr_passes [i].term; ++i) {
             info->dps [i].term = wps->decorr_passes [i].term;
             info->dps [i].delta = d;
-            decorr_mono_buffer (info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, info->dps, i);
+            decorr_mono_buffer (info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, info->dps + i, i);
         }
 
-        bits = LOG2BUFFER (info->sampleptrs [i], wps->wphdr.block_samples, info->log_limit);
+        bits = log2buffer_best (info->sampleptrs [i], wps->wphdr.block_samples, info->log_limit);
 
         if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
             bits += log2overhead (wps->decorr_passes [0].term, i);
@@ -348,10 +426,10 @@ static void delta_mono (WavpackStream *wps, WavpackExtraInfo *info)
         for (i = 0; i < info->nterms && wps->decorr_passes [i].term; ++i) {
             info->dps [i].term = wps->decorr_passes [i].term;
             info->dps [i].delta = d;
-            decorr_mono_buffer (info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, info->dps, i);
+            decorr_mono_buffer (info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, info->dps + i, i);
         }
 
-        bits = LOG2BUFFER (info->sampleptrs [i], wps->wphdr.block_samples, info->log_limit);
+        bits = log2buffer_best (info->sampleptrs [i], wps->wphdr.block_samples, info->log_limit);
 
         if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
             bits += log2overhead (wps->decorr_passes [0].term, i);
@@ -384,7 +462,7 @@ static void sort_mono (WavpackStream *wps, WavpackExtraInfo *info)
                 break;
 
             if (wps->decorr_passes [ri].term == wps->decorr_passes [ri+1].term) {
-                decorr_mono_buffer (info->sampleptrs [ri], info->sampleptrs [ri+1], wps->wphdr.block_samples, info->dps, ri);
+                decorr_mono_buffer (info->sampleptrs [ri], info->sampleptrs [ri+1], wps->wphdr.block_samples, info->dps + ri, ri);
                 continue;
             }
 
@@ -392,9 +470,9 @@ static void sort_mono (WavpackStream *wps, WavpackExtraInfo *info)
             info->dps [ri+1] = wps->decorr_passes [ri];
 
             for (i = ri; i < info->nterms && wps->decorr_passes [i].term; ++i)
-                decorr_mono_buffer (info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, info->dps, i);
+                decorr_mono_buffer (info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, info->dps + i, i);
 
-            bits = LOG2BUFFER (info->sampleptrs [i], wps->wphdr.block_samples, info->log_limit);
+            bits = log2buffer_best (info->sampleptrs [i], wps->wphdr.block_samples, info->log_limit);
 
             if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
                 bits += log2overhead (wps->decorr_passes [0].term, i);
@@ -409,7 +487,7 @@ static void sort_mono (WavpackStream *wps, WavpackExtraInfo *info)
             else {
                 info->dps [ri] = wps->decorr_passes [ri];
                 info->dps [ri+1] = wps->decorr_passes [ri+1];
-                decorr_mono_buffer (info->sampleptrs [ri], info->sampleptrs [ri+1], wps->wphdr.block_samples, info->dps, ri);
+                decorr_mono_buffer (info->sampleptrs [ri], info->sampleptrs [ri+1], wps->wphdr.block_samples, info->dps + ri, ri);
             }
         }
     }
@@ -441,13 +519,21 @@ static void analyze_mono (WavpackStream *wps, int32_t *samples, int32_t *best_bu
     for (i = 0; i < info.nterms + 2; ++i)
         info.sampleptrs [i] = malloc (wps->wphdr.block_samples * 4);
 
+    // when we've been given idle workers to help, each term tried at a depth needs its own buffer
+
+    CLEARA (info.termptrs);
+
+    if (wps->parallel_search && (wps->extra_flags & EXTRA_BRANCHES))
+        for (i = 0; i < MAX_SEARCH_TERMS; ++i)
+            info.termptrs [i] = malloc (wps->wphdr.block_samples * 4);
+
     memcpy (info.dps, wps->decorr_passes, sizeof (info.dps));
     memcpy (info.sampleptrs [0], samples, wps->wphdr.block_samples * 4);
 
     for (i = 0; i < info.nterms && info.dps [i].term; ++i)
         decorr_mono_pass (info.sampleptrs [i], info.sampleptrs [i + 1], wps->wphdr.block_samples, info.dps + i, 1);
 
-    info.best_bits = LOG2BUFFER (info.sampleptrs [info.nterms], wps->wphdr.block_samples, 0) * 1;
+    info.best_bits = log2buffer_best (info.sampleptrs [info.nterms], wps->wphdr.block_samples, 0) * 1;
 
     if (!(wps->wphdr.flags & HYBRID_FLAG))
         info.best_bits += log2overhead (info.dps [0].term, i);
@@ -460,7 +546,7 @@ static void analyze_mono (WavpackStream *wps, int32_t *samples, int32_t *best_bu
         if ((wps->extra_flags & EXTRA_TRY_DELTAS) && (wps->extra_flags & EXTRA_ADJUST_DELTAS))
             recurse_delta = (int) floor (wps->delta_decay + 0.5);
 
-        recurse_mono (wps, &info, 0, recurse_delta, LOG2BUFFER (info.sampleptrs [0], wps->wphdr.block_samples, 0));
+        recurse_mono (wps, &info, 0, recurse_delta, log2buffer_best (info.sampleptrs [0], wps->wphdr.block_samples, 0));
     }
 
     if (wps->extra_flags & EXTRA_SORT_FIRST)
@@ -483,6 +569,9 @@ static void analyze_mono (WavpackStream *wps, int32_t *samples, int32_t *best_bu
 
     for (i = 0; i < info.nterms + 2; ++i)
         free (info.sampleptrs [i]);
+
+    for (i = 0; i < MAX_SEARCH_TERMS; ++i)
+        free (info.termptrs [i]);
 }
 
 static void mono_add_noise (WavpackStream *wps, int32_t *lptr, int32_t *rptr)
@@ -525,6 +614,24 @@ static void mono_add_noise (WavpackStream *wps, int32_t *lptr, int32_t *rptr)
         }
 }
 
+// Select the fastest version of log2buffer() that is available for the host CPU. This is
+// called from WavpackPackInit(), but only does anything the first time (in any thread).
+
+static void select_dispatch (void)
+{
+#ifdef OPT_SIMD_X64
+    if (cpu_has_feature_simd (CPU_FEATURE_AVX2))
+        log2buffer_best = log2buffer_avx2;
+#endif
+}
+
+void extra_mono_init_dispatch (void)
+{
+    static wp_once_t dispatch_once = WP_ONCE_INIT;
+
+    wp_call_once (&dispatch_once, select_dispatch);
+}
+
 void execute_mono (WavpackStream *wps, int32_t *samples, int no_history, int do_samples)
 {
     int32_t *temp_buffer [2], *best_buffer, *noisy_buffer = NULL;
@@ -658,7 +765,7 @@ void execute_mono (WavpackStream *wps, int32_t *samples, int no_history, int do_
             decorr_mono_pass (temp_buffer [j&1], temp_buffer [~j&1], num_samples, &temp_decorr_pass, 1);
         }
 
-        size = LOG2BUFFER (temp_buffer [j&1], num_samples, log_limit);
+        size = log2buffer_best (temp_buffer [j&1], num_samples, log_limit);
 
         if (size == (uint32_t) -1 && nterms)
             nterms >>= 1;
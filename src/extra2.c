@@ -33,6 +33,10 @@
 
 #define LOG_LIMIT 6912
 
+// This is the most terms that recurse_stereo() tries at each depth (-3 to 8, 17 and 18)
+
+#define MAX_SEARCH_TERMS 13
+
 //#define EXTRA_DUMP        // dump generated filter data to error_line()
 
 #ifdef OPT_ASM_X86
@@ -54,25 +58,45 @@
     void ASMCALL PACK_DECORR_STEREO_PASS_CONT_REV (struct decorr_pass *dpp, int32_t *in_buffer, int32_t *out_buffer, int32_t sample_count);
 #endif
 
+// The "continuation" versions of the stereo decorrelation pass (forward and reverse) and the
+// log2buffer() used for the search are selected at runtime from the available assembly and
+// SIMD versions by extra_stereo_init_dispatch(). If the passes are NULL then the C version is used.
+
+typedef void (ASMCALL *decorr_stereo_pass_cont_func) (struct decorr_pass *dpp, int32_t *in_buffer, int32_t *out_buffer, int32_t sample_count);
+typedef uint32_t (ASMCALL *log2buffer_func) (int32_t *samples, uint32_t num_samples, int limit);
+
+static decorr_stereo_pass_cont_func decorr_stereo_pass_cont [2];    // forward and reverse
+static log2buffer_func log2buffer_best = LOG2BUFFER;
+
 typedef struct {
     int32_t *sampleptrs [MAX_NTERMS+2];
     struct decorr_pass dps [MAX_NTERMS];
     int nterms, log_limit;
     uint32_t best_bits;
+    int32_t *termptrs [MAX_SEARCH_TERMS];   // for parallel_search, one output buffer per term tried
 } WavpackExtraInfo;
 
+// This holds the terms tried at one depth of recurse_stereo() so that they can be evaluated
+// independently (and in parallel), each from its own copy of the decorrelation pass
+
+typedef struct {
+    WavpackStream *wps;
+    WavpackExtraInfo *info;
+    int depth, num_terms;
+    struct decorr_pass dps [MAX_SEARCH_TERMS];
+    uint32_t bits [MAX_SEARCH_TERMS];
+} SearchTerms;
+
 static void decorr_stereo_pass (int32_t *in_samples, int32_t *out_samples, int32_t num_samples, struct decorr_pass *dpp, int dir)
 {
     int32_t cont_samples = 0;
     int m = 0, i;
 
-#ifdef PACK_DECORR_STEREO_PASS_CONT
-    if (num_samples > 16 && PACK_DECORR_STEREO_PASS_CONT_AVAILABLE) {
+    if (num_samples > 16 && decorr_stereo_pass_cont [dir < 0]) {
         int32_t pre_samples = (dpp->term < 0 || dpp->term > MAX_TERM) ? 2 : dpp->term;
         cont_samples = num_samples - pre_samples;
         num_samples = pre_samples;
     }
-#endif
 
     dpp->sum_A = dpp->sum_B = 0;
 
@@ -261,14 +285,8 @@ static void decorr_stereo_pass (int32_t *in_samples, int32_t *out_samples, int32
             break;
     }
 
-#ifdef PACK_DECORR_STEREO_PASS_CONT
-    if (cont_samples) {
-        if (dir < 0)
-            PACK_DECORR_STEREO_PASS_CONT_REV (dpp, in_samples, out_samples, cont_samples);
-        else
-            PACK_DECORR_STEREO_PASS_CONT (dpp, in_samples, out_samples, cont_samples);
-    }
-#endif
+    if (cont_samples)
+        decorr_stereo_pass_cont [dir < 0] (dpp, in_samples, out_samples, cont_samples);
 }
 
 static void decorr_stereo_pass_reverse (int32_t *in_samples, int32_t *out_samples, int32_t num_samples, struct decorr_pass *dpp)
@@ -336,9 +354,9 @@ static void reverse_decorr (struct decorr_pass *dpp)
     }
 }
 
-static void decorr_stereo_buffer (WavpackExtraInfo *info, int32_t *samples, int32_t *outsamples, int32_t num_samples, int tindex)
+static void decorr_stereo_buffer (int32_t *samples, int32_t *outsamples, int32_t num_samples, struct decorr_pass *dppi, int tindex)
 {
-    struct decorr_pass dp, *dppi = info->dps + tindex;
+    struct decorr_pass dp;
     int delta = dppi->delta, pre_delta;
     int term = dppi->term;
 
@@ -395,11 +413,38 @@ static int log2overhead (int first_term, int num_terms)
 #endif
 }
 
+#ifdef ENABLE_THREADS
+
+// Evaluate one of the terms set up by recurse_stereo(). This only reads the shared info and
+// writes the term's own pass, bit count and buffer, so any number can be running at once.
+
+static void search_stereo_term (void *data, int index)
+{
+    SearchTerms *terms = data;
+    WavpackStream *wps = terms->wps;
+    WavpackExtraInfo *info = terms->info;
+    struct decorr_pass *dpp = terms->dps + index;
+    int32_t *outsamples = info->termptrs [index];
+    uint32_t bits;
+
+    decorr_stereo_buffer (info->sampleptrs [terms->depth], outsamples, wps->wphdr.block_samples, dpp, terms->depth);
+    bits = log2buffer_best (outsamples, wps->wphdr.block_samples * 2, info->log_limit);
+
+    if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
+        bits += log2overhead (terms->depth ? info->dps [0].term : dpp->term, terms->depth + 1);
+
+    terms->bits [index] = bits;
+}
+
+#endif
+
 static void recurse_stereo (WavpackStream *wps, WavpackExtraInfo *info, int depth, int delta, uint32_t input_bits)
 {
     int term, branches = ((wps->extra_flags & EXTRA_BRANCHES) >> 6) - depth;
     int32_t *samples, *outsamples;
     uint32_t term_bits [22], bits;
+    SearchTerms terms;
+    int index;
 
     if (branches < 1 || depth + 1 == info->nterms)
         branches = 1;
@@ -407,6 +452,12 @@ static void recurse_stereo (WavpackStream *wps, WavpackExtraInfo *info, int dept
     CLEARA (term_bits);
     samples = info->sampleptrs [depth];
     outsamples = info->sampleptrs [depth + 1];
+#ifdef ENABLE_THREADS
+    terms.wps = wps;
+    terms.info = info;
+    terms.depth = depth;
+#endif
+    terms.num_terms = 0;
 
     for (term = -3; term <= 18; ++term) {
         if (!term || (term > 8 && term < 17))
@@ -422,22 +473,44 @@ static void recurse_stereo (WavpackStream *wps, WavpackExtraInfo *info, int dept
         if ((wps->wpc->config.flags & CONFIG_FAST_FLAG) && (term > 4 && term < 17))
             continue;
 
-        info->dps [depth].term = term;
-        info->dps [depth].delta = delta;
-        decorr_stereo_buffer (info, samples, outsamples, wps->wphdr.block_samples, depth);
-        bits = LOG2BUFFER (outsamples, wps->wphdr.block_samples * 2, info->log_limit);
+        terms.dps [terms.num_terms] = info->dps [depth];
+        terms.dps [terms.num_terms].term = term;
+        terms.dps [terms.num_terms++].delta = delta;
+    }
 
-        if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
-            bits += log2overhead (info->dps [0].term, depth + 1);
+    // With term buffers we evaluate all the terms first (using whatever workers are idle) and
+    // then pick the best in the same order as the serial search, so the result is identical.
+
+#ifdef ENABLE_THREADS
+    if (info->termptrs [0])
+        run_parallel_jobs ((WavpackContext *) wps->wpc, search_stereo_term, &terms, terms.num_terms);
+#endif
+
+    for (index = 0; index < terms.num_terms; ++index) {
+        int32_t *termsamples = outsamples;
+
+        info->dps [depth] = terms.dps [index];
+
+        if (info->termptrs [0]) {
+            termsamples = info->termptrs [index];
+            bits = terms.bits [index];
+        }
+        else {
+            decorr_stereo_buffer (samples, outsamples, wps->wphdr.block_samples, info->dps + depth, depth);
+            bits = log2buffer_best (outsamples, wps->wphdr.block_samples * 2, info->log_limit);
+
+            if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
+                bits += log2overhead (info->dps [0].term, depth + 1);
+        }
 
         if (bits < info->best_bits) {
             info->best_bits = bits;
             CLEARA (wps->decorr_passes);
             memcpy (wps->decorr_passes, info->dps, sizeof (info->dps [0]) * (depth + 1));
-            memcpy (info->sampleptrs [info->nterms + 1], info->sampleptrs [depth + 1], wps->wphdr.block_samples * 8);
+            memcpy (info->sampleptrs [info->nterms + 1], termsamples, wps->wphdr.block_samples * 8);
         }
 
-        term_bits [term + 3] = bits;
+        term_bits [info->dps [depth].term + 3] = bits;
     }
 
     while (depth + 1 < info->nterms && branches--) {
@@ -458,7 +531,7 @@ static void recurse_stereo (WavpackStream *wps, WavpackExtraInfo *info, int dept
 
         info->dps [depth].term = best_term;
         info->dps [depth].delta = delta;
-        decorr_stereo_buffer (info, samples, outsamples, wps->wphdr.block_samples, depth);
+        decorr_stereo_buffer (samples, outsamples, wps->wphdr.block_samples, info->dps + depth, depth);
 
 //      if (log2buffer (outsamples, wps->wphdr.block_samples * 2, 0) != local_best_bits)
 //          error_line ("data doesn't match!");
@@ -487,10 +560,10 @@ static void delta_stereo (WavpackStream *wps, WavpackExtraInfo *info)
         for (i = 0; i < info->nterms && wps->decorr_passes [i].term; ++i) {
             info->dps [i].term = wps->decorr_passes [i].term;
             info->dps [i].delta = d;
-            decorr_stereo_buffer (info, info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, i);
+            decorr_stereo_buffer (info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, info->dps + i, i);
         }
 
-        bits = LOG2BUFFER (info->sampleptrs [i], wps->wphdr.block_samples * 2, info->log_limit);
+        bits = log2buffer_best (info->sampleptrs [i], wps->wphdr.block_samples * 2, info->log_limit);
 
         if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
             bits += log2overhead (wps->decorr_passes [0].term, i);
@@ -512,10 +585,10 @@ static void delta_stereo (WavpackStream *wps, WavpackExtraInfo *info)
         for (i = 0; i < info->nterms && wps->decorr_passes [i].term; ++i) {
             info->dps [i].term = wps->decorr_passes [i].term;
             info->dps [i].delta = d;
-            decorr_stereo_buffer (info, info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, i);
+            decorr_stereo_buffer (info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, info->dps + i, i);
         }
 
-        bits = LOG2BUFFER (info->sampleptrs [i], wps->wphdr.block_samples * 2, info->log_limit);
+        bits = log2buffer_best (info->sampleptrs [i], wps->wphdr.block_samples * 2, info->log_limit);
 
         if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
             bits += log2overhead (wps->decorr_passes [0].term, i);
@@ -548,7 +621,7 @@ static void sort_stereo (WavpackStream *wps, WavpackExtraInfo *info)
                 break;
 
             if (wps->decorr_passes [ri].term == wps->decorr_passes [ri+1].term) {
-                decorr_stereo_buffer (info, info->sampleptrs [ri], info->sampleptrs [ri+1], wps->wphdr.block_samples, ri);
+                decorr_stereo_buffer (info->sampleptrs [ri], info->sampleptrs [ri+1], wps->wphdr.block_samples, info->dps + ri, ri);
                 continue;
             }
 
@@ -556,9 +629,9 @@ static void sort_stereo (WavpackStream *wps, WavpackExtraInfo *info)
             info->dps [ri+1] = wps->decorr_passes [ri];
 
             for (i = ri; i < info->nterms && wps->decorr_passes [i].term; ++i)
-                decorr_stereo_buffer (info, info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, i);
+                decorr_stereo_buffer (info->sampleptrs [i], info->sampleptrs [i+1], wps->wphdr.block_samples, info->dps + i, i);
 
-            bits = LOG2BUFFER (info->sampleptrs [i], wps->wphdr.block_samples * 2, info->log_limit);
+            bits = log2buffer_best (info->sampleptrs [i], wps->wphdr.block_samples * 2, info->log_limit);
 
             if (bits != (uint32_t) -1 && !(wps->wphdr.flags & HYBRID_FLAG))
                 bits += log2overhead (wps->decorr_passes [0].term, i);
@@ -573,7 +646,7 @@ static void sort_stereo (WavpackStream *wps, WavpackExtraInfo *info)
             else {
                 info->dps [ri] = wps->decorr_passes [ri];
                 info->dps [ri+1] = wps->decorr_passes [ri+1];
-                decorr_stereo_buffer (info, info->sampleptrs [ri], info->sampleptrs [ri+1], wps->wphdr.block_samples, ri);
+                decorr_stereo_buffer (info->sampleptrs [ri], info->sampleptrs [ri+1], wps->wphdr.block_samples, info->dps + ri, ri);
             }
         }
     }
@@ -605,13 +678,21 @@ static void analyze_stereo (WavpackStream *wps, int32_t *samples, int32_t *best_
     for (i = 0; i < info.nterms + 2; ++i)
         info.sampleptrs [i] = malloc (wps->wphdr.block_samples * 8);
 
+    // when we've been given idle workers to help, each term tried at a depth needs its own buffer
+
+    CLEARA (info.termptrs);
+
+    if (wps->parallel_search && (wps->extra_flags & EXTRA_BRANCHES))
+        for (i = 0; i < MAX_SEARCH_TERMS; ++i)
+            info.termptrs [i] = malloc (wps->wphdr.block_samples * 8);
+
     memcpy (info.dps, wps->decorr_passes, sizeof (info.dps));
     memcpy (info.sampleptrs [0], samples, wps->wphdr.block_samples * 8);
 
     for (i = 0; i < info.nterms && info.dps [i].term; ++i)
         decorr_stereo_pass (info.sampleptrs [i], info.sampleptrs [i + 1], wps->wphdr.block_samples, info.dps + i, 1);
 
-    info.best_bits = LOG2BUFFER (info.sampleptrs [info.nterms], wps->wphdr.block_samples * 2, 0) * 1;
+    info.best_bits = log2buffer_best (info.sampleptrs [info.nterms], wps->wphdr.block_samples * 2, 0) * 1;
 
     if (!(wps->wphdr.flags & HYBRID_FLAG))
         info.best_bits += log2overhead (info.dps [0].term, i);
@@ -624,7 +705,7 @@ static void analyze_stereo (WavpackStream *wps, int32_t *samples, int32_t *best_
         if ((wps->extra_flags & EXTRA_TRY_DELTAS) && (wps->extra_flags & EXTRA_ADJUST_DELTAS))
             recurse_delta = (int) floor (wps->delta_decay + 0.5);
 
-        recurse_stereo (wps, &info, 0, recurse_delta, LOG2BUFFER (info.sampleptrs [0], wps->wphdr.block_samples * 2, 0));
+        recurse_stereo (wps, &info, 0, recurse_delta, log2buffer_best (info.sampleptrs [0], wps->wphdr.block_samples * 2, 0));
     }
 
     if (wps->extra_flags & EXTRA_SORT_FIRST)
@@ -647,6 +728,9 @@ static void analyze_stereo (WavpackStream *wps, int32_t *samples, int32_t *best_
 
     for (i = 0; i < info.nterms + 2; ++i)
         free (info.sampleptrs [i]);
+
+    for (i = 0; i < MAX_SEARCH_TERMS; ++i)
+        free (info.termptrs [i]);
 }
 
 static void stereo_add_noise (WavpackStream *wps, int32_t *lptr, int32_t *rptr)
@@ -710,6 +794,35 @@ static void stereo_add_noise (WavpackStream *wps, int32_t *lptr, int32_t *rptr)
         }
 }
 
+// Select the fastest versions of the search functions that are available for the host CPU.
+// This is called from WavpackPackInit(), but only does anything the first time (in any thread).
+// Note that the order is important here because we want the best one to win.
+
+static void select_dispatch (void)
+{
+#ifdef PACK_DECORR_STEREO_PASS_CONT
+    if (PACK_DECORR_STEREO_PASS_CONT_AVAILABLE) {
+        decorr_stereo_pass_cont [0] = PACK_DECORR_STEREO_PASS_CONT;
+        decorr_stereo_pass_cont [1] = PACK_DECORR_STEREO_PASS_CONT_REV;
+    }
+#endif
+
+#ifdef OPT_SIMD_X64
+    if (cpu_has_feature_simd (CPU_FEATURE_AVX2)) {
+        decorr_stereo_pass_cont [0] = pack_decorr_stereo_pass_cont_avx2;
+        decorr_stereo_pass_cont [1] = pack_decorr_stereo_pass_cont_rev_avx2;
+        log2buffer_best = log2buffer_avx2;
+    }
+#endif
+}
+
+void extra_stereo_init_dispatch (void)
+{
+    static wp_once_t dispatch_once = WP_ONCE_INIT;
+
+    wp_call_once (&dispatch_once, select_dispatch);
+}
+
 void execute_stereo (WavpackStream *wps, int32_t *samples, int no_history, int do_samples)
 {
     int32_t *temp_buffer [2], *best_buffer, *noisy_buffer = NULL, *js_buffer = NULL;
@@ -870,7 +983,7 @@ void execute_stereo (WavpackStream *wps, int32_t *samples, int no_history, int d
                 decorr_stereo_pass (temp_buffer [j&1], temp_buffer [~j&1], num_samples, &temp_decorr_pass, 1);
             }
 
-            size = LOG2BUFFER (temp_buffer [j&1], num_samples * 2, log_limit);
+            size = log2buffer_best (temp_buffer [j&1], num_samples * 2, log_limit);
 
             if (size == (uint32_t) -1 && nterms)
                 nterms >>= 1;
@@ -300,6 +300,165 @@ WavpackContext *WavpackOpenFileInput (const char *infilename, char *error, int f
     return WavpackOpenFileInputEx64 (&freader, wv_id, wvc_id, error, flags, norm_offset);
 }
 
+// This function obtains the same information about the specified WavPack file
+// as would be returned by the various WavpackGet*() functions after opening it
+// with WavpackOpenFileInput() and the same flags, but much more cheaply because
+// nothing is allocated for decoding and only the first block's metadata, any
+// tag header, and (only if required) the final blocks are read. With OPEN_LAZY
+// the end of the file is never scanned, so the total samples may be unknown.
+// If this fails for any reason then an appropriate message is copied to "error"
+// (if not NULL), the info is cleared, and FALSE is returned (legacy files can
+// not be probed and so must be opened).
+
+int WavpackProbeFile (const char *infilename, WavpackProbeInfo *info, char *error, int flags)
+{
+    FILE *(*fopen_func)(const char *, const char *) = fopen;
+    FILE *wv_id, *wvc_id;
+    int result;
+
+#ifdef _WIN32
+    if (flags & OPEN_FILE_UTF8)
+        fopen_func = fopen_utf8;
+#endif
+
+    if (*infilename == '-') {
+        wv_id = stdin;
+#if defined(_WIN32)
+        _setmode (_fileno (stdin), O_BINARY);
+#endif
+#if defined(__OS2__)
+        setmode (fileno (stdin), O_BINARY);
+#endif
+    }
+    else if ((wv_id = fopen_func (infilename, "rb")) == NULL) {
+        if (error) strcpy (error, "can't open file");
+        CLEAR (*info);
+        return FALSE;
+    }
+
+    if (*infilename != '-' && (flags & OPEN_WVC)) {
+        char *in2filename = malloc (strlen (infilename) + 10);
+
+        strcpy (in2filename, infilename);
+        strcat (in2filename, "c");
+        wvc_id = fopen_func (in2filename, "rb");
+        free (in2filename);
+    }
+    else
+        wvc_id = NULL;
+
+    result = probe_file (&freader, wv_id, wvc_id, info, error, flags);
+
+    if (wv_id != stdin)
+        fclose (wv_id);
+
+    if (wvc_id)
+        fclose (wvc_id);
+
+    return result;
+}
+
+// Probe a list of files with WavpackProbeFile(), filling in the corresponding
+// array of info structures (the version is zero for any file that could not be
+// probed). If the flags specify additional threads (with OPEN_THREADS(), so up to
+// OPEN_THREADS_MAX, but never more than one less than the number of files), they
+// probe files at the same time as the calling thread so that the reads of several
+// files are outstanding at once, which is where the time goes for large libraries
+// (and especially with network storage). Returns the number of files probed.
+
+#ifdef ENABLE_THREADS
+
+typedef struct {
+    char **infilenames;
+    WavpackProbeInfo *info;
+    int num_files, next_file, files_probed, flags;
+    wp_mutex_t mutex;
+} ProbeBatch;
+
+static void probe_batch_files (ProbeBatch *batch)
+{
+    while (1) {
+        int file_index, result;
+
+        wp_mutex_obtain (batch->mutex);
+        file_index = batch->next_file++;
+        wp_mutex_release (batch->mutex);
+
+        if (file_index >= batch->num_files)
+            break;
+
+        result = WavpackProbeFile (batch->infilenames [file_index], batch->info + file_index, NULL, batch->flags);
+
+        wp_mutex_obtain (batch->mutex);
+        batch->files_probed += result;
+        wp_mutex_release (batch->mutex);
+    }
+}
+
+#ifdef _WIN32
+static unsigned WINAPI probe_batch_thread (LPVOID param)
+#else
+static void *probe_batch_thread (void *param)
+#endif
+{
+    probe_batch_files ((ProbeBatch *) param);
+    wp_thread_exit (0);
+    return 0;
+}
+
+#endif
+
+int WavpackProbeFiles (char **infilenames, int num_files, WavpackProbeInfo *info, int flags)
+{
+#ifdef ENABLE_THREADS
+    int num_threads = OPEN_FLAGS_THREADS (flags), i;
+    wp_thread_t *threads = NULL;
+    ProbeBatch batch;
+
+    CLEAR (batch);
+    batch.infilenames = infilenames;
+    batch.info = info;
+    batch.num_files = num_files;
+    batch.flags = flags;
+    wp_mutex_init (batch.mutex);
+
+    if (num_threads > num_files - 1)
+        num_threads = num_files > 1 ? num_files - 1 : 0;
+
+    if (num_threads && !(threads = (wp_thread_t *)malloc (num_threads * sizeof (wp_thread_t))))
+        num_threads = 0;        // just do them all ourselves
+
+    for (i = 0; i < num_threads; ++i) {
+        wp_thread_create (threads [i], probe_batch_thread, &batch);
+
+        // gracefully handle failures in creating threads
+
+        if (!threads [i]) {
+            num_threads = i;
+            break;
+        }
+    }
+
+    probe_batch_files (&batch);
+
+    for (i = 0; i < num_threads; ++i) {
+        wp_thread_join (threads [i]);
+        wp_thread_delete (threads [i]);
+    }
+
+    free (threads);
+    wp_mutex_delete (batch.mutex);
+    return batch.files_probed;
+#else
+    int files_probed = 0, i;
+
+    for (i = 0; i < num_files; ++i)
+        files_probed += WavpackProbeFile (infilenames [i], info + i, NULL, flags);
+
+    return files_probed;
+#endif
+}
+
 #ifdef _WIN32
 
 // The following code Copyright (c) 2004-2012 LoRd_MuldeR <mulder2@gmx.de>
@@ -0,0 +1,279 @@
+////////////////////////////////////////////////////////////////////////////
+//                           **** WAVPACK ****                            //
+//                  Hybrid Lossless Wavefile Compressor                   //
+//                Copyright (c) 1998 - 2024 David Bryant.                 //
+//                          All Rights Reserved.                          //
+//      Distributed under the BSD Software License (see license.txt)      //
+////////////////////////////////////////////////////////////////////////////
+
+// open_memory.c
+
+// This module provides the ability to open and decode complete WavPack files
+// that are already in memory, either supplied by the application or mapped
+// into memory from a file (where supported). This is different from the raw
+// decoder in open_raw.c because complete, seekable files are handled (with
+// tags, seeking, etc.) and because the WavPack blocks are decoded in place,
+// without first being copied into allocated block buffers.
+
+#if !defined(_WIN32) && !defined(__WATCOMC__) && !defined(__OS2__)
+#define USE_MMAP
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavpack_local.h"
+
+#ifdef USE_MMAP
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+    unsigned char *data;
+    int64_t size, pos;
+    int mapped;
+} WavpackMemoryFile;
+
+static int32_t mem_read_bytes (void *id, void *data, int32_t bcount)
+{
+    WavpackMemoryFile *mfile = id;
+
+    if (mfile->pos >= mfile->size)
+        return 0;
+
+    if (bcount > mfile->size - mfile->pos)
+        bcount = (int32_t) (mfile->size - mfile->pos);
+
+    memcpy (data, mfile->data + mfile->pos, bcount);
+    mfile->pos += bcount;
+    return bcount;
+}
+
+static int32_t mem_write_bytes (void *id, void *data, int32_t bcount)
+{
+    return 0;
+}
+
+static int64_t mem_get_pos (void *id)
+{
+    WavpackMemoryFile *mfile = id;
+    return mfile->pos;
+}
+
+static int mem_set_pos_abs (void *id, int64_t pos)
+{
+    WavpackMemoryFile *mfile = id;
+
+    if (pos < 0)
+        return -1;
+
+    mfile->pos = pos;
+    return 0;
+}
+
+static int mem_set_pos_rel (void *id, int64_t delta, int mode)
+{
+    WavpackMemoryFile *mfile = id;
+
+    if (mode == SEEK_CUR)
+        delta += mfile->pos;
+    else if (mode == SEEK_END)
+        delta += mfile->size;
+
+    return mem_set_pos_abs (id, delta);
+}
+
+// Because the data is not going anywhere, pushing back a byte
+// is simply backing up over the last one read.
+
+static int mem_push_back_byte (void *id, int c)
+{
+    WavpackMemoryFile *mfile = id;
+
+    if (mfile->pos > 0)
+        mfile->pos--;
+
+    return c;
+}
+
+static int64_t mem_get_length (void *id)
+{
+    WavpackMemoryFile *mfile = id;
+    return mfile->size;
+}
+
+static int mem_can_seek (void *id)
+{
+    return 1;
+}
+
+static int mem_close_stream (void *id)
+{
+    WavpackMemoryFile *mfile = id;
+
+    if (mfile) {
+#ifdef USE_MMAP
+        if (mfile->mapped)
+            munmap (mfile->data, (size_t) mfile->size);
+#endif
+        free (mfile);
+    }
+
+    return 0;
+}
+
+static WavpackStreamReader64 mem_reader = {
+    mem_read_bytes, mem_write_bytes, mem_get_pos, mem_set_pos_abs, mem_set_pos_rel,
+    mem_push_back_byte, mem_get_length, mem_can_seek, NULL, mem_close_stream
+};
+
+static WavpackMemoryFile *mem_file_create (void *data, int64_t size, int mapped)
+{
+    WavpackMemoryFile *mfile = calloc (1, sizeof (WavpackMemoryFile));
+
+    if (mfile) {
+        mfile->data = data;
+        mfile->size = size;
+        mfile->mapped = mapped;
+    }
+
+    return mfile;
+}
+
+// This function is similar to WavpackOpenFileInput() except that instead of
+// providing a filename to open, the caller provides pointers to complete
+// WavPack files in memory (the standard file and, optionally, the correction
+// file). The data must remain valid (and unchanged) until the file is closed,
+// but is never written. Blocks are decoded directly from this data without
+// being copied (except in a few situations, like big-endian hosts, misaligned
+// blocks or corrupt blocks, where the library transparently falls back to
+// making a copy). Tags can be read, but not edited.
+
+WavpackContext *WavpackOpenFileInputMemory (void *wv_data, int64_t wv_size, void *wvc_data, int64_t wvc_size, char *error, int flags, int norm_offset)
+{
+    WavpackMemoryFile *wv_id, *wvc_id = NULL;
+    WavpackContext *wpc;
+
+    if (!wv_data || wv_size <= 0 || !(wv_id = mem_file_create (wv_data, wv_size, FALSE))) {
+        if (error) strcpy (error, "can't open file");
+        return NULL;
+    }
+
+    if (wvc_data && wvc_size > 0)
+        wvc_id = mem_file_create (wvc_data, wvc_size, FALSE);
+
+    wpc = WavpackOpenFileInputEx64 (&mem_reader, wv_id, wvc_id, error, flags & ~OPEN_EDIT_TAGS, norm_offset);
+
+    // now that the file is open, we can tell the library where the data is so that
+    // it can be used in place (the first block has already been copied, of course)
+
+    if (wpc) {
+        wpc->wv_data = wv_id->data;
+        wpc->wv_data_size = wv_id->size;
+
+        if (wpc->wvc_in) {
+            wpc->wvc_data = wvc_id->data;
+            wpc->wvc_data_size = wvc_id->size;
+        }
+    }
+
+    return wpc;
+}
+
+// This function is the equivalent of WavpackProbeFile() for files in memory (as
+// for WavpackOpenFileInputMemory()). The memory file descriptors are on the
+// stack, so nothing at all is allocated.
+
+int WavpackProbeBuffer (void *wv_data, int64_t wv_size, void *wvc_data, int64_t wvc_size, WavpackProbeInfo *info, char *error, int flags)
+{
+    WavpackMemoryFile wv_file, wvc_file;
+
+    if (!wv_data || wv_size <= 0) {
+        if (error) strcpy (error, "can't open file");
+        CLEAR (*info);
+        return FALSE;
+    }
+
+    CLEAR (wv_file);
+    wv_file.data = wv_data;
+    wv_file.size = wv_size;
+
+    CLEAR (wvc_file);
+    wvc_file.data = wvc_data;
+    wvc_file.size = wvc_size;
+
+    return probe_file (&mem_reader, &wv_file, (wvc_data && wvc_size > 0) ? &wvc_file : NULL, info, error, flags);
+}
+
+#ifdef USE_MMAP
+
+// Map the specified file into memory (read-only), returning NULL on any error
+
+static WavpackMemoryFile *mem_file_map (const char *filename)
+{
+    WavpackMemoryFile *mfile = NULL;
+    struct stat statbuf;
+    void *data;
+    int fd;
+
+    if ((fd = open (filename, O_RDONLY)) == -1)
+        return NULL;
+
+    if (!fstat (fd, &statbuf) && S_ISREG (statbuf.st_mode) && statbuf.st_size > 0 &&
+        (uint64_t) statbuf.st_size == (size_t) statbuf.st_size) {
+            data = mmap (NULL, (size_t) statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED && !(mfile = mem_file_create (data, statbuf.st_size, TRUE)))
+                munmap (data, (size_t) statbuf.st_size);
+    }
+
+    close (fd);     // the mapping remains valid after the descriptor is closed
+    return mfile;
+}
+
+#endif
+
+// This function is identical to WavpackOpenFileInput() except that, where the
+// platform supports it, the file (and correction file) are mapped into memory
+// and decoded in place as with WavpackOpenFileInputMemory(). If the file can't
+// be mapped (e.g., stdin, pipes, or an unsupported platform) or tag editing is
+// requested, then this simply reverts to WavpackOpenFileInput().
+
+WavpackContext *WavpackOpenFileInputMapped (const char *infilename, char *error, int flags, int norm_offset)
+{
+#ifdef USE_MMAP
+    WavpackMemoryFile *wv_id, *wvc_id = NULL;
+    WavpackContext *wpc;
+
+    if (*infilename == '-' || (flags & OPEN_EDIT_TAGS) || !(wv_id = mem_file_map (infilename)))
+        return WavpackOpenFileInput (infilename, error, flags, norm_offset);
+
+    if (flags & OPEN_WVC) {
+        char *in2filename = malloc (strlen (infilename) + 10);
+
+        strcpy (in2filename, infilename);
+        strcat (in2filename, "c");
+        wvc_id = mem_file_map (in2filename);
+        free (in2filename);
+    }
+
+    wpc = WavpackOpenFileInputEx64 (&mem_reader, wv_id, wvc_id, error, flags, norm_offset);
+
+    if (wpc) {
+        wpc->wv_data = wv_id->data;
+        wpc->wv_data_size = wv_id->size;
+
+        if (wpc->wvc_in) {
+            wpc->wvc_data = wvc_id->data;
+            wpc->wvc_data_size = wvc_id->size;
+        }
+    }
+
+    return wpc;
+#else
+    return WavpackOpenFileInput (infilename, error, flags, norm_offset);
+#endif
+}
@@ -0,0 +1,370 @@
+////////////////////////////////////////////////////////////////////////////
+//                           **** WAVPACK ****                            //
+//                  Hybrid Lossless Wavefile Compressor                   //
+//                Copyright (c) 1998 - 2024 David Bryant.                 //
+//                          All Rights Reserved.                          //
+//      Distributed under the BSD Software License (see license.txt)      //
+////////////////////////////////////////////////////////////////////////////
+
+// open_push.c
+
+// This module provides a "push" interface for decoding WavPack streams that
+// arrive incrementally (e.g., from the network). Instead of supplying a reader
+// callback that blocks until data is available, the application feeds in the
+// data as it arrives (in pieces of any size) and then drains whatever samples
+// can be decoded. The buffered data is framed by finding the WavPack headers
+// with read_next_header() (exactly as the decoder itself will) and the decoder
+// is only ever run on complete frames, so it never runs out of data and the
+// calls never block. This means that any number of streams can be serviced
+// from a single thread (like an event loop). Because the stream can't seek,
+// there are no tags, no correction files, and no seeking.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavpack_local.h"
+
+typedef struct {
+    unsigned char *data;
+    uint32_t size, alloc, pos;      // "pos" is where the decoder will read next
+    int64_t base;                   // stream position of data [0] (bytes already discarded)
+} PushBuffer;
+
+struct WavpackStreamDecoder {
+    PushBuffer buffer;
+    WavpackContext *wpc;            // NULL until the first complete frame arrives
+    int flags, norm_offset, failed;
+    char error_message [80];
+};
+
+static int32_t push_read_bytes (void *id, void *data, int32_t bcount)
+{
+    PushBuffer *buf = id;
+
+    if (bcount > (int32_t)(buf->size - buf->pos))
+        bcount = buf->size - buf->pos;
+
+    memcpy (data, buf->data + buf->pos, bcount);
+    buf->pos += bcount;
+    return bcount;
+}
+
+static int32_t push_write_bytes (void *id, void *data, int32_t bcount)
+{
+    return 0;
+}
+
+static int64_t push_get_pos (void *id)
+{
+    PushBuffer *buf = id;
+    return buf->base + buf->pos;
+}
+
+// Only positions within the buffered data can be reached; this is used
+// to skip over blocks of channels that are not selected for decode.
+
+static int push_set_pos_abs (void *id, int64_t pos)
+{
+    PushBuffer *buf = id;
+
+    if (pos < buf->base || pos > buf->base + buf->size)
+        return -1;
+
+    buf->pos = (uint32_t)(pos - buf->base);
+    return 0;
+}
+
+static int push_set_pos_rel (void *id, int64_t delta, int mode)
+{
+    PushBuffer *buf = id;
+
+    if (mode != SEEK_CUR)
+        return -1;
+
+    return push_set_pos_abs (id, buf->base + buf->pos + delta);
+}
+
+static int push_push_back_byte (void *id, int c)
+{
+    PushBuffer *buf = id;
+
+    if (buf->pos > 0)
+        buf->pos--;
+
+    return c;
+}
+
+static int64_t push_get_length (void *id)
+{
+    return 0;
+}
+
+static int push_can_seek (void *id)
+{
+    return 0;
+}
+
+// there's no close function because the buffer belongs to the WavpackStreamDecoder
+
+static WavpackStreamReader64 push_reader = {
+    push_read_bytes, push_write_bytes, push_get_pos, push_set_pos_abs, push_set_pos_rel,
+    push_push_back_byte, push_get_length, push_can_seek, NULL, NULL
+};
+
+// Create a push-mode decoder. The flags and normalization offset are the same
+// as for WavpackOpenFileInput(), except that OPEN_WVC, OPEN_TAGS and
+// OPEN_EDIT_TAGS don't apply. OPEN_STREAMING may be used to ignore the block
+// indexes in the stream (which otherwise are used to detect missing audio and
+// fill it with silence). Nothing is decoded until WavpackDecoderDrain() is
+// called. Returns NULL only if memory can't be allocated.
+
+WavpackStreamDecoder *WavpackCreateDecoder (int flags, int norm_offset)
+{
+    WavpackStreamDecoder *dec = calloc (1, sizeof (WavpackStreamDecoder));
+
+    if (dec) {
+        dec->flags = flags & ~(OPEN_WVC | OPEN_TAGS | OPEN_EDIT_TAGS);
+        dec->norm_offset = norm_offset;
+    }
+
+    return dec;
+}
+
+// Append the specified data to the data buffered for decode. The data can be
+// any size (the block boundaries don't matter) and is copied, so it can be
+// reused as soon as this returns. Returns FALSE if the decoder has failed (in
+// which case the stream should be abandoned), otherwise TRUE.
+
+int WavpackDecoderFeed (WavpackStreamDecoder *dec, const void *data, int32_t bcount)
+{
+    PushBuffer *buf;
+
+    if (!dec || dec->failed)
+        return FALSE;
+
+    if (bcount <= 0)
+        return TRUE;
+
+    buf = &dec->buffer;
+
+    // first discard everything that the decoder has already consumed
+
+    if (buf->pos) {
+        memmove (buf->data, buf->data + buf->pos, buf->size - buf->pos);
+        buf->base += buf->pos;
+        buf->size -= buf->pos;
+        buf->pos = 0;
+    }
+
+    if ((int64_t) buf->size + bcount > 0x7fffffff) {
+        strcpy (dec->error_message, "too much data buffered!");
+        dec->failed = TRUE;
+        return FALSE;
+    }
+
+    if (buf->size + bcount > buf->alloc) {
+        uint32_t new_alloc = buf->alloc ? buf->alloc : 65536;
+        unsigned char *new_data;
+
+        while (new_alloc < buf->size + bcount)
+            new_alloc *= 2;
+
+        if (!(new_data = realloc (buf->data, new_alloc))) {
+            strcpy (dec->error_message, "can't allocate memory");
+            dec->failed = TRUE;
+            return FALSE;
+        }
+
+        buf->data = new_data;
+        buf->alloc = new_alloc;
+    }
+
+    memcpy (buf->data + buf->size, data, bcount);
+    buf->size += bcount;
+    return TRUE;
+}
+
+// Return TRUE if the decoder will read the block with the specified header and then just
+// discard it. These are blocks with audio that are not the first block of a frame (e.g.,
+// at the start of a stream that was joined mid-frame) and blocks with audio that ends
+// before the sample index the decoder is already at (e.g., repeated blocks).
+
+static int block_discarded (WavpackStreamDecoder *dec, WavpackHeader *wphdr)
+{
+    WavpackContext *wpc = dec->wpc;
+
+    if (!wphdr->block_samples)
+        return FALSE;
+
+    if (!(wphdr->flags & INITIAL_BLOCK))
+        return TRUE;
+
+    return wpc && !(wpc->open_flags & OPEN_STREAMING) &&
+        GET_BLOCK_INDEX (*wphdr) - wpc->initial_index + wphdr->block_samples <= wpc->streams [0]->sample_index;
+}
+
+// Scan the buffered data (from where the decoder will read next) for the next complete
+// frame, looking at the blocks exactly as the decoder will: first any blocks that have no
+// audio (which are decoded for their metadata), that will be discarded, or that are corrupt,
+// then the first block of a frame followed by the rest of its blocks (up to FINAL_BLOCK).
+// If all of that is buffered, the number of samples in the frame is returned, otherwise
+// zero. Data that the decoder would skip anyway before the next block (i.e., non-WavPack
+// data) is dropped here so that it doesn't accumulate.
+
+static uint32_t scan_next_frame (WavpackStreamDecoder *dec)
+{
+    PushBuffer *buf = &dec->buffer, peek = *buf;
+    uint32_t frame_samples = 0;
+    WavpackHeader wphdr;
+
+    while (1) {
+        uint32_t start = peek.pos, bcount = read_next_header (&push_reader, &peek, &wphdr);
+        int leading = (start == buf->pos);      // nothing before this point is needed
+
+        if (bcount == (uint32_t) -1) {
+            // no header found, but the last few bytes might be the start of one
+
+            if (leading && peek.pos - start >= sizeof (WavpackHeader))
+                buf->pos = peek.pos - sizeof (WavpackHeader) + 1;
+
+            return 0;
+        }
+
+        if (leading)
+            buf->pos += bcount;
+
+        if (peek.size - peek.pos < wphdr.ckSize - 24)
+            return 0;
+
+        peek.pos += wphdr.ckSize - 24;
+
+        if (!frame_samples) {
+            // before the stream is opened we drop these, because the open would take any
+            // block with audio as the first one (and then its configuration)
+
+            if (block_discarded (dec, &wphdr)) {
+                if (leading && !dec->wpc)
+                    buf->pos = peek.pos;
+
+                continue;
+            }
+
+            // a block that fails verification is read, but is treated as having no audio
+
+            if (wphdr.block_samples && !WavpackVerifySingleBlock (peek.data + peek.pos - wphdr.ckSize - 8,
+                !(dec->flags & OPEN_NO_CHECKSUM)))
+                    continue;
+
+            frame_samples = wphdr.block_samples;
+        }
+
+        if (frame_samples && (wphdr.flags & FINAL_BLOCK))
+            return frame_samples;
+    }
+}
+
+// Decode up to the specified number of samples from the data fed so far into the buffer
+// (which must have room for "samples" complete samples, of WavpackGetReducedChannels()
+// channels each). Only complete frames are decoded, so fewer samples (and often none)
+// may be returned; this is not an error, it just means that more data is required. The
+// format of the samples is the same as for WavpackUnpackSamples(). The context (which
+// provides the stream information and the error count) is created here once the first
+// frame is complete; calling this for zero samples creates it without decoding anything
+// (e.g., to select channels first). If the stream is not decodable at all, this returns
+// zero and WavpackDecoderFeed() will return FALSE.
+
+uint32_t WavpackDecoderDrain (WavpackStreamDecoder *dec, int32_t *buffer, uint32_t samples)
+{
+    uint32_t samples_drained = 0;
+    WavpackContext *wpc;
+
+    if (!dec || dec->failed)
+        return 0;
+
+    if (!dec->wpc) {
+        if (!scan_next_frame (dec))
+            return 0;
+
+        dec->wpc = WavpackOpenFileInputEx64 (&push_reader, &dec->buffer, NULL, dec->error_message, dec->flags, dec->norm_offset);
+
+        if (!dec->wpc) {
+            dec->failed = TRUE;
+            return 0;
+        }
+
+#ifdef ENABLE_THREADS
+        // temporal multithreading of mono and stereo streams decodes ahead of the request
+        // (and so would read frames that are not here yet), so we don't allow that here
+
+        if (!dec->wpc->reduced_channels && dec->wpc->config.num_channels <= 2)
+            dec->wpc->num_workers = 0;
+#endif
+    }
+
+    wpc = dec->wpc;
+
+    while (samples_drained < samples) {
+        WavpackStream *wps = wpc->streams [0];
+        uint32_t start_pos = dec->buffer.pos, frame_samples, samples_unpacked;
+
+        // if we're in the middle of a frame then it's all been read (or is buffered), otherwise
+        // we must check that the next frame is all here before the decoder tries to read it
+
+        if (wps->wphdr.block_samples && (wps->wphdr.flags & INITIAL_BLOCK) &&
+            wps->sample_index < GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples)
+                frame_samples = (uint32_t) (GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples - wps->sample_index);
+        else if (!(frame_samples = scan_next_frame (dec)))
+            break;
+
+        if (frame_samples > samples - samples_drained)
+            frame_samples = samples - samples_drained;
+
+        samples_unpacked = WavpackUnpackSamples (wpc, buffer + samples_drained * WavpackGetReducedChannels (wpc), frame_samples);
+        samples_drained += samples_unpacked;
+
+        if (!samples_unpacked && dec->buffer.pos == start_pos)
+            break;
+    }
+
+    return samples_drained;
+}
+
+// Return the context for the stream (for WavpackGetNumChannels(), WavpackGetSampleRate(),
+// WavpackGetNumErrors(), WavpackSelectChannels(), etc.) or NULL if the first frame has
+// not been received yet. The context belongs to the decoder and must not be closed.
+
+WavpackContext *WavpackDecoderGetContext (WavpackStreamDecoder *dec)
+{
+    return dec ? dec->wpc : NULL;
+}
+
+// Return the reason that the decoder failed, or the last error reported by the context (a NULL
+// decoder, as returned by a failed WavpackCreateDecoder(), gets a fixed message)
+
+char *WavpackDecoderGetErrorMessage (WavpackStreamDecoder *dec)
+{
+    static char no_decoder [] = "no decoder!";
+
+    if (!dec)
+        return no_decoder;
+
+    if (dec->wpc && !dec->failed)
+        return WavpackGetErrorMessage (dec->wpc);
+
+    return dec->error_message;
+}
+
+// Free the decoder, its context, and any buffered data. Returns NULL.
+
+WavpackStreamDecoder *WavpackDestroyDecoder (WavpackStreamDecoder *dec)
+{
+    if (dec) {
+        if (dec->wpc)
+            WavpackCloseFile (dec->wpc);
+
+        free (dec->buffer.data);
+        free (dec);
+    }
+
+    return NULL;
+}
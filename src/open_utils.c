@@ -30,7 +30,8 @@
 // function which handles the correction file transparently, in this case it
 // is the responsibility of the caller to be aware of correction files.
 
-static int seek_eof_information (WavpackContext *wpc, int64_t *final_index, int get_wrapper);
+static int seek_eof_information (WavpackContext *wpc, int64_t *final_index, int get_wrapper, int64_t start_pos);
+static int block_index_copy (BlockIndex *dest, BlockIndex *source);
 
 WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *wv_id, void *wvc_id, char *error, int flags, int norm_offset)
 {
@@ -46,6 +47,9 @@ WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *w
     }
 
     CLEAR (*wpc);
+#ifdef ENABLE_THREADS
+    wp_mutex_init (wpc->reader_mutex);
+#endif
     wpc->wv_in = wv_id;
     wpc->wvc_in = wvc_id;
     wpc->reader = reader;
@@ -54,10 +58,14 @@ WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *w
     wpc->max_streams = OLD_MAX_STREAMS;     // use this until overwritten with actual number
     wpc->open_flags = flags;
 
+    unpack_init_dispatch ();    // select the best decoding functions for this CPU (first time only)
+
     wpc->filelen = wpc->reader->get_length (wpc->wv_in);
 
 #ifndef NO_TAGS
-    if ((flags & (OPEN_TAGS | OPEN_EDIT_TAGS)) && wpc->reader->can_seek (wpc->wv_in)) {
+    if ((flags & OPEN_LAZY) && (flags & OPEN_TAGS) && !(flags & OPEN_EDIT_TAGS) && wpc->reader->can_seek (wpc->wv_in))
+        wpc->lazy_pending |= LAZY_TAGS;
+    else if ((flags & (OPEN_TAGS | OPEN_EDIT_TAGS)) && wpc->reader->can_seek (wpc->wv_in)) {
         load_tag (wpc);
         wpc->reader->set_pos_abs (wpc->wv_in, 0);
 
@@ -110,14 +118,9 @@ WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *w
         }
 
         wpc->filepos += bcount;
-        wps->blockbuff = (unsigned char *)malloc (wps->wphdr.ckSize + 8);
-        if (!wps->blockbuff) {
-            if (error) strcpy (error, "can't allocate memory");
-            return WavpackCloseFile (wpc);
-        }
-        memcpy (wps->blockbuff, &wps->wphdr, 32);
+        wps->blockbuff = read_block_buffer (wpc, wpc->wv_in, &wps->wphdr, &wps->blockbuff_size);
 
-        if (wpc->reader->read_bytes (wpc->wv_in, wps->blockbuff + 32, wps->wphdr.ckSize - 24) != wps->wphdr.ckSize - 24) {
+        if (!wps->blockbuff) {
             if (error) strcpy (error, "can't read all of WavPack file!");
             return WavpackCloseFile (wpc);
         }
@@ -125,7 +128,7 @@ WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *w
         // if block does not verify, flag error, free buffer, and continue
         if (!WavpackVerifySingleBlock (wps->blockbuff, !(flags & OPEN_NO_CHECKSUM))) {
             wps->wphdr.block_samples = 0;
-            free (wps->blockbuff);
+            block_buffer_release (wpc, wps->blockbuff, wps->blockbuff_size);
             wps->blockbuff = NULL;
             wpc->crc_errors++;
             continue;
@@ -141,10 +144,12 @@ WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *w
                     wpc->initial_index = GET_BLOCK_INDEX (wps->wphdr);
                     SET_BLOCK_INDEX (wps->wphdr, 0);
 
-                    if (wpc->reader->can_seek (wpc->wv_in)) {
+                    if ((flags & OPEN_LAZY) && wpc->reader->can_seek (wpc->wv_in))
+                        wpc->lazy_pending |= LAZY_TOTAL_SAMPLES;
+                    else if (wpc->reader->can_seek (wpc->wv_in)) {
                         int64_t final_index = -1;
 
-                        seek_eof_information (wpc, &final_index, FALSE);
+                        seek_eof_information (wpc, &final_index, FALSE, -1);
 
                         if (final_index != -1)
                             wpc->total_samples = final_index - wpc->initial_index;
@@ -180,13 +185,20 @@ WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *w
         }
 
         if (!wps->wphdr.block_samples) {    // free blockbuff if we're going to loop again
-            free (wps->blockbuff);
+            block_buffer_release (wpc, wps->blockbuff, wps->blockbuff_size);
             wps->blockbuff = NULL;
         }
 
         wps->init_done = TRUE;
     }
 
+#ifndef NO_SEEKING
+    // the first block is indexed just like the ones found later while decoding
+
+    if ((wps->wphdr.flags & INITIAL_BLOCK) && !(flags & OPEN_STREAMING))
+        block_index_add (&wpc->wv_index, GET_BLOCK_INDEX (wps->wphdr), wpc->filepos, wps->wphdr.block_samples);
+#endif
+
     wpc->config.flags &= ~0xff;
     wpc->config.flags |= wps->wphdr.flags & 0xff;
 
@@ -236,8 +248,8 @@ WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *w
     }
 
 #ifdef ENABLE_THREADS
-    if (!wpc->reduced_channels && (wpc->open_flags & OPEN_THREADS_MASK)) {
-        wpc->num_workers = ((wpc->open_flags & OPEN_THREADS_MASK) >> OPEN_THREADS_SHFT) & 0xf;
+    if (!wpc->reduced_channels && (wpc->open_flags & (OPEN_THREADS_MASK | OPEN_THREADS_HIGH_MASK))) {
+        wpc->num_workers = OPEN_FLAGS_THREADS (wpc->open_flags);
 
         // for multichannel files we can limit the number of workers
         // because we only do spatial multithreading (not temporal)
@@ -249,12 +261,220 @@ WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *w
             if (wpc->num_workers > wpc->config.num_channels - 1)
                 wpc->num_workers = wpc->config.num_channels - 1;
         }
+        else if (wpc->num_workers > MAX_TEMPORAL_WORKERS)
+            wpc->num_workers = MAX_TEMPORAL_WORKERS;
     }
 #endif
 
     return wpc;
 }
 
+// Create a new context for an already opened WavPack file, with its own independent position that
+// starts at the beginning of the audio. Everything parsed when the original context was opened (the
+// configuration, channel information, tags, wrapper, total samples and block index) is copied, so
+// there's no scan of the end of the file and no tag parsing. The caller provides new handles for the
+// file (and the correction file, if it should be used) which are accessed with the specified reader
+// or, if that's NULL, the original context's reader (for files opened with WavpackOpenFileInput()
+// these would be FILE pointers). If the reader has a close function, the handles are closed with the
+// new context (even on failure). The file must be seekable, and legacy files are not supported.
+
+WavpackContext *WavpackCloneContext (WavpackContext *wpc, WavpackStreamReader64 *reader, void *wv_id, void *wvc_id, char *error)
+{
+    WavpackContext *clone = (WavpackContext *)malloc (sizeof (WavpackContext));
+    int copy_failed = FALSE;
+
+    finish_lazy_open (wpc, LAZY_TOTAL_SAMPLES | LAZY_TAGS);
+
+    if (!clone) {
+        if (error) strcpy (error, "can't allocate memory");
+        return NULL;
+    }
+
+    CLEAR (*clone);
+#ifdef ENABLE_THREADS
+    wp_mutex_init (clone->reader_mutex);
+#endif
+    copy_context_info (clone, wpc);
+    clone->reader = reader ? reader : wpc->reader;
+    clone->wv_in = wv_id;
+    clone->wvc_in = wvc_id;
+    clone->wvc_flag = wpc->wvc_flag && wvc_id;
+
+#ifdef NO_SEEKING
+    if (error) strcpy (error, "can't clone contexts without seeking support!");
+    return WavpackCloseFile (clone);
+#endif
+
+    if (!wv_id || wpc->total_samples == -1 || (wpc->open_flags & OPEN_STREAMING) || !clone->reader->can_seek (wv_id) ||
+        (clone->wvc_flag && !clone->reader->can_seek (wvc_id))) {
+            if (error) strcpy (error, "can't clone context of unseekable file!");
+            return WavpackCloseFile (clone);
+    }
+
+#ifdef ENABLE_LEGACY
+    if (wpc->stream3) {
+        if (error) strcpy (error, "can't clone context of legacy file!");
+        return WavpackCloseFile (clone);
+    }
+#endif
+
+    if (wpc->channel_identities) {
+        size_t bytes = strlen ((char *) wpc->channel_identities) + 1;
+
+        if ((clone->channel_identities = malloc (bytes)))
+            memcpy (clone->channel_identities, wpc->channel_identities, bytes);
+        else
+            copy_failed = TRUE;
+    }
+
+    if (wpc->channel_reordering) {
+        if ((clone->channel_reordering = malloc (wpc->channel_layout & 0xff)))
+            memcpy (clone->channel_reordering, wpc->channel_reordering, wpc->channel_layout & 0xff);
+        else
+            copy_failed = TRUE;
+    }
+
+    if (wpc->channel_map) {
+        if ((clone->channel_map = malloc (wpc->config.num_channels * sizeof (int))))
+            memcpy (clone->channel_map, wpc->channel_map, wpc->config.num_channels * sizeof (int));
+        else
+            copy_failed = TRUE;
+    }
+
+#ifndef NO_TAGS
+    clone->m_tag = wpc->m_tag;
+
+    if (wpc->m_tag.ape_tag_data) {
+        if ((clone->m_tag.ape_tag_data = malloc (wpc->m_tag.ape_tag_hdr.length)))
+            memcpy (clone->m_tag.ape_tag_data, wpc->m_tag.ape_tag_data, wpc->m_tag.ape_tag_hdr.length);
+        else
+            copy_failed = TRUE;
+    }
+#endif
+
+    if (!block_index_copy (&clone->wv_index, &wpc->wv_index) ||
+        (clone->wvc_flag && !block_index_copy (&clone->wvc_index, &wpc->wvc_index)))
+            copy_failed = TRUE;
+
+#ifdef ENABLE_DSD
+    if (wpc->decimation_context && !(clone->decimation_context =
+        decimate_dsd_init (wpc->reduced_channels ? wpc->reduced_channels : wpc->config.num_channels)))
+            copy_failed = TRUE;
+#endif
+
+    clone->streams = (WavpackStream **)malloc ((clone->num_streams = 1) * sizeof (clone->streams [0]));
+
+    if (clone->streams && (clone->streams [0] = (WavpackStream *)calloc (1, sizeof (WavpackStream))))
+        clone->streams [0]->wpc = clone;
+    else
+        copy_failed = TRUE;
+
+    if (copy_failed) {
+        if (error) strcpy (error, "can't allocate memory");
+        return WavpackCloseFile (clone);
+    }
+
+#ifndef NO_SEEKING
+    if (!WavpackSeekSample64 (clone, 0)) {
+        if (error) strcpy (error, "can't read all of WavPack file!");
+        return WavpackCloseFile (clone);
+    }
+#endif
+
+    // reading the first block might have picked up the wrapper header, so replace it with the original
+
+    WavpackFreeWrapper (clone);
+
+    if (wpc->wrapper_bytes) {
+        if (!(clone->wrapper_data = malloc (wpc->wrapper_bytes))) {
+            if (error) strcpy (error, "can't allocate memory");
+            return WavpackCloseFile (clone);
+        }
+
+        memcpy (clone->wrapper_data, wpc->wrapper_data, wpc->wrapper_bytes);
+        clone->wrapper_bytes = wpc->wrapper_bytes;
+    }
+
+    return clone;
+}
+
+// With OPEN_LAZY, scanning the end of the file for the total number of samples (when that's not in
+// the first block header) and reading the tags are deferred until something needs them, which is
+// when this is called to perform the specified steps (if still pending). The file position is not
+// changed.
+
+void finish_lazy_open (WavpackContext *wpc, int steps)
+{
+    if (!(steps &= wpc->lazy_pending))
+        return;
+
+    wpc->lazy_pending &= ~steps;
+
+    if ((steps & LAZY_TOTAL_SAMPLES) && wpc->total_samples == -1) {
+        int64_t final_index = -1;
+
+        seek_eof_information (wpc, &final_index, FALSE, -1);
+
+        if (final_index != -1)
+            wpc->total_samples = final_index - wpc->initial_index;
+    }
+
+#ifndef NO_TAGS
+    if (steps & LAZY_TAGS) {
+        int64_t restore_pos = wpc->reader->get_pos (wpc->wv_in);
+
+        load_tag (wpc);
+        wpc->reader->set_pos_abs (wpc->wv_in, restore_pos);
+    }
+#endif
+}
+
+// Copy the information that was parsed when a file was opened (but no decoding state) from one
+// context to another, as for WavpackCloneContext() and WavpackReadRange(). Nothing is allocated,
+// so the caller must handle the channel identities, reordering and selection, the wrapper and the tags.
+
+void copy_context_info (WavpackContext *dest, WavpackContext *source)
+{
+    dest->config = source->config;
+    dest->total_samples = source->total_samples;
+    dest->initial_index = source->initial_index;
+    dest->filelen = source->filelen;
+    dest->file2len = source->file2len;
+    dest->wvc_flag = source->wvc_flag;
+    dest->open_flags = source->open_flags;
+    dest->norm_offset = source->norm_offset;
+    dest->reduced_channels = source->reduced_channels;
+    dest->lossy_blocks = source->lossy_blocks;
+    dest->version_five = source->version_five;
+    dest->max_streams = source->max_streams;
+    dest->stream_version = source->stream_version;
+    dest->file_format = source->file_format;
+    dest->channel_layout = source->channel_layout;
+    dest->dsd_multiplier = source->dsd_multiplier;
+    dest->seek_interval = source->seek_interval;
+    memcpy (dest->file_extension, source->file_extension, sizeof (dest->file_extension));
+#ifdef ENABLE_THREADS
+    dest->num_workers = source->num_workers;
+#endif
+}
+
+static int block_index_copy (BlockIndex *dest, BlockIndex *source)
+{
+    if (source->count) {
+        dest->entries = malloc (source->count * sizeof (BlockIndexEntry));
+
+        if (!dest->entries)
+            return FALSE;
+
+        memcpy (dest->entries, source->entries, source->count * sizeof (BlockIndexEntry));
+        dest->count = dest->max = source->count;
+    }
+
+    dest->complete = source->complete;
+
+    return TRUE;
+}
+
 // This function returns the major version number of the WavPack program
 // (or library) that created the open file. Currently, this can be 1 to 5.
 // Minor versions are not recorded in WavPack files.
@@ -326,7 +546,7 @@ int unpack_init (WavpackContext *wpc, int stream)
     CLEAR (wps->w);
 
     if (!(wps->wphdr.flags & MONO_FLAG) && wpc->config.num_channels && wps->wphdr.block_samples &&
-        (wpc->reduced_channels == 1 || wpc->config.num_channels == 1)) {
+        ((wpc->reduced_channels == 1 && !wpc->channel_map) || wpc->config.num_channels == 1)) {
             wps->mute_error = TRUE;
             return FALSE;
     }
@@ -691,6 +911,79 @@ static int read_sample_rate (WavpackContext *wpc, WavpackMetadata *wpmd)
     return TRUE;
 }
 
+// Read the seek table that the encoder may have stored in the first block (see wavpack_local.h
+// for the format) and add its entries to the block indexes, so that seeks never need to search
+// the file (they go to an indexed block, or walk forward from the closest one). The offsets are
+// relative to the first block, which is where the table is read from. Because the table is just
+// an optimization, one that does not match the file is ignored rather than flagged as an error.
+
+static int64_t read_le_bytes (unsigned char *byteptr, int bytes)
+{
+    uint64_t value = 0;
+
+    while (bytes--)
+        value = (value << 8) | byteptr [bytes];
+
+    return (int64_t) value;
+}
+
+static int read_seek_table (WavpackContext *wpc, WavpackMetadata *wpmd)
+{
+#ifndef NO_SEEKING
+    unsigned char *byteptr = (unsigned char *)wpmd->data;
+    int64_t block_end = 0, wv_pos = -1, wvc_pos = -1;
+    uint32_t interval, num_entries, i;
+    int entry_bytes, use_wvc;
+
+    if (wpc->seek_interval || (wpc->open_flags & OPEN_STREAMING) || GET_BLOCK_INDEX (wpc->streams [0]->wphdr) ||
+        wpmd->byte_length < SEEK_TABLE_HEADER_BYTES)
+            return TRUE;
+
+    entry_bytes = SEEK_TABLE_ENTRY_BYTES (byteptr [0]);
+    use_wvc = wpc->wvc_flag && (byteptr [0] & SEEK_TABLE_WVC);
+    interval = (uint32_t) read_le_bytes (byteptr + 2, 4);
+    num_entries = (uint32_t) read_le_bytes (byteptr + 6, 4);
+
+    if (!interval || !num_entries || num_entries > (uint32_t) (wpmd->byte_length - SEEK_TABLE_HEADER_BYTES) / entry_bytes)
+        return TRUE;
+
+    // first make sure the entries are in order and point inside the files
+
+    for (byteptr += SEEK_TABLE_HEADER_BYTES, i = 0; i < num_entries; ++i, byteptr += entry_bytes) {
+        int64_t block_index = read_le_bytes (byteptr, 8), offset = read_le_bytes (byteptr + 12, 8);
+        uint32_t block_samples = (uint32_t) read_le_bytes (byteptr + 8, 4);
+
+        if (block_index < block_end || !block_samples || offset <= wv_pos || wpc->filepos + offset >= wpc->filelen)
+            return TRUE;
+
+        block_end = block_index + block_samples;
+        wv_pos = offset;
+
+        if (use_wvc) {
+            offset = read_le_bytes (byteptr + 20, 8);
+
+            if (offset <= wvc_pos || wpc->file2pos + offset >= wpc->file2len)
+                return TRUE;
+
+            wvc_pos = offset;
+        }
+    }
+
+    for (byteptr = (unsigned char *)wpmd->data + SEEK_TABLE_HEADER_BYTES, i = 0; i < num_entries; ++i, byteptr += entry_bytes) {
+        int64_t block_index = read_le_bytes (byteptr, 8);
+        uint32_t block_samples = (uint32_t) read_le_bytes (byteptr + 8, 4);
+
+        block_index_add (&wpc->wv_index, block_index, wpc->filepos + read_le_bytes (byteptr + 12, 8), block_samples);
+
+        if (use_wvc)
+            block_index_add (&wpc->wvc_index, block_index, wpc->file2pos + read_le_bytes (byteptr + 20, 8), block_samples);
+    }
+
+    wpc->seek_interval = interval;
+#endif
+    return TRUE;
+}
+
 // Read wrapper data from metadata. Currently, this consists of the RIFF
 // header and trailer that wav files contain around the audio data but could
 // be used for other formats as well. Because WavPack files contain all the
@@ -712,8 +1005,11 @@ static int read_wrapper_data (WavpackContext *wpc, WavpackMetadata *wpmd)
 
 static int read_metadata_buff (WavpackMetadata *wpmd, unsigned char *blockbuff, unsigned char **buffptr)
 {
-    WavpackHeader *wphdr = (WavpackHeader *) blockbuff;
-    unsigned char *buffend = blockbuff + wphdr->ckSize + 8;
+    unsigned char *buffend;
+    WavpackHeader wphdr;
+
+    memcpy (&wphdr, blockbuff, sizeof (WavpackHeader));     // block might not be 4-byte aligned
+    buffend = blockbuff + wphdr.ckSize + 8;
 
     if (buffend - *buffptr < 2)
         return FALSE;
@@ -800,6 +1096,9 @@ static int process_metadata (WavpackContext *wpc, WavpackMetadata *wpmd, int str
         case ID_SAMPLE_RATE:
             return read_sample_rate (wpc, wpmd);
 
+        case ID_SEEK_TABLE:
+            return stream ? TRUE : read_seek_table (wpc, wpmd);
+
         case ID_WV_BITSTREAM:
             return init_wv_bitstream (wps, wpmd);
 
@@ -920,7 +1219,7 @@ void WavpackSeekTrailingWrapper (WavpackContext *wpc)
 {
     if ((wpc->open_flags & OPEN_WRAPPER) &&
         wpc->reader->can_seek (wpc->wv_in) && !wpc->stream3)
-            seek_eof_information (wpc, NULL, TRUE);
+            seek_eof_information (wpc, NULL, TRUE, -1);
 }
 
 // Get any MD5 checksum stored in the metadata (should be called after reading
@@ -931,7 +1230,7 @@ int WavpackGetMD5Sum (WavpackContext *wpc, unsigned char data [16])
 {
     if (wpc->config.flags & CONFIG_MD5_CHECKSUM) {
         if (!wpc->config.md5_read && wpc->reader->can_seek (wpc->wv_in))
-            seek_eof_information (wpc, NULL, FALSE);
+            seek_eof_information (wpc, NULL, FALSE, -1);
 
         if (wpc->config.md5_read) {
             memcpy (data, wpc->config.md5_checksum, 16);
@@ -942,6 +1241,85 @@ int WavpackGetMD5Sum (WavpackContext *wpc, unsigned char data [16])
     return FALSE;
 }
 
+// Read the remainder of the block whose header was just read (into "wphdr", in the
+// native endian format) from the specified file, and return a buffer containing the
+// complete block (or NULL if it could not be read). Normally the buffer comes from
+// the context pool, but if the file is in memory (WavpackOpenFileInputMemory()) and
+// the header there is identical to the native one (i.e., we're little-endian) then
+// the returned buffer points directly into the caller's data and nothing is copied
+// (note that such blocks are only guaranteed to be 2-byte aligned).
+// The latter case is indicated by a size of BLOCK_BUFFER_BORROWED, and buffers like
+// this must not be written (see store_block_header() below).
+
+unsigned char *read_block_buffer (WavpackContext *wpc, void *id, WavpackHeader *wphdr, uint32_t *size)
+{
+    unsigned char *buffer;
+
+#ifdef BITSTREAM_SHORTS     // only on little-endian builds, because the header is never converted in place
+    unsigned char *data = (id == wpc->wv_in) ? wpc->wv_data : ((id == wpc->wvc_in) ? wpc->wvc_data : NULL);
+
+    if (data) {
+        int64_t data_size = (id == wpc->wv_in) ? wpc->wv_data_size : wpc->wvc_data_size;
+        int64_t pos = wpc->reader->get_pos (id) - sizeof (WavpackHeader);
+
+        if (pos >= 0 && pos + wphdr->ckSize + 8 <= data_size && !((uintptr_t)(data + pos) & 1) &&
+            !memcmp (data + pos, wphdr, sizeof (WavpackHeader)) &&
+            !wpc->reader->set_pos_rel (id, wphdr->ckSize - 24, SEEK_CUR)) {
+                *size = BLOCK_BUFFER_BORROWED;
+                return data + pos;
+        }
+    }
+#endif
+
+    buffer = block_buffer_obtain (wpc, wphdr->ckSize + 8, size);
+
+    if (!buffer)
+        return NULL;
+
+    memcpy (buffer, wphdr, sizeof (WavpackHeader));
+
+    if (wpc->reader->read_bytes (id, buffer + sizeof (WavpackHeader), wphdr->ckSize - 24) != wphdr->ckSize - 24) {
+        block_buffer_release (wpc, buffer, *size);
+        *size = 0;
+        return NULL;
+    }
+
+    return buffer;
+}
+
+// Store the specified (native endian) header into the block buffer. If the buffer is
+// borrowed (i.e., points into read-only caller data) then we don't need to do anything
+// as long as the block size, samples and flags match (the block index in these headers
+// is never used). Otherwise, we switch to a copy of the block from the pool.
+
+void store_block_header (WavpackContext *wpc, unsigned char **buffer, uint32_t *size, WavpackHeader *wphdr)
+{
+    if (*size == BLOCK_BUFFER_BORROWED) {
+        unsigned char *new_buffer;
+        WavpackHeader orig_wphdr;
+
+        memcpy (&orig_wphdr, *buffer, sizeof (WavpackHeader));
+
+        if (orig_wphdr.ckSize == wphdr->ckSize && orig_wphdr.block_samples == wphdr->block_samples &&
+            orig_wphdr.flags == wphdr->flags)
+                return;
+
+        new_buffer = block_buffer_obtain (wpc, wphdr->ckSize + 8, size);
+
+        if (!new_buffer) {      // this can only happen when rendering corrupt blocks harmless
+            *size = BLOCK_BUFFER_BORROWED;
+            return;
+        }
+
+        if (wphdr->ckSize > 24)
+            memcpy (new_buffer + sizeof (WavpackHeader), *buffer + sizeof (WavpackHeader), wphdr->ckSize - 24);
+
+        *buffer = new_buffer;
+    }
+
+    memcpy (*buffer, wphdr, sizeof (WavpackHeader));
+}
+
 // Read from current file position until a valid 32-byte WavPack 4.0 header is
 // found and read into the specified pointer. The number of bytes skipped is
 // returned. If no WavPack header is found within 1 meg, then a -1 is returned
@@ -1060,24 +1438,17 @@ int read_wvc_block (WavpackContext *wpc, int stream)
         compare_result = match_wvc_header (&wps->wphdr, &wphdr);
 
         if (!compare_result) {
-            wps->block2buff = (unsigned char *)malloc (wphdr.ckSize + 8);
-	    if (!wps->block2buff)
-	        return FALSE;
-
-            if (wpc->reader->read_bytes (wpc->wvc_in, wps->block2buff + 32, wphdr.ckSize - 24) !=
-                wphdr.ckSize - 24) {
-                    free (wps->block2buff);
-                    wps->block2buff = NULL;
-                    wps->wvc_skip = TRUE;
-                    wpc->crc_errors++;
-                    return FALSE;
-            }
+            wps->block2buff = read_block_buffer (wpc, wpc->wvc_in, &orig_wphdr, &wps->block2buff_size);
 
-            memcpy (wps->block2buff, &orig_wphdr, 32);
+            if (!wps->block2buff) {
+                wps->wvc_skip = TRUE;
+                wpc->crc_errors++;
+                return FALSE;
+            }
 
             // don't use corrupt blocks
             if (!WavpackVerifySingleBlock (wps->block2buff, !(wpc->open_flags & OPEN_NO_CHECKSUM))) {
-                free (wps->block2buff);
+                block_buffer_release (wpc, wps->block2buff, wps->block2buff_size);
                 wps->block2buff = NULL;
                 wps->wvc_skip = TRUE;
                 wpc->crc_errors++;
@@ -1085,8 +1456,13 @@ int read_wvc_block (WavpackContext *wpc, int stream)
             }
 
             wps->wvc_skip = FALSE;
-            memcpy (wps->block2buff, &wphdr, 32);
+            store_block_header (wpc, &wps->block2buff, &wps->block2buff_size, &wphdr);
             memcpy (&wps->wphdr, &wphdr, 32);
+
+#ifndef NO_SEEKING
+            if (wphdr.block_samples && (wphdr.flags & INITIAL_BLOCK) && !(wpc->open_flags & OPEN_STREAMING))
+                block_index_add (&wpc->wvc_index, GET_BLOCK_INDEX (wphdr), wpc->file2pos, wphdr.block_samples);
+#endif
             return TRUE;
         }
         else if (compare_result == -1) {
@@ -1098,6 +1474,48 @@ int read_wvc_block (WavpackContext *wpc, int stream)
     }
 }
 
+// Skip over the rest of the block whose header was just read for the specified stream (and the
+// matching wvc block) because the stream has none of the channels selected for decoding (see
+// WavpackSelectChannels()). We jump over the block data when the file can seek and otherwise read
+// and discard it. The stream is not initialized, but its block index is adjusted and its sample index
+// is set just like for decoded streams so that it's kept in step with them. A return of FALSE indicates
+// that the block could not be read (i.e., the end of the file).
+
+int skip_stream_block (WavpackContext *wpc, int stream)
+{
+    WavpackStream *wps = wpc->streams [stream];
+
+    if (wpc->reader->set_pos_rel (wpc->wv_in, wps->wphdr.ckSize - 24, SEEK_CUR)) {
+        unsigned char *buffer = read_block_buffer (wpc, wpc->wv_in, &wps->wphdr, &wps->blockbuff_size);
+
+        if (!buffer)
+            return FALSE;
+
+        block_buffer_release (wpc, buffer, wps->blockbuff_size);
+        wps->blockbuff_size = 0;
+    }
+
+    if (wpc->open_flags & OPEN_STREAMING)
+        SET_BLOCK_INDEX (wps->wphdr, wps->sample_index = 0);
+    else
+        SET_BLOCK_INDEX (wps->wphdr, GET_BLOCK_INDEX (wps->wphdr) - wpc->initial_index);
+
+    if (wpc->wvc_flag) {
+        read_wvc_block (wpc, stream);
+
+        if (wps->block2buff) {
+            block_buffer_release (wpc, wps->block2buff, wps->block2buff_size);
+            wps->block2buff = NULL;
+            wps->block2buff_size = 0;
+        }
+    }
+
+    if (wps->wphdr.block_samples)
+        wps->sample_index = GET_BLOCK_INDEX (wps->wphdr);
+
+    return TRUE;
+}
+
 // This function is used to seek to end of a file to obtain certain information
 // that is stored there at the file creation time because it is not known at
 // the start. This includes the MD5 sum and and trailing part of the file
@@ -1109,8 +1527,10 @@ int read_wvc_block (WavpackContext *wpc, int stream)
 // information was retrieved. An error return of FALSE usually means the file
 // terminated unexpectedly. Note that this could be used to get all three
 // types of information in one go, but it's not actually used that way now.
+// The search normally starts 1MB from the end of the file, but the caller can
+// specify a closer starting position (which is backed up from if necessary).
 
-static int seek_eof_information (WavpackContext *wpc, int64_t *final_index, int get_wrapper)
+static int seek_eof_information (WavpackContext *wpc, int64_t *final_index, int get_wrapper, int64_t start_pos)
 {
     int64_t restore_pos, last_pos = -1;
     WavpackStreamReader64 *reader = wpc->reader;
@@ -1123,7 +1543,9 @@ static int seek_eof_information (WavpackContext *wpc, int64_t *final_index, int
 
     // start 1MB from the end-of-file, or from the start if the file is not that big
 
-    if (reader->get_length (id) > (int64_t) 1048576)
+    if (start_pos >= 0)
+        reader->set_pos_abs (id, start_pos);
+    else if (reader->get_length (id) > (int64_t) 1048576)
         reader->set_pos_rel (id, -1048576, SEEK_END);
     else
         reader->set_pos_abs (id, 0);
@@ -1258,6 +1680,355 @@ static int seek_eof_information (WavpackContext *wpc, int64_t *final_index, int
     }
 }
 
+// Add the specified bytes (an even number, in file order) to a running block checksum, which is
+// calculated over the 16-bit little-endian words of the block (see WavpackVerifySingleBlock()).
+
+static uint32_t update_checksum (uint32_t csum, unsigned char *bytes, uint32_t bcount)
+{
+    for (; bcount >= 2; bcount -= 2, bytes += 2)
+        csum = (csum * 3) + bytes [0] + (bytes [1] << 8);
+
+    return csum;
+}
+
+// Probe a WavPack file for the information that the WavpackGet*() functions would return after
+// opening it with the same flags (see WavpackProbeFile()), but without allocating anything. The
+// context is just used (on the stack) to hold what's parsed. Only the first block with audio (and
+// any before it) is read, and just the metadata if OPEN_NO_CHECKSUM is specified, along with the
+// tag header if OPEN_TAGS is specified. The end of the file is scanned only if needed for the total
+// samples or MD5 sum, starting close to the end of the audio, and not at all with OPEN_LAZY. Unlike
+// opening, the decoding parameters are not parsed or checked. Legacy (pre-4.0) files are not handled.
+// The handles are not closed. A return value of FALSE means the file could not be probed, and a
+// message is copied to "error" and the info is cleared.
+
+int probe_file (WavpackStreamReader64 *reader, void *wv_id, void *wvc_id, WavpackProbeInfo *info, char *error, int flags)
+{
+    int64_t first_block_pos = 0, audio_end;
+    WavpackStream *no_stream = NULL;
+    unsigned char meta_data [512];
+    int num_blocks = 0, can_seek;
+    unsigned char first_byte;
+    WavpackHeader wphdr;
+    WavpackContext wpc;
+    uint32_t bcount;
+
+    CLEAR (*info);
+    CLEAR (wphdr);
+    CLEAR (wpc);
+    wpc.wv_in = wv_id;
+    wpc.reader = reader;
+    wpc.streams = &no_stream;               // process_metadata() only uses this for stream data
+    wpc.total_samples = -1;
+    wpc.max_streams = OLD_MAX_STREAMS;      // use this until overwritten with actual number
+    wpc.open_flags = flags;
+    wpc.filelen = audio_end = reader->get_length (wv_id);
+    can_seek = reader->can_seek (wv_id);
+
+#ifndef NO_TAGS
+    if ((flags & OPEN_TAGS) && can_seek) {
+        if (locate_tag (&wpc) && !wpc.m_tag.tag_begins_file)
+            audio_end += wpc.m_tag.tag_file_pos;
+
+        reader->set_pos_abs (wv_id, 0);
+    }
+#endif
+
+    if (reader->read_bytes (wv_id, &first_byte, 1) != 1) {
+        if (error) strcpy (error, "can't read all of WavPack file!");
+        return FALSE;
+    }
+
+    reader->push_back_byte (wv_id, first_byte);
+
+    if (first_byte == 'R') {
+        if (error) strcpy (error, "legacy WavPack files can't be probed!");
+        return FALSE;
+    }
+
+    // Parse the metadata of blocks (just the small items we need) until we get one with audio. Unless
+    // OPEN_NO_CHECKSUM is specified, blocks are verified as they are read (rather than skipping over
+    // the audio data) and, just like opening, any that fail are ignored.
+
+    while (!wphdr.block_samples) {
+        int verify = !(flags & OPEN_NO_CHECKSUM), checksum_passed = 0, checksum_failed = 0;
+        uint32_t csum = (uint32_t) -1;
+        WavpackContext block_wpc;
+
+        first_block_pos = reader->get_pos (wv_id);
+        bcount = read_next_header (reader, wv_id, &wphdr);
+
+        if (bcount == (uint32_t) -1 || (!wphdr.block_samples && num_blocks++ > 16)) {
+            if (error) strcpy (error, "not compatible with this version of WavPack file!");
+            return FALSE;
+        }
+
+        first_block_pos += bcount;
+        memcpy (&block_wpc, &wpc, sizeof (wpc));    // so we can back out a block that fails
+
+        if (verify) {
+            WavpackHeader file_hdr = wphdr;
+
+            WavpackNativeToLittleEndian (&file_hdr, WavpackHeaderFormat);
+            csum = update_checksum (csum, (unsigned char *) &file_hdr, sizeof (file_hdr));
+        }
+
+        for (bcount = wphdr.ckSize - sizeof (WavpackHeader) + 8; bcount >= 2;) {
+            uint32_t meta_bc, meta_hdr_bytes = 2, meta_read = 0;
+            unsigned char meta_hdr [4];
+            WavpackMetadata wpmd;
+            int wanted = FALSE;
+
+            if (reader->read_bytes (wv_id, meta_hdr, 2) != 2 || ((meta_hdr [0] & ID_LARGE) &&
+                (bcount < 4 || reader->read_bytes (wv_id, meta_hdr + 2, 2) != 2))) {
+                    if (error) strcpy (error, "can't read all of WavPack file!");
+                    return FALSE;
+            }
+
+            meta_bc = meta_hdr [1] << 1;
+
+            if (meta_hdr [0] & ID_LARGE) {
+                meta_bc += ((uint32_t) meta_hdr [2] << 9) + ((uint32_t) meta_hdr [3] << 17);
+                meta_hdr_bytes = 4;
+            }
+
+            bcount -= meta_hdr_bytes;
+
+            if (meta_bc > bcount) {
+                if (error) strcpy (error, "not compatible with this version of WavPack file!");
+                return FALSE;
+            }
+
+            wpmd.id = meta_hdr [0] & ID_UNIQUE;
+            wpmd.byte_length = (meta_hdr [0] & ID_ODD_SIZE) && meta_bc ? meta_bc - 1 : meta_bc;
+            wpmd.data = meta_data;
+
+            if (verify && wpmd.id == ID_BLOCK_CHECKSUM) {
+                if ((meta_hdr [0] & ID_ODD_SIZE) || meta_bc < 2 || meta_bc > 4 ||
+                    reader->read_bytes (wv_id, meta_data, meta_bc) != (int32_t) meta_bc) {
+                        checksum_failed++;
+                        break;
+                }
+
+                if (meta_bc == 4 ? (meta_data [0] != (csum & 0xff) || meta_data [1] != ((csum >> 8) & 0xff) ||
+                    meta_data [2] != ((csum >> 16) & 0xff) || meta_data [3] != ((csum >> 24) & 0xff)) :
+                    (meta_data [0] != ((csum ^ (csum >> 16)) & 0xff) || meta_data [1] != (((csum ^ (csum >> 16)) >> 8) & 0xff)))
+                        checksum_failed++;
+                else
+                    checksum_passed++;
+
+                wpc.version_five = 1;           // this is a good indicator of version 5 files
+                bcount -= meta_bc;
+                continue;
+            }
+
+            if (verify)
+                csum = update_checksum (csum, meta_hdr, meta_hdr_bytes);
+
+            switch (wpmd.id) {
+                case ID_CHANNEL_INFO: case ID_CONFIG_BLOCK: case ID_NEW_CONFIG_BLOCK: case ID_SAMPLE_RATE:
+                case ID_FLOAT_INFO: case ID_MD5_CHECKSUM: case ID_ALT_MD5_CHECKSUM: case ID_ALT_EXTENSION:
+                    wanted = meta_bc <= sizeof (meta_data);     // otherwise too big to be valid, so skip it
+                    break;
+
+                case ID_DSD_BLOCK:                              // we just need the DSD rate from this
+                    wanted = meta_bc > 0;
+                    break;
+
+                case ID_BLOCK_CHECKSUM:
+                    wanted = TRUE;
+                    break;
+            }
+
+            // we read all the data if we're verifying the block, otherwise just what we need
+
+            while (meta_read < meta_bc && (verify || (wanted && !meta_read))) {
+                uint32_t chunk_bytes = meta_bc - meta_read < sizeof (meta_data) ? meta_bc - meta_read : sizeof (meta_data);
+
+                if (reader->read_bytes (wv_id, meta_data, chunk_bytes) != (int32_t) chunk_bytes) {
+                    if (error) strcpy (error, "can't read all of WavPack file!");
+                    return FALSE;
+                }
+
+                if (verify)
+                    csum = update_checksum (csum, meta_data, chunk_bytes);
+
+                if (wanted && !meta_read) {
+                    switch (wpmd.id) {
+                        case ID_NEW_CONFIG_BLOCK:       // just the file format and qmode (no channel reordering)
+                            wpc.version_five = 1;
+                            wpc.file_format = wpc.config.qmode = 0;
+
+                            if (wpmd.byte_length >= 2) {
+                                wpc.file_format = meta_data [0];
+                                wpc.config.qmode = meta_data [1];
+                            }
+
+                            break;
+
+                        case ID_FLOAT_INFO:
+                            if (wpmd.byte_length == 4)
+                                wpc.config.float_norm_exp = meta_data [3];
+
+                            break;
+
+                        case ID_DSD_BLOCK:
+                            if (meta_data [0] <= 31)
+                                wpc.dsd_multiplier = 1U << meta_data [0];
+
+                            break;
+
+                        default:
+                            if (!process_metadata (&wpc, &wpmd, 0)) {
+                                if (error) strcpy (error, "not compatible with this version of WavPack file!");
+                                return FALSE;
+                            }
+
+                            break;
+                    }
+                }
+
+                meta_read += chunk_bytes;
+            }
+
+            if (wanted && !meta_bc && !process_metadata (&wpc, &wpmd, 0)) {
+                if (error) strcpy (error, "not compatible with this version of WavPack file!");
+                return FALSE;
+            }
+
+            if (meta_bc > meta_read)
+                reader->set_pos_rel (wv_id, meta_bc - meta_read, SEEK_CUR);
+
+            bcount -= meta_bc;
+        }
+
+        // if block does not verify, back out anything we got from it and continue
+
+        if (verify && (bcount || checksum_failed || ((wphdr.flags & HAS_CHECKSUM) && !checksum_passed))) {
+            memcpy (&wpc, &block_wpc, sizeof (wpc));
+            wphdr.block_samples = 0;
+            continue;
+        }
+
+        if (wphdr.block_samples) {
+            if (wpc.total_samples == -1) {
+                if (GET_BLOCK_INDEX (wphdr) || GET_TOTAL_SAMPLES (wphdr) == -1)
+                    wpc.initial_index = GET_BLOCK_INDEX (wphdr);
+                else
+                    wpc.total_samples = GET_TOTAL_SAMPLES (wphdr);
+            }
+        }
+        else if (wpc.total_samples == -1 && !GET_BLOCK_INDEX (wphdr) && GET_TOTAL_SAMPLES (wphdr))
+            wpc.total_samples = GET_TOTAL_SAMPLES (wphdr);
+    }
+
+    // now fill in what's derived from the header of the first block with audio, as opening does
+
+    wpc.config.flags &= ~0xff;
+    wpc.config.flags |= wphdr.flags & 0xff;
+
+    if (!wpc.config.num_channels) {
+        wpc.config.num_channels = (wphdr.flags & MONO_FLAG) ? 1 : 2;
+        wpc.config.channel_mask = 0x5 - wpc.config.num_channels;
+    }
+
+    if (wphdr.flags & DSD_FLAG) {
+#ifdef ENABLE_DSD
+        if (flags & OPEN_DSD_NATIVE) {
+            wpc.config.bytes_per_sample = 1;
+            wpc.config.bits_per_sample = 8;
+        }
+        else if (flags & OPEN_DSD_AS_PCM) {
+            wpc.config.bytes_per_sample = 3;
+            wpc.config.bits_per_sample = 24;
+        }
+        else {
+            if (error) strcpy (error, "WavPack DSD file handling not enabled by application!");
+            return FALSE;
+        }
+#else
+        if (error) strcpy (error, "WavPack library not built with DSD file support!");
+        return FALSE;
+#endif
+    }
+    else {
+        wpc.config.bytes_per_sample = (wphdr.flags & BYTES_STORED) + 1;
+        wpc.config.bits_per_sample = (wpc.config.bytes_per_sample * 8) - ((wphdr.flags & SHIFT_MASK) >> SHIFT_LSB);
+    }
+
+    if (!wpc.config.sample_rate) {
+        if ((wphdr.flags & SRATE_MASK) == SRATE_MASK)
+            wpc.config.sample_rate = 44100;
+        else
+            wpc.config.sample_rate = sample_rates [(wphdr.flags & SRATE_MASK) >> SRATE_LSB];
+    }
+
+    if (wvc_id && (wphdr.flags & HYBRID_FLAG) && reader->read_bytes (wvc_id, &first_byte, 1) == 1) {
+        reader->push_back_byte (wvc_id, first_byte);
+        wpc.file2len = reader->get_length (wvc_id);
+        wpc.wvc_flag = TRUE;
+    }
+
+    // The final block (usually) has the MD5 sum, and the total samples (if that's not in the first
+    // block) comes from its header. Blocks are generally similar in size, so we start looking a
+    // couple of blocks before the end of the audio (i.e., before any tag) and back up if needed.
+
+    if (can_seek && !(flags & OPEN_LAZY) && (wpc.total_samples == -1 ||
+        ((wpc.config.flags & CONFIG_MD5_CHECKSUM) && !wpc.config.md5_read))) {
+            int64_t final_index = -1, start_pos = audio_end - (int64_t) (wphdr.ckSize + 8) * 2;
+
+            seek_eof_information (&wpc, &final_index, FALSE, start_pos > first_block_pos ? start_pos : first_block_pos);
+
+            if (wpc.total_samples == -1 && final_index != -1)
+                wpc.total_samples = final_index - wpc.initial_index;
+    }
+
+    info->num_samples = wpc.total_samples;
+    info->file_size = WavpackGetFileSize64 (&wpc);
+    info->sample_rate = WavpackGetSampleRate (&wpc);
+    info->native_sample_rate = WavpackGetNativeSampleRate (&wpc);
+    info->num_channels = WavpackGetNumChannels (&wpc);
+    info->channel_mask = WavpackGetChannelMask (&wpc);
+    info->bits_per_sample = WavpackGetBitsPerSample (&wpc);
+    info->bytes_per_sample = WavpackGetBytesPerSample (&wpc);
+    info->float_norm_exp = WavpackGetFloatNormExp (&wpc);
+    info->version = WavpackGetVersion (&wpc);
+    info->qualify_mode = WavpackGetQualifyMode (&wpc);
+    info->file_format = WavpackGetFileFormat (&wpc);
+    strcpy (info->file_extension, WavpackGetFileExtension (&wpc));
+    info->mode = WavpackGetMode (&wpc);
+
+    // these mode bits depend on the stream version, which WavpackGetMode() gets from the stream
+
+    if ((info->mode & MODE_HIGH) && wphdr.version < 0x405)
+        info->mode |= MODE_VERY_HIGH;
+
+    if ((wpc.config.flags & CONFIG_HYBRID_FLAG) && (wpc.config.flags & CONFIG_DYNAMIC_SHAPING) && wphdr.version >= 0x407)
+        info->mode |= MODE_DNS;
+
+    if (wpc.config.md5_read) {
+        memcpy (info->md5_sum, wpc.config.md5_checksum, sizeof (info->md5_sum));
+        info->md5_read = TRUE;
+    }
+
+#ifndef NO_TAGS
+    if (valid_tag (&wpc.m_tag) == 'A') {
+        info->tag_length = wpc.m_tag.ape_tag_hdr.length;
+
+        if (wpc.m_tag.ape_tag_hdr.flags & APE_TAG_CONTAINS_HEADER)
+            info->tag_length += sizeof (APE_Tag_Hdr);
+
+        info->tag_position = wpc.m_tag.tag_begins_file ? 0 : wpc.filelen + wpc.m_tag.tag_file_pos;
+        info->tag_items = wpc.m_tag.ape_tag_hdr.item_count;
+    }
+    else if (valid_tag (&wpc.m_tag) == 'T') {
+        info->tag_length = sizeof (ID3_Tag);
+        info->tag_position = wpc.filelen - sizeof (ID3_Tag);
+    }
+#endif
+
+    return TRUE;
+}
+
 // Quickly verify the referenced block. It is assumed that the WavPack header has been converted
 // to native endian format. If a block checksum is performed, that is done in little-endian
 // (file) format. It is also assumed that the caller has made sure that the block length
@@ -1267,15 +2038,17 @@ static int seek_eof_information (WavpackContext *wpc, int64_t *final_index, int
 
 int WavpackVerifySingleBlock (unsigned char *buffer, int verify_checksum)
 {
-    WavpackHeader *wphdr = (WavpackHeader *) buffer;
     uint32_t checksum_passed = 0, bcount, meta_bc;
     unsigned char *dp, meta_id, c1, c2;
+    WavpackHeader wphdr;
+
+    memcpy (&wphdr, buffer, sizeof (WavpackHeader));        // buffer might not be 4-byte aligned
 
-    if (strncmp (wphdr->ckID, "wvpk", 4) || wphdr->ckSize + 8 < sizeof (WavpackHeader))
+    if (strncmp (wphdr.ckID, "wvpk", 4) || wphdr.ckSize + 8 < sizeof (WavpackHeader))
         return FALSE;
 
-    bcount = wphdr->ckSize - sizeof (WavpackHeader) + 8;
-    dp = (unsigned char *)(wphdr + 1);
+    bcount = wphdr.ckSize - sizeof (WavpackHeader) + 8;
+    dp = buffer + sizeof (WavpackHeader);
 
     while (bcount >= 2) {
         meta_id = *dp++;
@@ -1341,5 +2114,5 @@ int WavpackVerifySingleBlock (unsigned char *buffer, int verify_checksum)
         dp += meta_bc;
     }
 
-    return (bcount == 0) && (!verify_checksum || !(wphdr->flags & HAS_CHECKSUM) || checksum_passed);
+    return (bcount == 0) && (!verify_checksum || !(wphdr.flags & HAS_CHECKSUM) || checksum_passed);
 }
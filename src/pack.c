@@ -28,20 +28,35 @@
 // WavpackStream structure would already be cleared, however this function can
 // also be used to clear the stream context of history which is required after
 // discontinuities caused by multi-threaded temporal encoding. This is why,
-// for example, we do not clear the sample_index here.
+// for example, we do not clear the sample_index here. For the same reason, the
+// dynamic noise shaping profile (which depends only on the source audio) and
+// the accumulated noise measurements are retained.
 
 void pack_init (WavpackStream *wps)
 {
+    int16_t *shaping_data = wps->dc.shaping_data;
+    int32_t shaping_samples = wps->dc.shaping_samples;
+    double noise_sum = wps->dc.noise_sum, noise_max = wps->dc.noise_max;
+
     wps->num_terms = 0;
     wps->dc.error [0] = wps->dc.error [1] = 0;
     CLEARA (wps->decorr_passes);
     CLEAR (wps->dc);
 
+    wps->dc.noise_sum = noise_sum;
+    wps->dc.noise_max = noise_max;
+
     if (wps->delta_decay == 0.0)
         wps->delta_decay = 2.0;
 
     if (wps->wpc->config.flags & CONFIG_DYNAMIC_SHAPING) {
-        wps->dc.shaping_data = malloc (wps->wpc->max_samples * sizeof (*wps->dc.shaping_data));
+        if (shaping_data) {
+            wps->dc.shaping_data = shaping_data;
+            wps->dc.shaping_samples = shaping_samples;
+        }
+        else
+            wps->dc.shaping_data = malloc (wps->wpc->max_samples * sizeof (*wps->dc.shaping_data));
+
         CLEAR (wps->analysis_pass);
         wps->analysis_pass.term = 18;
         wps->analysis_pass.delta = 2;
@@ -372,6 +387,21 @@ static void write_config_info (WavpackStream *wps, WavpackMetadata *wpmd)
     wpmd->byte_length = (int32_t)(byteptr - (char *) wpmd->data);
 }
 
+// Allocate room for the seek table that is stored in the first block of audio
+// data. It is written here with no entries (just the flags) and is filled in
+// later by WavpackUpdateNumSamples() when the application rewrites the first
+// block (see wavpack_local.h for the format).
+
+static void write_seek_table_info (WavpackStream *wps, WavpackMetadata *wpmd)
+{
+    unsigned char flags = wps->wpc->wvc_flag ? SEEK_TABLE_WVC : 0;
+
+    wpmd->byte_length = SEEK_TABLE_HEADER_BYTES + wps->wpc->seek_table_entries * SEEK_TABLE_ENTRY_BYTES (flags);
+    wpmd->data = calloc (1, wpmd->byte_length);
+    wpmd->id = ID_SEEK_TABLE;
+    * (unsigned char *) wpmd->data = flags;
+}
+
 // Allocate room for and copy the "new" configuration information into the
 // specified metadata structure. This is all the stuff introduced with version
 // 5.0 and includes the qmode flags (big-endian, etc.) and CAF extended
@@ -440,6 +470,62 @@ static void write_sample_rate (WavpackStream *wps, WavpackMetadata *wpmd)
     wpmd->byte_length = (int32_t)(byteptr - (char *) wpmd->data);
 }
 
+static int scan_int32_data (WavpackStream *wps, int32_t *values, int32_t num_values);
+static void scan_int32_quick (WavpackStream *wps, int32_t *values, int32_t num_values);
+static void send_int32_data (WavpackStream *wps, int32_t *values, int32_t num_values);
+static int scan_redundancy (int32_t *values, int32_t num_values);
+static int pack_samples (WavpackStream *wps, int32_t *buffer);
+static void bs_open_write (Bitstream *bs, void *buffer_start, void *buffer_end);
+static uint32_t bs_close_write (Bitstream *bs);
+
+// Calculate the dynamic noise shaping profile for the next block of the first stream, if that's
+// where pack_block() would do it (which is where the block can be shortened). This allows the
+// length of the block to be known before it's packed, which is required for multithreading
+// because other streams (or the next block) are started before this one is done. Returns TRUE
+// if the profile was calculated (and the block length possibly changed), otherwise FALSE.
+
+int pack_block_shaping (WavpackStream *wps)
+{
+    uint32_t flags = wps->wphdr.flags;
+
+    if (!wps->stream_index && !(flags & FLOAT_DATA) && (flags & MAG_MASK) >> MAG_LSB < 24 &&
+        (wps->wpc->config.flags & CONFIG_DYNAMIC_SHAPING) && !wps->wpc->config.block_samples) {
+            dynamic_noise_shaping (wps, wps->sample_buffer, TRUE);
+            wps->dc.shaping_done = TRUE;
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+// Determine whether the --merge-blocks feature must shorten the next block of the first stream (and
+// therefore of all the streams). The nominal block is made up of some number of fixed-size pieces
+// (of "block_boundary" samples) and it's cut at the first piece whose redundancy (i.e., wasted bits
+// like those left by lossyWAV) differs from the first one's. Like pack_block_shaping(), this is done
+// before the packing starts so that it works with multithreading, and the decision depends only on
+// the source audio, so doing it here does not change the output. Returns TRUE if the block length
+// was changed, otherwise FALSE.
+
+int pack_block_merge (WavpackStream *wps)
+{
+    uint32_t flags = wps->wphdr.flags, boundary = wps->wpc->block_boundary;
+    int32_t sample_count = wps->wphdr.block_samples;
+
+    if (!wps->stream_index && !(flags & (FLOAT_DATA | DSD_FLAG)) && (flags & MAG_MASK) >> MAG_LSB < 24 &&
+        boundary && sample_count >= (int32_t) boundary * 2) {
+            int bc = sample_count / boundary, chans = (flags & MONO_DATA) ? 1 : 2;
+            int res = scan_redundancy (wps->sample_buffer, boundary * chans), i;
+
+            for (i = 1; i < bc; ++i)
+                if (res != scan_redundancy (wps->sample_buffer + (i * boundary * chans), boundary * chans)) {
+                    wps->wphdr.block_samples = boundary * i;
+                    return TRUE;
+                }
+    }
+
+    return FALSE;
+}
+
 // Pack an entire block of samples (either mono or stereo) into a completed
 // WavPack block. This function is actually a shell for pack_samples() and
 // performs tasks like handling any shift required by the format, preprocessing
@@ -449,14 +535,6 @@ static void write_sample_rate (WavpackStream *wps, WavpackMetadata *wpmd)
 // "wps->blockend" points to the end of the available space. A return value of
 // FALSE indicates an error.
 
-static int scan_int32_data (WavpackStream *wps, int32_t *values, int32_t num_values);
-static void scan_int32_quick (WavpackStream *wps, int32_t *values, int32_t num_values);
-static void send_int32_data (WavpackStream *wps, int32_t *values, int32_t num_values);
-static int scan_redundancy (int32_t *values, int32_t num_values);
-static int pack_samples (WavpackStream *wps, int32_t *buffer);
-static void bs_open_write (Bitstream *bs, void *buffer_start, void *buffer_end);
-static uint32_t bs_close_write (Bitstream *bs);
-
 int pack_block (WavpackStream *wps, int32_t *buffer)
 {
     uint32_t flags = wps->wphdr.flags, sflags = wps->wphdr.flags;
@@ -465,28 +543,21 @@ int pack_block (WavpackStream *wps, int32_t *buffer)
 
     // This is done first because this code can potentially change the size of the block about to
     // be encoded. This can happen because the dynamic noise shaping algorithm wants to send a
-    // shorter block because the desired noise-shaping profile is changing quickly. It can also
-    // be that the --merge-blocks feature wants to create a longer block because it combines areas
-    // with equal redundancy. These are not applicable for anything besides the first stream of
-    // the file and they are not applicable with float data or >24-bit data.
+    // shorter block because the desired noise-shaping profile is changing quickly. This is not
+    // applicable for anything besides the first stream of the file and it is not applicable with
+    // float data or >24-bit data. Note that the --merge-blocks feature, which also determines the
+    // block size, is handled before we get here (see pack_block_merge()).
 
     if (!wps->stream_index && !(flags & FLOAT_DATA) && (flags & MAG_MASK) >> MAG_LSB < 24) {
         if ((wps->wpc->config.flags & CONFIG_DYNAMIC_SHAPING) && !wps->wpc->config.block_samples) {
-            dynamic_noise_shaping (wps, buffer, TRUE);
+            if (wps->dc.shaping_done)               // already done by pack_block_shaping()
+                wps->dc.shaping_done = FALSE;
+            else
+                dynamic_noise_shaping (wps, buffer, TRUE);
+
             sample_count = wps->wphdr.block_samples;
             dynamic_shaping_done = TRUE;
         }
-        else if (wps->wpc->block_boundary && sample_count >= (int32_t) wps->wpc->block_boundary * 2) {
-            int bc = sample_count / wps->wpc->block_boundary, chans = (flags & MONO_DATA) ? 1 : 2;
-            int res = scan_redundancy (buffer, wps->wpc->block_boundary * chans), i;
-
-            for (i = 1; i < bc; ++i)
-                if (res != scan_redundancy (buffer + (i * wps->wpc->block_boundary * chans),
-                    wps->wpc->block_boundary * chans)) {
-                        sample_count = wps->wphdr.block_samples = wps->wpc->block_boundary * i;
-                        break;
-                    }
-        }
     }
 
     // This code scans stereo data to check whether it can be stored as mono data
@@ -987,6 +1058,12 @@ void send_general_metadata (WavpackStream *wps)
         write_config_info (wps, &wpmd);
         copy_metadata (&wpmd, wps->blockbuff, wps->blockend);
         free_metadata (&wpmd);
+
+        if (wps->wpc->seek_table_entries) {
+            write_seek_table_info (wps, &wpmd);
+            copy_metadata (&wpmd, wps->blockbuff, wps->blockend);
+            free_metadata (&wpmd);
+        }
     }
 
     if (flags & INITIAL_BLOCK) {
@@ -1060,19 +1137,13 @@ static int pack_samples (WavpackStream *wps, int32_t *buffer)
     crc = crc2 = 0xffffffff;
 
     if (!(flags & HYBRID_FLAG) && (flags & MONO_DATA)) {
-        int32_t *eptr = buffer + sample_count;
-
-        for (bptr = buffer; bptr < eptr;)
-            crc += (crc << 1) + *bptr++;
+        crc = crc_mono_samples (crc, buffer, sample_count);
 
         if (wps->num_passes)
             execute_mono (wps, buffer, !wps->num_terms, 1);
     }
     else if (!(flags & HYBRID_FLAG) && !(flags & MONO_DATA)) {
-        int32_t *eptr = buffer + (sample_count * 2);
-
-        for (bptr = buffer; bptr < eptr; bptr += 2)
-            crc += (crc << 3) + ((uint32_t)bptr [0] << 1) + bptr [0] + bptr [1];
+        crc = crc_stereo_samples (crc, buffer, sample_count);
 
         if (wps->num_passes) {
             execute_stereo (wps, buffer, !wps->num_terms, 1);
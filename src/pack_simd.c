@@ -0,0 +1,219 @@
+////////////////////////////////////////////////////////////////////////////
+//                           **** WAVPACK ****                            //
+//                  Hybrid Lossless Wavefile Compressor                   //
+//                Copyright (c) 1998 - 2024 David Bryant.                 //
+//                          All Rights Reserved.                          //
+//      Distributed under the BSD Software License (see license.txt)      //
+////////////////////////////////////////////////////////////////////////////
+
+// pack_simd.c
+
+// This module provides AVX2 versions of the functions that the "extra" modes
+// use to search for the best decorrelation filters, which is where most of
+// the time is spent with -x4 to -x6: the stereo decorrelation "continuation"
+// passes (forward and reverse) and log2buffer(). Like the decoding versions
+// in unpack_simd.c, they are written with compiler intrinsics and are built
+// into every x86-64 binary, with the selection made at runtime by the
+// init_dispatch() functions in extra1.c and extra2.c.
+//
+// The results are identical to the versions they replace. For the passes,
+// each residual updates the weight used for the next sample, so there is no
+// way to work on more than one sample at a time; the vectors hold the two
+// stereo channels (as the MMX assembly versions do) and AVX2 provides the
+// 64-bit multiplies and three-operand forms. There are no mono versions for
+// the same reason (a single channel would leave nothing for the vectors to
+// do). The log2 values on the other hand are independent, so log2buffer_avx2()
+// does eight samples at a time, finding the magnitude, the log2 and the sum
+// in a single sweep.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavpack_local.h"
+
+#ifdef OPT_SIMD_X64
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// The stereo samples and weights are held with the left channel in the low 32 bits of
+// the first 64-bit lane and the right channel in the low 32 bits of the second 64-bit
+// lane so that _mm_mul_epi32() can generate the full 64-bit products (exactly as in
+// unpack_simd.c). The upper halves of the lanes are ignored.
+
+#define LOAD_STEREO(ptr) _mm_shuffle_epi32 (_mm_loadl_epi64 ((const __m128i *)(ptr)), 0x50)
+#define STORE_STEREO(ptr,v) _mm_storel_epi64 ((__m128i *)(ptr), _mm_shuffle_epi32 ((v), 0x08))
+#define SWAP_STEREO(v) _mm_shuffle_epi32 ((v), 0x4e)
+
+// Perform a single pass of stereo decorrelation from the input buffer to the output buffer
+// in the specified direction (2 for forward, -2 for reverse). Like the assembly versions,
+// this requires that the up to 8 previous stereo samples (depending on the term, and in
+// the direction of travel) are visible and correct in the input buffer, and it returns
+// the weights, the weight sums and the normalized history samples to the decorr_pass.
+
+static void TARGET_AVX2 decorr_stereo_pass_cont_avx2 (struct decorr_pass *dpp, int32_t *in_buffer, int32_t *out_buffer, int32_t sample_count, int dir)
+{
+    __m128i weight, sum, delta, round, zero, limit, sam, input, output, sign, skip;
+    int32_t *bptr = in_buffer, *eptr = in_buffer + sample_count * dir;
+    intptr_t offset = out_buffer - in_buffer;
+    int term = dpp->term, k;
+
+    if (sample_count <= 0)
+        return;
+
+    weight = _mm_set_epi32 (0, dpp->weight_B, 0, dpp->weight_A);
+    sum = _mm_set_epi32 (0, dpp->sum_B, 0, dpp->sum_A);
+    delta = _mm_set1_epi32 (dpp->delta);
+    round = _mm_set1_epi64x (512);
+    limit = _mm_set1_epi32 (1024);
+    zero = _mm_setzero_si128 ();
+
+    for (; bptr != eptr; bptr += dir) {
+        input = LOAD_STEREO (bptr);
+
+        // in the encoder all the history samples are input samples, so even the cross-channel
+        // terms are available here (unlike when decoding)
+
+        if (term > MAX_TERM) {
+            __m128i sam1 = LOAD_STEREO (bptr - dir), sam2 = LOAD_STEREO (bptr - dir * 2);
+
+            if (term & 1)
+                sam = _mm_sub_epi32 (_mm_add_epi32 (sam1, sam1), sam2);
+            else
+                sam = _mm_add_epi32 (sam1, _mm_srai_epi32 (_mm_sub_epi32 (sam1, sam2), 1));
+        }
+        else if (term > 0)
+            sam = LOAD_STEREO (bptr - dir * term);
+        else if (term == -1)
+            sam = _mm_blend_epi32 (SWAP_STEREO (LOAD_STEREO (bptr - dir)), SWAP_STEREO (input), 0xc);
+        else if (term == -2)
+            sam = _mm_blend_epi32 (SWAP_STEREO (input), SWAP_STEREO (LOAD_STEREO (bptr - dir)), 0xc);
+        else
+            sam = SWAP_STEREO (LOAD_STEREO (bptr - dir));
+
+        output = _mm_sub_epi32 (input, _mm_srli_epi64 (_mm_add_epi64 (_mm_mul_epi32 (sam, weight), round), 10));
+        STORE_STEREO (bptr + offset, output);
+
+        // update_weight() (or update_weight_clip() for the negative terms) for both channels
+
+        sign = _mm_srai_epi32 (_mm_xor_si128 (sam, output), 31);
+        skip = _mm_or_si128 (_mm_cmpeq_epi32 (sam, zero), _mm_cmpeq_epi32 (output, zero));
+
+        if (term > 0)
+            weight = _mm_add_epi32 (weight, _mm_sub_epi32 (_mm_xor_si128 (_mm_andnot_si128 (skip, delta), sign), sign));
+        else
+            weight = _mm_blendv_epi8 (_mm_blendv_epi8 (_mm_min_epi32 (_mm_add_epi32 (weight, delta), limit),
+                _mm_max_epi32 (_mm_sub_epi32 (weight, delta), _mm_sub_epi32 (zero, limit)), sign), weight, skip);
+
+        sum = _mm_add_epi32 (sum, weight);
+    }
+
+    dpp->weight_A = _mm_cvtsi128_si32 (weight);
+    dpp->weight_B = _mm_extract_epi32 (weight, 2);
+    dpp->sum_A = _mm_cvtsi128_si32 (sum);
+    dpp->sum_B = _mm_extract_epi32 (sum, 2);
+
+    // eptr is now one sample past the last one processed (in the direction of travel)
+
+    if (term > MAX_TERM) {
+        dpp->samples_A [0] = eptr [-dir];
+        dpp->samples_B [0] = eptr [-dir + 1];
+        dpp->samples_A [1] = eptr [-dir * 2];
+        dpp->samples_B [1] = eptr [-dir * 2 + 1];
+    }
+    else if (term > 0)
+        for (k = 0; k < term; ++k) {
+            dpp->samples_A [k] = eptr [(k - term) * dir];
+            dpp->samples_B [k] = eptr [(k - term) * dir + 1];
+        }
+    else {
+        if (term != -2)
+            dpp->samples_A [0] = eptr [-dir + 1];
+
+        if (term != -1)
+            dpp->samples_B [0] = eptr [-dir];
+    }
+}
+
+void ASMCALL TARGET_AVX2 pack_decorr_stereo_pass_cont_avx2 (struct decorr_pass *dpp, int32_t *in_buffer, int32_t *out_buffer, int32_t sample_count)
+{
+    decorr_stereo_pass_cont_avx2 (dpp, in_buffer, out_buffer, sample_count, 2);
+}
+
+void ASMCALL TARGET_AVX2 pack_decorr_stereo_pass_cont_rev_avx2 (struct decorr_pass *dpp, int32_t *in_buffer, int32_t *out_buffer, int32_t sample_count)
+{
+    decorr_stereo_pass_cont_avx2 (dpp, in_buffer, out_buffer, sample_count, -2);
+}
+
+// Scan a buffer of samples and return the total log2 value (in the same format as wp_log2()),
+// or -1 if the limit is specified and is reached. The number of bits in each magnitude is
+// found by converting to floating-point (which can round up into the next power of two, so
+// that's checked), and then the 8 bits below the MSB index the fraction table (log2_table,
+// which is padded so that it can be read as 32-bit words with _mm256_i32gather_epi32()).
+
+uint32_t ASMCALL TARGET_AVX2 log2buffer_avx2 (int32_t *samples, uint32_t num_samples, int limit)
+{
+    __m256i one = _mm256_set1_epi32 (1), nine = _mm256_set1_epi32 (9), mask = _mm256_set1_epi32 (0xff);
+    __m256i zero = _mm256_setzero_si256 (), sum = zero, over = zero;
+    uint32_t result;
+    int threshold;
+
+    // the assembly versions compare every sample to the limit, but the C version only compares
+    // values of 256 or more (i.e., with a log2 of at least 9 << 8), and we must match whichever
+    // one we're replacing or the output would depend on the CPU
+
+#if defined(OPT_ASM_X86) || defined(OPT_ASM_X64)
+    threshold = limit ? limit - 1 : 0x7fffffff;
+#else
+    threshold = limit ? (limit > (9 << 8) ? limit : (9 << 8)) - 1 : 0x7fffffff;
+#endif
+
+    for (; num_samples >= 8; num_samples -= 8, samples += 8) {
+        __m256i avalue = _mm256_abs_epi32 (_mm256_loadu_si256 ((const __m256i *) samples)), half, dbits, fraction, value;
+
+        avalue = _mm256_add_epi32 (avalue, _mm256_srli_epi32 (avalue, 9));
+        half = _mm256_srli_epi32 (avalue, 1);      // so that the conversion is never negative
+
+        // the exponent of the converted half is one less than the bits in avalue, unless it rounded up
+
+        dbits = _mm256_sub_epi32 (_mm256_srli_epi32 (_mm256_castps_si256 (_mm256_cvtepi32_ps (half)), 23), _mm256_set1_epi32 (125));
+        dbits = _mm256_add_epi32 (dbits, _mm256_cmpeq_epi32 (_mm256_srlv_epi32 (avalue, _mm256_sub_epi32 (dbits, one)), zero));
+        dbits = _mm256_blendv_epi8 (dbits, avalue, _mm256_cmpeq_epi32 (half, zero));     // avalue is 0 or 1
+
+        // one of these shifts is out of range (giving zero) unless dbits is 9, when both give avalue
+
+        fraction = _mm256_or_si256 (_mm256_srlv_epi32 (avalue, _mm256_sub_epi32 (dbits, nine)),
+            _mm256_sllv_epi32 (avalue, _mm256_sub_epi32 (nine, dbits)));
+
+        value = _mm256_i32gather_epi32 ((const int *) log2_table, _mm256_and_si256 (fraction, mask), 1);
+        value = _mm256_add_epi32 (_mm256_slli_epi32 (dbits, 8), _mm256_and_si256 (value, mask));
+        over = _mm256_or_si256 (over, _mm256_cmpgt_epi32 (value, _mm256_set1_epi32 (threshold)));
+        sum = _mm256_add_epi32 (sum, value);
+    }
+
+    if (!_mm256_testz_si256 (over, over))
+        return (uint32_t) -1;
+
+    sum = _mm256_add_epi32 (sum, _mm256_permute2x128_si256 (sum, sum, 1));
+    sum = _mm256_add_epi32 (sum, _mm256_shuffle_epi32 (sum, 0x4e));
+    sum = _mm256_add_epi32 (sum, _mm256_shuffle_epi32 (sum, 0xb1));
+    result = _mm_cvtsi128_si32 (_mm256_castsi256_si128 (sum));
+
+    while (num_samples--) {
+        int value = wp_log2 (abs (*samples++));
+
+        result += value;
+
+        if (value > threshold)
+            return (uint32_t) -1;
+    }
+
+    return result;
+}
+
+#endif
@@ -26,6 +26,7 @@ static void worker_threads_create (WavpackContext *wpc);
 static void pack_samples_enqueue (WavpackStream *wps, int free_wps);
 static int write_completed_blocks (WavpackContext *wpc, int write_all_blocks, int result);
 static int worker_available (WavpackContext *wpc);
+static void pack_stream_job (WorkerInfo *cxt, StreamJob *job);
 #endif
 
 ///////////////////////////// executable code ////////////////////////////////
@@ -45,6 +46,9 @@ WavpackContext *WavpackOpenFileOutput (WavpackBlockOutput blockout, void *wv_id,
         return NULL;
 
     CLEAR (*wpc);
+#ifdef ENABLE_THREADS
+    wp_mutex_init (wpc->reader_mutex);
+#endif
     wpc->total_samples = -1;
     wpc->stream_version = CUR_STREAM_VERS;
     wpc->blockout = blockout;
@@ -106,6 +110,9 @@ void WavpackSetFileInformation (WavpackContext *wpc, char *file_extension, unsig
 // o CONFIG_SKIP_WVX            no wvx stream for floats & large ints
 // o CONFIG_MD5_CHECKSUM        specify if you plan to store MD5 signature
 // o CONFIG_CREATE_EXE          specify if you plan to prepend sfx module
+// o CONFIG_SEEK_TABLE          reserve a seek table in the first block (this
+//                               is filled in by WavpackUpdateNumSamples(), so
+//                               the first block must be rewritten)
 // o CONFIG_OPTIMIZE_MONO       detect and optimize for mono files posing as
 //                               stereo (uses a more recent stream format that
 //                               is not compatible with decoders < 4.3)
@@ -250,7 +257,7 @@ int WavpackSetConfiguration64 (WavpackContext *wpc, WavpackConfig *config, int64
         }
 
         // with DSD, very few PCM options work (or make sense), so only allow those that do
-        config->flags &= (CONFIG_HIGH_FLAG | CONFIG_MD5_CHECKSUM | CONFIG_PAIR_UNDEF_CHANS);
+        config->flags &= (CONFIG_HIGH_FLAG | CONFIG_MD5_CHECKSUM | CONFIG_PAIR_UNDEF_CHANS | CONFIG_SEEK_TABLE);
         config->float_norm_exp = config->xmode = 0;
 #else
         strcpy (wpc->error_message, "WavPack library not built with DSD file support!");
@@ -554,6 +561,11 @@ int WavpackPackInit (WavpackContext *wpc)
     if (wpc->metabytes > 16384)             // 16384 bytes still leaves plenty of room for audio
         write_metadata_block (wpc);         //  in this block (otherwise write a special one)
 
+    if (wpc->config.flags & CONFIG_EXTRA_MODE) {
+        extra_mono_init_dispatch ();        // select the best search functions for this CPU
+        extra_stereo_init_dispatch ();      //  (first time only)
+    }
+
 #ifdef ENABLE_THREADS
     // if multithreading is enabled and requested, configure and start the workers here
 
@@ -564,25 +576,8 @@ int WavpackPackInit (WavpackContext *wpc)
         else
             wpc->num_workers = wpc->config.worker_threads;
 
-        if (wpc->num_workers > 15)
-            wpc->num_workers = 15;
-
-        // FIXME: There are some situations where the number of samples in a block is truncated during the packing
-        // of the first stream. This can be either because of dynamic noise shaping used with correction files or with
-        // the "merge blocks" feature. Since this would not work with multithreaded compression, we'll prohibit that
-        // for now, but in the future a better solution would be to simply calculate the truncation before starting
-        // the compression threads.
-
-        if (!(wpc->streams [0]->wphdr.flags & FLOAT_DATA) && wpc->config.bytes_per_sample <= 3)
-            if ((wpc->wvc_flag && (wpc->config.flags & CONFIG_DYNAMIC_SHAPING) && !wpc->config.block_samples) ||
-                wpc->config.flags & CONFIG_MERGE_BLOCKS)
-                    wpc->num_workers = 0;
-
-        // Because of noise-shaping discontinuities between blocks and complications in measuring quantization noise,
-        // we don't allow temporal multithreading in hybrid mode. In the future we might be able to loosen this up some.
-
-        if (wpc->num_workers && wpc->num_streams == 1 && (wpc->streams [0]->wphdr.flags & HYBRID_FLAG))
-            wpc->num_workers = 0;
+        if (wpc->num_workers > (wpc->num_streams > 1 ? OPEN_THREADS_MAX : MAX_TEMPORAL_WORKERS))
+            wpc->num_workers = wpc->num_streams > 1 ? OPEN_THREADS_MAX : MAX_TEMPORAL_WORKERS;
 
         // DSD "high" mode performs much better with discontinuities if it has some "pre samples" to chew on first.
         // DSD "fast" mode doesn't care about discontinuities, and the PCM modes do a pack_init() to deal with them.
@@ -641,6 +636,18 @@ int WavpackPackInit (WavpackContext *wpc)
     wpc->ave_block_samples = wpc->block_samples;
     wpc->max_samples = wpc->block_samples + (wpc->block_samples >> 1);
 
+    // If a seek table was requested, reserve an entry for every block if the length is known (and
+    // the maximum otherwise). If more blocks than this are written, the interval is simply larger.
+
+    if (wpc->config.flags & CONFIG_SEEK_TABLE) {
+        int64_t num_blocks = SEEK_TABLE_MAX_ENTRIES;
+
+        if (wpc->total_samples != -1)
+            num_blocks = (wpc->total_samples + wpc->block_samples - 1) / wpc->block_samples;
+
+        wpc->seek_table_entries = num_blocks < SEEK_TABLE_MAX_ENTRIES ? (uint32_t) num_blocks : SEEK_TABLE_MAX_ENTRIES;
+    }
+
     for (stream_index = 0; stream_index < wpc->num_streams; stream_index++) {
         WavpackStream *wps = wpc->streams [stream_index];
 
@@ -1047,6 +1054,17 @@ static int write_stream_block (WavpackStream *wps, int result)
     WavpackContext *wpc = (WavpackContext *) wps->wpc;  // safe because this is called single-threaded
     int bcount;
 
+    // if we're writing a seek table, record where the initial blocks go (before the header is converted)
+
+    if (result && wpc->seek_table_entries && (((WavpackHeader *) wps->blockbuff)->flags & INITIAL_BLOCK)) {
+        WavpackHeader *wphdr = (WavpackHeader *) wps->blockbuff;
+
+        block_index_add (&wpc->wv_index, GET_BLOCK_INDEX (*wphdr), wpc->filelen, wphdr->block_samples);
+
+        if (wps->block2buff)
+            block_index_add (&wpc->wvc_index, GET_BLOCK_INDEX (*wphdr), wpc->file2len, wphdr->block_samples);
+    }
+
     if (result) {
         bcount = ((WavpackHeader *) wps->blockbuff)->ckSize + 8;
         WavpackNativeToLittleEndian ((WavpackHeader *) wps->blockbuff, WavpackHeaderFormat);
@@ -1125,6 +1143,10 @@ static int pack_streams (WavpackContext *wpc, uint32_t block_samples, int last_b
         max_blocksize += max_blocksize >> 2;    // otherwise 25% margin for everything else
 
     max_blocksize += wpc->metabytes + 1024;     // finally, add metadata & another 1K margin
+
+    if (wpc->seek_table_entries && !wpc->streams [0]->sample_index)
+        max_blocksize += SEEK_TABLE_HEADER_BYTES + wpc->seek_table_entries * SEEK_TABLE_ENTRY_BYTES (SEEK_TABLE_WVC);
+
     max_blocksize += max_blocksize & 1;         // and make sure it's even so we detect overflow
 
     for (stream_index = 0; result && stream_index < wpc->num_streams; stream_index++) {
@@ -1142,15 +1164,23 @@ static int pack_streams (WavpackContext *wpc, uint32_t block_samples, int last_b
         wps->blockbuff = malloc (max_blocksize);
         wps->blockend = wps->blockbuff + max_blocksize;
 
+        // The --merge-blocks feature can shorten the block of the first stream (and so of all the
+        // streams) to where the redundancy changes. This is determined here, before any packing is
+        // started, so that multithreading knows the block length (and where the next block starts).
+
+        if (!stream_index && wpc->block_boundary && pack_block_merge (wps))
+            block_samples = wps->wphdr.block_samples;
+
 #ifdef ENABLE_THREADS
-        // If there is a worker thread available, and we're not doing the final stream (which
-        // implies we're doing multichannel) then we can start packing this stream on a worker
-        // thread. In this case we pass the WavpackStream structure directly (i.e., not a copy).
+        // If there are worker threads and we're doing multichannel, then add this stream to the
+        // jobs for this block, which are run by the workers (and this thread) once all the streams
+        // are set up (see run_stream_jobs()). The blocks are then written in order below.
 
-        if (worker_available (wpc) && stream_index < wpc->num_streams - 1) {
-            result = write_completed_blocks (wpc, FALSE, result);
-            pack_samples_enqueue (wps, FALSE);
-        }
+        if (wpc->workers && wpc->num_streams > 1 && !stream_index && pack_block_shaping (wps))
+            block_samples = wps->wphdr.block_samples;
+
+        if (wpc->workers && wpc->num_streams > 1 && add_stream_job (wpc, wps, NULL, NULL, 0, 0))
+            continue;
 
         // If there is a worker available and we're doing a single stream (i.e., mono or stereo) and
         // it's not the very first block (which might have metadata which needs to be sent unthreaded)
@@ -1163,7 +1193,10 @@ static int pack_streams (WavpackContext *wpc, uint32_t block_samples, int last_b
 
         else if (worker_available (wpc) && wpc->num_streams == 1 && wps->sample_index && !last_block) {
             WavpackStream *wps_copy = malloc (sizeof (WavpackStream));
+            int shaping_done = pack_block_shaping (wps);
 
+            // the dynamic noise shaping (if any) might have shortened this block
+            block_samples = wps->wphdr.block_samples;
             memcpy (wps_copy, wps, sizeof (WavpackStream));
 
             // If there is a discontinuity (i.e., the previous block is not done, so we can't get any
@@ -1174,6 +1207,34 @@ static int pack_streams (WavpackContext *wpc, uint32_t block_samples, int last_b
             if (wps->discontinuous)
                 pack_init (wps_copy);
 
+            // The copy gets its own dynamic noise shaping profile for just this block, and the rest
+            // stays here for the next block. Likewise, the copy starts a fresh noise measurement that
+            // is added back into ours when the block is written (see write_completed_blocks()).
+
+            if (wps->dc.shaping_data) {
+                wps_copy->dc.shaping_data = malloc (wpc->max_samples * sizeof (*wps->dc.shaping_data));
+
+                if (shaping_done) {
+                    memcpy (wps_copy->dc.shaping_data, wps->dc.shaping_data, block_samples * sizeof (*wps->dc.shaping_data));
+                    wps_copy->dc.shaping_array = wps->dc.shaping_array ? wps_copy->dc.shaping_data : NULL;
+                    memcpy (wps_copy->dc.shaping_acc, wps->dc.shaping_acc, sizeof (wps->dc.shaping_acc));
+                    memcpy (wps_copy->dc.shaping_delta, wps->dc.shaping_delta, sizeof (wps->dc.shaping_delta));
+                    wps_copy->dc.shaping_samples = block_samples;
+                    wps_copy->dc.shaping_done = TRUE;
+
+                    if (wps->dc.shaping_samples > (int32_t) block_samples)
+                        memmove (wps->dc.shaping_data, wps->dc.shaping_data + block_samples,
+                            (wps->dc.shaping_samples - block_samples) * sizeof (*wps->dc.shaping_data));
+
+                    wps->dc.shaping_samples -= block_samples;
+                    wps->dc.shaping_done = FALSE;
+                }
+                else
+                    wps_copy->dc.shaping_samples = 0;
+            }
+
+            wps_copy->dc.noise_sum = wps_copy->dc.noise_max = 0.0;
+
             wps_copy->sample_buffer = malloc (block_samples * (wps->wphdr.flags & MONO_FLAG ? 4 : 8));
             memcpy (wps_copy->sample_buffer, wps->sample_buffer, block_samples * (wps->wphdr.flags & MONO_FLAG ? 4 : 8));
 
@@ -1211,7 +1272,15 @@ static int pack_streams (WavpackContext *wpc, uint32_t block_samples, int last_b
             if (wps->discontinuous)
                 pack_init (wps);
 
+#ifdef ENABLE_THREADS
+            // we're packing this block ourselves, so the extra modes can hand parts of their
+            // search to any workers that are idle (e.g., at the start or with no temporal jobs)
+            wps->parallel_search = wpc->workers != NULL;
+            result = pack_stream_block (wps);
+            wps->parallel_search = FALSE;
+#else
             result = pack_stream_block (wps);
+#endif
 
             if (wps->wphdr.block_samples != block_samples)
                 block_samples = wps->wphdr.block_samples;
@@ -1258,9 +1327,34 @@ static int pack_streams (WavpackContext *wpc, uint32_t block_samples, int last_b
     }
 
 #ifdef ENABLE_THREADS
+    // For multichannel, pack all the streams queued above and then write their blocks in order
+
+    if (wpc->num_stream_jobs) {
+        run_stream_jobs (wpc, pack_stream_job, NULL, 0);
+
+        for (i = 0; i < wpc->num_stream_jobs; ++i) {
+            WavpackStream *wps = wpc->stream_jobs [i].wps;
+
+            if (result && !wpc->stream_jobs [i].result) {
+                strcpy (wpc->error_message, "output buffer overflowed!");
+                result = FALSE;
+            }
+
+            if (wps->decorr_passes [0].term)
+                wps->delta_decay = (float)((wps->delta_decay * 2.0 + wps->decorr_passes [0].delta) / 3.0);
+
+            if (wps->wphdr.block_samples != block_samples)
+                block_samples = wps->wphdr.block_samples;
+
+            wpc->lossy_blocks |= wps->lossy_blocks;
+            result = write_stream_block (wps, result);
+        }
+
+        wpc->num_stream_jobs = 0;
+    }
+
     // All background blocks must be complete and sent before we return if this is the last
-    // block of the WavpackPackSamples() call (or an error occurred). Of course, for
-    // multichannel audio, this was already done above before we sent the last stream.
+    // block of the WavpackPackSamples() call (or an error occurred).
 
     if (wpc->num_workers && (last_block || !result))
         result = write_completed_blocks (wpc, TRUE, result);
@@ -1288,12 +1382,18 @@ static int pack_streams (WavpackContext *wpc, uint32_t block_samples, int last_b
 // be done if WavpackSetConfiguration() was called with an incorrect number
 // of samples (or -1). It is the responsibility of the application to read and
 // rewrite the block. An example of this can be found in the Audition filter.
+// If CONFIG_SEEK_TABLE was specified, then the seek table is filled in here,
+// so in that case the first block should be rewritten even if the number of
+// samples was correct (this is not required for the .wvc file).
 
 static void block_update_checksum (unsigned char *buffer_start);
+static void update_seek_table (WavpackContext *wpc, unsigned char *table, uint32_t size);
+static void *find_metadata (void *wavpack_block, int desired_id, uint32_t *size);
 
 void WavpackUpdateNumSamples (WavpackContext *wpc, void *first_block)
 {
-    uint32_t wrapper_size;
+    uint32_t wrapper_size, table_size;
+    unsigned char *table;
 
     if (wpc->riff_header_created && WavpackGetWrapperLocation (first_block, &wrapper_size)) {
         unsigned char riff_header [128];
@@ -1304,6 +1404,10 @@ void WavpackUpdateNumSamples (WavpackContext *wpc, void *first_block)
 
     WavpackLittleEndianToNative (first_block, WavpackHeaderFormat);
     SET_TOTAL_SAMPLES (* (WavpackHeader *) first_block, WavpackGetSampleIndex64 (wpc));
+
+    if (wpc->seek_table_entries && (table = find_metadata (first_block, ID_SEEK_TABLE, &table_size)))
+        update_seek_table (wpc, table, table_size);
+
     block_update_checksum (first_block);
     WavpackNativeToLittleEndian (first_block, WavpackHeaderFormat);
 }
@@ -1325,8 +1429,6 @@ void WavpackUpdateNumSamples (WavpackContext *wpc, void *first_block)
 // responsibility of the application to read and rewrite the block. An example
 // of this can be found in the Audition filter.
 
-static void *find_metadata (void *wavpack_block, int desired_id, uint32_t *size);
-
 void *WavpackGetWrapperLocation (void *first_block, uint32_t *size)
 {
     void *loc;
@@ -1342,6 +1444,70 @@ void *WavpackGetWrapperLocation (void *first_block, uint32_t *size)
     return loc;
 }
 
+// Fill in the seek table reserved in the first block from the initial blocks actually written (which
+// were recorded in the block indexes by write_stream_block()). The interval is chosen so that the
+// entries reserved cover the whole file, and the block containing each multiple of the interval is
+// stored (see wavpack_local.h for the format). If the blocks recorded for the .wv and .wvc files
+// don't match up, then the table is left empty (which decoders will ignore).
+
+static unsigned char *store_le_bytes (unsigned char *dp, int64_t value, int bytes)
+{
+    while (bytes--) {
+        *dp++ = (unsigned char) value;
+        value >>= 8;
+    }
+
+    return dp;
+}
+
+static void update_seek_table (WavpackContext *wpc, unsigned char *table, uint32_t size)
+{
+    int64_t total_samples = WavpackGetSampleIndex64 (wpc), target = 0;
+    BlockIndex *index = &wpc->wv_index, *index2 = &wpc->wvc_index;
+    uint32_t max_entries, num_entries = 0, interval;
+    unsigned char *dp;
+    int i;
+
+    if (size < SEEK_TABLE_HEADER_BYTES || !index->count || total_samples <= 0)
+        return;
+
+    if ((table [0] & SEEK_TABLE_WVC) && index2->count != index->count)
+        return;
+
+    max_entries = (size - SEEK_TABLE_HEADER_BYTES) / SEEK_TABLE_ENTRY_BYTES (table [0]);
+
+    if (!max_entries)
+        return;
+
+    interval = (uint32_t) ((total_samples + max_entries - 1) / max_entries);
+    dp = table + SEEK_TABLE_HEADER_BYTES;
+
+    for (i = 0; i < index->count && num_entries < max_entries; ++i) {
+        BlockIndexEntry *entry = index->entries + i;
+
+        if (target >= entry->block_index + entry->block_samples)
+            continue;
+
+        if ((table [0] & SEEK_TABLE_WVC) && index2->entries [i].block_index != entry->block_index)
+            return;
+
+        dp = store_le_bytes (dp, entry->block_index, 8);
+        dp = store_le_bytes (dp, entry->block_samples, 4);
+        dp = store_le_bytes (dp, entry->file_pos, 8);
+
+        if (table [0] & SEEK_TABLE_WVC)
+            dp = store_le_bytes (dp, index2->entries [i].file_pos, 8);
+
+        while (target < entry->block_index + entry->block_samples)
+            target += interval;
+
+        num_entries++;
+    }
+
+    store_le_bytes (table + 2, interval, 4);
+    store_le_bytes (table + 6, num_entries, 4);
+}
+
 static void *find_metadata (void *wavpack_block, int desired_id, uint32_t *size)
 {
     WavpackHeader *wphdr = wavpack_block;
@@ -1695,9 +1861,24 @@ static void block_update_checksum (unsigned char *buffer_start)
 
 #ifdef ENABLE_THREADS
 
-// This is the worker thread function for packing support, essentially allowing
+// This is the job performed by the workers for packing support, essentially allowing
 // pack_stream_block() to be running for multiple streams simultaneously.
 
+static void pack_samples_job (WorkerInfo *cxt)
+{
+    cxt->result = pack_stream_block (cxt->wps);
+}
+
+// This is the job function for packing one stream of a multichannel block (see run_stream_jobs())
+
+static void pack_stream_job (WorkerInfo *cxt, StreamJob *job)
+{
+    (void) cxt;
+    job->result = pack_stream_block (job->wps);
+}
+
+// This is the worker thread function for packing support (when the context has its own threads)
+
 #ifdef _WIN32
 static unsigned WINAPI pack_samples_worker_thread (LPVOID param)
 #else
@@ -1720,19 +1901,21 @@ static void *pack_samples_worker_thread (void *param)
         if (cxt->state == Quit)                     // break out if we're done
             break;
 
-        cxt->result = pack_stream_block (cxt->wps); // this is where the work is done
+        cxt->job (cxt);                             // this is where the work is done
 
-        wp_mutex_obtain (*cxt->mutex);
-        cxt->state = Done;
-        wp_condvar_signal (*cxt->global_cond);      // signal completion
+        if (cxt->done_state == Done) {              // stream jobs just go back to ready
+            wp_mutex_obtain (*cxt->mutex);
+            cxt->state = Done;
+            wp_condvar_signal (*cxt->global_cond);  // signal completion
 
-        while (cxt->state == Done)                  // wait for output to be written
-            wp_condvar_wait (cxt->worker_cond, *cxt->mutex);
+            while (cxt->state == Done)              // wait for output to be written
+                wp_condvar_wait (cxt->worker_cond, *cxt->mutex);
 
-        wp_mutex_release (*cxt->mutex);
+            wp_mutex_release (*cxt->mutex);
 
-        if (cxt->state == Quit)                     // should check for quit here too
-            break;
+            if (cxt->state == Quit)                 // should check for quit here too
+                break;
+        }
     }
 
     wp_thread_exit (0);
@@ -1759,7 +1942,14 @@ static void pack_samples_enqueue (WavpackStream *wps, int free_wps)
             wpc->workers [i].wps = wps;
             wpc->workers [i].state = Running;
             wpc->workers [i].free_wps = free_wps;
-            wp_condvar_signal (wpc->workers [i].worker_cond);
+            wpc->workers [i].job = pack_samples_job;
+            wpc->workers [i].done_state = Done;
+
+            if (wpc->thread_pool)
+                thread_pool_submit (wpc->thread_pool, &wpc->workers [i]);
+            else
+                wp_condvar_signal (wpc->workers [i].worker_cond);
+
             wpc->workers_ready--;
             break;
         }
@@ -1813,6 +2003,12 @@ static int write_completed_blocks (WavpackContext *wpc, int write_all_blocks, in
             result = write_stream_block (next_worker->wps, result);
 
             if (next_worker->free_wps) {
+                parent->dc.noise_sum += next_worker->wps->dc.noise_sum;
+
+                if (next_worker->wps->dc.noise_max > parent->dc.noise_max)
+                    parent->dc.noise_max = next_worker->wps->dc.noise_max;
+
+                free (next_worker->wps->dc.shaping_data);
                 free (next_worker->wps->pre_sample_buffer);
                 free (next_worker->wps->sample_buffer);
                 free (next_worker->wps->dsd.ptable);
@@ -1820,8 +2016,15 @@ static int write_completed_blocks (WavpackContext *wpc, int write_all_blocks, in
             }
 
             wp_mutex_obtain (wpc->mutex);
-            next_worker->state = Uninit;
-            wp_condvar_signal (next_worker->worker_cond);   // signal the thread so it can go ready
+
+            if (wpc->thread_pool) {                         // pooled workers have no thread, so
+                next_worker->state = Ready;                 //  we make them ready here
+                wpc->workers_ready++;
+            }
+            else {
+                next_worker->state = Uninit;
+                wp_condvar_signal (next_worker->worker_cond);   // signal the thread so it can go ready
+            }
         }
         else
             wp_condvar_wait (wpc->global_cond, wpc->mutex);
@@ -1832,8 +2035,9 @@ static int write_completed_blocks (WavpackContext *wpc, int write_all_blocks, in
     return result;
 }
 
-// Create the worker thread contexts and start the threads
-// (which should all quickly go to the ready state)
+// Create the worker thread contexts and start the threads (which should all quickly go
+// to the ready state). If a shared thread pool is installed, the workers are simply
+// marked ready and their jobs are run by the pool's threads instead.
 
 static void worker_threads_create (WavpackContext *wpc)
 {
@@ -1844,12 +2048,23 @@ static void worker_threads_create (WavpackContext *wpc)
         wp_condvar_init (wpc->global_cond);
 
         wpc->workers = calloc (wpc->num_workers, sizeof (WorkerInfo));
+        wpc->thread_pool = thread_pool_attach ();
 
         for (i = 0; i < wpc->num_workers; ++i) {
             wpc->workers [i].mutex = &wpc->mutex;
             wpc->workers [i].global_cond = &wpc->global_cond;
             wpc->workers [i].workers_ready = &wpc->workers_ready;
+            wpc->workers [i].worker_errors = &wpc->worker_errors;
+            wpc->workers [i].wpc = wpc;
+            wpc->workers [i].index = i;
             wp_condvar_init (wpc->workers [i].worker_cond);
+
+            if (wpc->thread_pool) {
+                wpc->workers [i].state = Ready;
+                wpc->workers_ready++;
+                continue;
+            }
+
             wp_thread_create (wpc->workers [i].thread, pack_samples_worker_thread, &wpc->workers [i]);
 
             // gracefully handle failures in creating worker threads
@@ -48,6 +48,7 @@ extern __inline uint32_t _bsf_watcom (uint32_t);
 #endif
 
 #define USE_BITMASK_TABLES      // use tables instead of shifting for certain masking operations
+#define USE_LOOKUP_DECODER      // decode common lossless words with a table & a 64-bit bit reservoir
 
 ///////////////////////////// local table storage ////////////////////////////
 
@@ -64,6 +65,51 @@ static const char ones_count_table [] = {
 };
 #endif
 
+#ifdef USE_LOOKUP_DECODER
+
+// This table is indexed with the "holding_one" state in bit 8 and the next 8 bits of the
+// bitstream in bits 0-7. Each entry contains the total number of bits used by the unary
+// ones count (including the terminating zero) in bits 0-3, the new "holding_one" state in
+// bit 4, and the resulting median bucket (i.e., "ones_count") in bits 5-7. An entry of zero
+// indicates that there are 8 or more ones and the regular decoder must be used.
+
+static const unsigned char lookup_decode_table [] = {
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x45,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x56,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x45,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x67,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x45,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x56,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x45,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x78,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x45,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x56,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x45,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x67,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x45,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x56,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x45,
+    0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x34,0x01,0x12,0x01,0x23,0x01,0x12,0x01,0x00,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x65,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x76,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x65,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x87,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x65,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x76,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x65,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x98,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x65,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x76,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x65,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x87,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x65,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x76,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x65,
+    0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x54,0x21,0x32,0x21,0x43,0x21,0x32,0x21,0x00
+};
+
+#endif
+
 ///////////////////////////// executable code ////////////////////////////////
 
 static uint32_t __inline read_code (Bitstream *bs, uint32_t maxcode);
@@ -334,6 +380,146 @@ int32_t FASTCALL get_word (WavpackStream *wps, int chan, int32_t *correction)
     return sign ? ~mid : mid;
 }
 
+#ifdef USE_LOOKUP_DECODER
+
+// This is the fast path for get_words_lossless(). The bits are loaded into a local 64-bit
+// reservoir which is refilled once per sample (so that no further checks are needed), the
+// unary ones count and the resulting median bucket are obtained with a single probe of the
+// lookup_decode_table[], and the remainder code and sign bit are taken directly from the
+// reservoir. Decoding continues until the requested number of samples is reached or until
+// a sample is encountered that this can't handle (a run of zeros, 8 or more ones, or too
+// close to the end of the buffer). This always stops at a sample boundary, and the bitstream
+// is returned to the same state the regular decoder would have left it in. The index of the
+// next sample to decode is returned.
+
+#define RESERVOIR_MIN_BITS 41   // max bits for one sample: 8 unary + 32 code + 1 sign
+
+static int32_t get_words_lookup (WavpackStream *wps, int32_t *buffer, int32_t csamples, int32_t nsamples)
+{
+    int word_bits = sizeof (*(wps->wvbits.ptr)) * 8, stereo = !(wps->wphdr.flags & MONO_DATA);
+    Bitstream *bs = &wps->wvbits;
+    struct entropy_data *c;
+    uint32_t low, high, code, maxcode;
+    uint64_t reservoir;
+    int bc, bitcount;
+
+    // we need enough data so that the refill below will never reach the end of the buffer
+
+    if (bs->end - bs->ptr <= (64 / word_bits) + 1)
+        return csamples;
+
+    reservoir = bs->sr;
+    bc = bs->bc;
+
+    for (; csamples < nsamples; ++csamples) {
+        c = wps->w.c + (stereo ? (csamples & 1) : 0);
+
+        if (bs->end - bs->ptr <= (64 / word_bits) + 1)
+            break;
+
+        while (bc <= 64 - word_bits) {
+            reservoir |= (uint64_t) *++(bs->ptr) << bc;
+            bc += word_bits;
+        }
+
+        if (wps->w.holding_zero) {
+            wps->w.holding_zero = 0;
+            low = 0;
+            high = GET_MED (0) - 1;
+            DEC_MED0 ();
+        }
+        else {
+            int entry;
+
+            if (wps->w.c [0].median [0] < 2 && !wps->w.holding_one && wps->w.c [1].median [0] < 2)
+                break;
+
+            if (!(entry = lookup_decode_table [(wps->w.holding_one << 8) | (int)(reservoir & 0xff)]))
+                break;
+
+            reservoir >>= entry & 0xf;
+            bc -= entry & 0xf;
+            wps->w.holding_one = (entry >> 4) & 1;
+            wps->w.holding_zero = !(entry & 0x10);
+
+            switch (entry >> 5) {
+                case 0:
+                    low = 0;
+                    high = GET_MED (0) - 1;
+                    DEC_MED0 ();
+                    break;
+
+                case 1:
+                    low = GET_MED (0);
+                    INC_MED0 ();
+                    high = low + GET_MED (1) - 1;
+                    DEC_MED1 ();
+                    break;
+
+                case 2:
+                    low = GET_MED (0);
+                    INC_MED0 ();
+                    low += GET_MED (1);
+                    INC_MED1 ();
+                    high = low + GET_MED (2) - 1;
+                    DEC_MED2 ();
+                    break;
+
+                default:
+                    low = GET_MED (0);
+                    INC_MED0 ();
+                    low += GET_MED (1);
+                    INC_MED1 ();
+                    low += ((entry >> 5) - 2) * GET_MED (2);
+                    high = low + GET_MED (2) - 1;
+                    INC_MED2 ();
+                    break;
+            }
+        }
+
+        // this is identical to read_code(), except that the bits are known to be present
+
+        if ((maxcode = high - low) < 2) {
+            code = maxcode & (uint32_t) reservoir;
+            reservoir >>= maxcode;
+            bc -= maxcode;
+        }
+        else {
+            uint32_t extras;
+
+            bitcount = count_bits (maxcode);
+            extras = (uint32_t) (((uint64_t) 1 << bitcount) - maxcode - 1);
+
+            if ((code = (uint32_t) reservoir & bitmask [bitcount - 1]) >= extras)
+                code = (code << 1) - extras + ((uint32_t) (reservoir >> (bitcount - 1)) & 1);
+            else
+                bitcount--;
+
+            reservoir >>= bitcount;
+            bc -= bitcount;
+        }
+
+        low += code;
+        buffer [csamples] = (reservoir & 1) ? ~low : low;
+        reservoir >>= 1;
+        bc--;
+    }
+
+    // return any whole words we didn't use so the bitstream is back to its normal state
+
+    while (bc >= word_bits) {
+        bs->ptr--;
+        bc -= word_bits;
+    }
+
+    bs->sr = (uint32_t) reservoir & bitmask [bc];
+    bs->bc = bc;
+
+    return csamples;
+}
+
+#endif
+
 // This is an optimized version of get_word() that is used for lossless only
 // (error_limit == 0). Also, rather than obtaining a single sample, it can be
 // used to obtain an entire buffer of either mono or stereo samples.
@@ -357,6 +543,10 @@ int32_t get_words_lossless (WavpackStream *wps, int32_t *buffer, int32_t nsample
         nsamples *= 2;
 
     for (csamples = 0; csamples < nsamples; ++csamples) {
+#ifdef USE_LOOKUP_DECODER
+        if ((csamples = get_words_lookup (wps, buffer, csamples, nsamples)) == nsamples)
+            break;
+#endif
         if (!(wps->wphdr.flags & MONO_DATA))
             c = wps->w.c + (csamples & 1);
 
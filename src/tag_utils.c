@@ -79,6 +79,9 @@ int WavpackGetTagItem (WavpackContext *wpc, const char *item, char *value, int s
 {
     M_Tag *m_tag = &wpc->m_tag;
 
+    if (wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TAGS);
+
     if (value && size)
         *value = 0;
 
@@ -102,6 +105,9 @@ int WavpackGetBinaryTagItem (WavpackContext *wpc, const char *item, char *value,
 {
     M_Tag *m_tag = &wpc->m_tag;
 
+    if (wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TAGS);
+
     if (value && size)
         *value = 0;
 
@@ -128,6 +134,9 @@ int WavpackGetTagItemIndexed (WavpackContext *wpc, int index, char *item, int si
 {
     M_Tag *m_tag = &wpc->m_tag;
 
+    if (wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TAGS);
+
     if (item && size)
         *item = 0;
 
@@ -143,6 +152,9 @@ int WavpackGetBinaryTagItemIndexed (WavpackContext *wpc, int index, char *item,
 {
     M_Tag *m_tag = &wpc->m_tag;
 
+    if (wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TAGS);
+
     if (item && size)
         *item = 0;
 
@@ -25,7 +25,23 @@
 // value of TRUE indicates a valid tag was found and loaded. Note that the
 // file pointer is undefined when this function exits.
 
+static int find_tag (WavpackContext *wpc, int load_items);
+
 int load_tag (WavpackContext *wpc)
+{
+    return find_tag (wpc, TRUE);
+}
+
+// This function finds an ID3v1 or APEv2 tag just like load_tag(), but does not
+// load the APEv2 items (so nothing is allocated and free_tag() is not needed).
+// This is enough to identify the tag, and its location (see probe_file()).
+
+int locate_tag (WavpackContext *wpc)
+{
+    return find_tag (wpc, FALSE);
+}
+
+static int find_tag (WavpackContext *wpc, int load_items)
 {
     int ape_tag_length, ape_tag_items;
     M_Tag *m_tag = &wpc->m_tag;
@@ -58,8 +74,8 @@ int load_tag (WavpackContext *wpc)
 
                 if (m_tag->ape_tag_hdr.version == 2000 && m_tag->ape_tag_hdr.item_count &&
                     m_tag->ape_tag_hdr.length > (int) sizeof (m_tag->ape_tag_hdr) &&
-                    m_tag->ape_tag_hdr.length <= APE_TAG_MAX_LENGTH &&
-                    (m_tag->ape_tag_data = (unsigned char *)malloc (m_tag->ape_tag_hdr.length)) != NULL) {
+                    m_tag->ape_tag_hdr.length <= APE_TAG_MAX_LENGTH && (!load_items ||
+                    (m_tag->ape_tag_data = (unsigned char *)malloc (m_tag->ape_tag_hdr.length)) != NULL)) {
 
                         ape_tag_items = m_tag->ape_tag_hdr.item_count;
                         ape_tag_length = m_tag->ape_tag_hdr.length;
@@ -102,7 +118,7 @@ int load_tag (WavpackContext *wpc)
                             }
                         }
 
-                        if (wpc->reader->read_bytes (wpc->wv_in, m_tag->ape_tag_data,
+                        if (load_items && wpc->reader->read_bytes (wpc->wv_in, m_tag->ape_tag_data,
                             ape_tag_length - sizeof (APE_Tag_Hdr)) != ape_tag_length - sizeof (APE_Tag_Hdr)) {
                                 free (m_tag->ape_tag_data);
                                 CLEAR (*m_tag);
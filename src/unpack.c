@@ -41,6 +41,16 @@ extern void ASMCALL DECORR_STEREO_PASS_CONT (struct decorr_pass *dpp, int32_t *b
 extern void ASMCALL DECORR_MONO_PASS_CONT (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count, int32_t long_math);
 #endif
 
+// The "continuation" versions of the stereo decorrelation pass are selected at runtime from
+// the available assembly and SIMD versions by unpack_init_dispatch(). There are separate
+// entries for terms -1 & -2 (which can't use SIMD because the channels depend on each other)
+// and for all other terms. If these are NULL then the C version is used for everything.
+
+#define CONT_FUNC_INDEX(term) ((term) == -1 || (term) == -2)
+
+typedef void (ASMCALL *decorr_stereo_pass_cont_func) (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count, int32_t long_math);
+static decorr_stereo_pass_cont_func decorr_stereo_pass_cont [2];
+
 // This flag provides the functionality of terminating the decoding and muting
 // the output when a lossy sample appears to be corrupt. This is automatic
 // for lossless files because a corrupt sample is unambiguous, but for lossy
@@ -51,6 +61,38 @@ extern void ASMCALL DECORR_MONO_PASS_CONT (struct decorr_pass *dpp, int32_t *buf
 
 ///////////////////////////// executable code ////////////////////////////////
 
+// Select the fastest versions of the decoding functions that are available for the
+// host CPU. This is called on every file open (possibly from several threads at once),
+// but the selection is only done the first time. Note that the order is important here
+// because we want the best one to win.
+
+static void select_dispatch (void)
+{
+#ifdef DECORR_STEREO_PASS_CONT
+    if (DECORR_STEREO_PASS_CONT_AVAILABLE)
+        decorr_stereo_pass_cont [0] = decorr_stereo_pass_cont [1] = DECORR_STEREO_PASS_CONT;
+#endif
+
+    // the SIMD versions handle terms -1 & -2 with scalar code, so keep assembly for those (if present)
+
+#ifdef OPT_SIMD_X64
+    if (cpu_has_feature_simd (CPU_FEATURE_AVX2))
+        decorr_stereo_pass_cont [0] = unpack_decorr_stereo_pass_cont_avx2;
+    else if (cpu_has_feature_simd (CPU_FEATURE_SSE41))
+        decorr_stereo_pass_cont [0] = unpack_decorr_stereo_pass_cont_sse41;
+
+    if (!decorr_stereo_pass_cont [1])
+        decorr_stereo_pass_cont [1] = decorr_stereo_pass_cont [0];
+#endif
+}
+
+void unpack_init_dispatch (void)
+{
+    static wp_once_t dispatch_once = WP_ONCE_INIT;
+
+    wp_call_once (&dispatch_once, select_dispatch);
+}
+
 // This monster actually unpacks the WavPack bitstream(s) into the specified
 // buffer as 32-bit integers or floats (depending on original data). Lossy
 // samples will be clipped to their original limits (i.e. 8-bit samples are
@@ -89,7 +131,7 @@ int32_t unpack_samples (WavpackStream *wps, int32_t *buffer, uint32_t sample_cou
         wps->mute_error = TRUE;
 
     if (wps->mute_error) {
-        if (wps->wpc->reduced_channels == 1 || wps->wpc->config.num_channels == 1 || (flags & MONO_FLAG))
+        if ((wps->wpc->reduced_channels == 1 && !wps->wpc->channel_map) || wps->wpc->config.num_channels == 1 || (flags & MONO_FLAG))
             memset (buffer, 0, sample_count * 4);
         else
             memset (buffer, 0, sample_count * 8);
@@ -139,22 +181,16 @@ int32_t unpack_samples (WavpackStream *wps, int32_t *buffer, uint32_t sample_cou
             decorr_mono_pass (dpp, buffer, sample_count);
 #endif
 
+        crc = crc_mono_samples (crc, buffer, sample_count);
+
 #ifndef LOSSY_MUTE
         if (!(flags & HYBRID_FLAG))
 #endif
-        for (bptr = buffer; bptr < eptr; ++bptr) {
+        for (bptr = buffer; bptr < eptr; ++bptr)
             if (labs (bptr [0]) > mute_limit) {
                 i = (uint32_t)(bptr - buffer);
                 break;
             }
-
-            crc = crc * 3 + bptr [0];
-        }
-#ifndef LOSSY_MUTE
-        else
-            for (bptr = buffer; bptr < eptr; ++bptr)
-                crc = crc * 3 + bptr [0];
-#endif
     }
 
     /////////////// handle lossless or hybrid lossy stereo data ///////////////
@@ -178,8 +214,7 @@ int32_t unpack_samples (WavpackStream *wps, int32_t *buffer, uint32_t sample_cou
         if (i != sample_count)
             goto get_word_eof;
 
-#ifdef DECORR_STEREO_PASS_CONT
-        if (sample_count < 16 || !DECORR_STEREO_PASS_CONT_AVAILABLE) {
+        if (sample_count < 16 || !decorr_stereo_pass_cont [0]) {
             for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++)
                 decorr_stereo_pass (dpp, buffer, sample_count);
 
@@ -191,24 +226,15 @@ int32_t unpack_samples (WavpackStream *wps, int32_t *buffer, uint32_t sample_cou
 
                 decorr_stereo_pass (dpp, buffer, pre_samples);
 
-                DECORR_STEREO_PASS_CONT (dpp, buffer + pre_samples * 2, sample_count - pre_samples,
+                decorr_stereo_pass_cont [CONT_FUNC_INDEX (dpp->term)] (dpp, buffer + pre_samples * 2, sample_count - pre_samples,
                     ((flags & MAG_MASK) >> MAG_LSB) >= 16);
             }
-#else
-        for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++)
-            decorr_stereo_pass (dpp, buffer, sample_count);
-
-        m = sample_count & (MAX_TERM - 1);
-#endif
 
         if (flags & JOINT_STEREO)
-            for (bptr = buffer; bptr < eptr; bptr += 2) {
-                bptr [0] += (bptr [1] -= (bptr [0] >> 1));
-                crc += (crc << 3) + ((uint32_t) bptr [0] << 1) + bptr [0] + bptr [1];
-            }
-        else
             for (bptr = buffer; bptr < eptr; bptr += 2)
-                crc += (crc << 3) + ((uint32_t) bptr [0] << 1) + bptr [0] + bptr [1];
+                bptr [0] += (bptr [1] -= (bptr [0] >> 1));
+
+        crc = crc_stereo_samples (crc, buffer, sample_count);
 
 #ifndef LOSSY_MUTE
         if (!(flags & HYBRID_FLAG))
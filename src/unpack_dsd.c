@@ -104,7 +104,7 @@ int32_t unpack_dsd_samples (WavpackStream *wps, int32_t *buffer, uint32_t sample
 
     if (wps->mute_error) {
         int samples_to_null;
-        if (wps->wpc->reduced_channels == 1 || wps->wpc->config.num_channels == 1 || (flags & MONO_FLAG))
+        if ((wps->wpc->reduced_channels == 1 && !wps->wpc->channel_map) || wps->wpc->config.num_channels == 1 || (flags & MONO_FLAG))
             samples_to_null = sample_count;
         else
             samples_to_null = sample_count * 2;
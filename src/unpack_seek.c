@@ -21,6 +21,12 @@
 ///////////////////////////// executable code ////////////////////////////////
 
 static int64_t find_sample (WavpackContext *wpc, void *infile, int64_t header_pos, int64_t sample);
+static int64_t block_index_find (BlockIndex *index, int64_t sample);
+static int64_t block_index_walk (WavpackContext *wpc, void *infile, BlockIndex *index, int64_t sample);
+static int block_index_scan (WavpackContext *wpc, void *infile, BlockIndex *index);
+static int block_cache_find (WavpackContext *wpc, int64_t sample);
+static CachedBlock *block_cache_alloc (WavpackContext *wpc, uint32_t block_samples);
+static int block_cache_fill (WavpackContext *wpc, CachedBlock *block, int64_t sample);
 
 // Seek to the specified sample index, returning TRUE on success. Note that
 // files generated with version 4.0 or newer will seek almost immediately.
@@ -28,7 +34,12 @@ static int64_t find_sample (WavpackContext *wpc, void *infile, int64_t header_po
 // portions of the file, but will create a seek map so that reverse seeks
 // (or forward seeks to already scanned areas) will be very fast. After a
 // FALSE return the file should not be accessed again (other than to close
-// it); this is a fatal error.
+// it); this is a fatal error. The positions of blocks seen while decoding and
+// seeking are remembered (see WavpackBuildBlockIndex()), and seeks into those
+// blocks go directly there without searching the file. Files written with a
+// seek table (CONFIG_SEEK_TABLE) never require searching. If the block cache
+// is enabled (see WavpackSetBlockCache()) then seeks into cached blocks don't
+// access the file at all.
 
 int WavpackSeekSample (WavpackContext *wpc, uint32_t sample)
 {
@@ -42,9 +53,12 @@ int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample)
 #ifdef ENABLE_DSD
     uint32_t samples_to_decode = 0;
 #endif
-    int stream_index = 0;
+    int stream_index = 0, offset = 0;
     int32_t *buffer;
 
+    if (wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TOTAL_SAMPLES);
+
     if (wpc->total_samples == -1 || sample >= wpc->total_samples ||
         !wpc->reader->can_seek (wpc->wv_in) || (wpc->open_flags & OPEN_STREAMING) ||
         (wpc->wvc_flag && !wpc->reader->can_seek (wpc->wvc_in)))
@@ -55,6 +69,13 @@ int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample)
         return seek_sample3 (wpc, (uint32_t) sample);
 #endif
 
+    if (wpc->block_cache.max_bytes && block_cache_find (wpc, sample))
+        return TRUE;
+
+#ifdef ENABLE_THREADS
+    wpc->readahead_count = wpc->readahead_pos = 0;     // discard any read-ahead samples
+#endif
+
 #ifdef ENABLE_DSD
     if (wpc->decimation_context) {      // the decimation code needs some context to be sample accurate
         if (sample < 16) {
@@ -71,14 +92,24 @@ int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample)
     if (!wps->wphdr.block_samples || !(wps->wphdr.flags & INITIAL_BLOCK) || sample < GET_BLOCK_INDEX (wps->wphdr) ||
         sample >= GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples) {
 
+            int64_t index_pos = block_index_find (&wpc->wv_index, sample);
+
+            if (index_pos == -1)
+                index_pos = block_index_walk (wpc, wpc->wv_in, &wpc->wv_index, sample);
+
             free_streams (wpc);
-            wpc->filepos = find_sample (wpc, wpc->wv_in, wpc->filepos, sample);
+            wpc->filepos = index_pos != -1 ? index_pos : find_sample (wpc, wpc->wv_in, wpc->filepos, sample);
 
             if (wpc->filepos == -1)
                 return FALSE;
 
             if (wpc->wvc_flag) {
-                wpc->file2pos = find_sample (wpc, wpc->wvc_in, 0, sample);
+                index_pos = block_index_find (&wpc->wvc_index, sample);
+
+                if (index_pos == -1)
+                    index_pos = block_index_walk (wpc, wpc->wvc_in, &wpc->wvc_index, sample);
+
+                wpc->file2pos = index_pos != -1 ? index_pos : find_sample (wpc, wpc->wvc_in, 0, sample);
 
                 if (wpc->file2pos == -1)
                     return FALSE;
@@ -95,26 +126,26 @@ int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample)
             return FALSE;
         }
 
-        wps->blockbuff = (unsigned char *)malloc (wps->wphdr.ckSize + 8);
-        memcpy (wps->blockbuff, &wps->wphdr, sizeof (WavpackHeader));
+        wps->blockbuff = read_block_buffer (wpc, wpc->wv_in, &wps->wphdr, &wps->blockbuff_size);
 
-        if (wpc->reader->read_bytes (wpc->wv_in, wps->blockbuff + sizeof (WavpackHeader), wps->wphdr.ckSize - 24) !=
-            wps->wphdr.ckSize - 24) {
-                free_streams (wpc);
-                return FALSE;
+        if (!wps->blockbuff) {
+            free_streams (wpc);
+            return FALSE;
         }
 
         // render corrupt blocks harmless
         if (!WavpackVerifySingleBlock (wps->blockbuff, !(wpc->open_flags & OPEN_NO_CHECKSUM))) {
             wps->wphdr.ckSize = sizeof (WavpackHeader) - 8;
             wps->wphdr.block_samples = 0;
-            memcpy (wps->blockbuff, &wps->wphdr, 32);
         }
 
         SET_BLOCK_INDEX (wps->wphdr, GET_BLOCK_INDEX (wps->wphdr) - wpc->initial_index);
-        memcpy (wps->blockbuff, &wps->wphdr, sizeof (WavpackHeader));
+        store_block_header (wpc, &wps->blockbuff, &wps->blockbuff_size, &wps->wphdr);
         wps->init_done = FALSE;
 
+        if (wps->wphdr.block_samples && (wps->wphdr.flags & INITIAL_BLOCK))
+            block_index_add (&wpc->wv_index, GET_BLOCK_INDEX (wps->wphdr), wpc->filepos, wps->wphdr.block_samples);
+
         if (wpc->wvc_flag) {
             wpc->reader->set_pos_abs (wpc->wvc_in, wpc->file2pos);
             wpc->reader->read_bytes (wpc->wvc_in, &wps->wphdr, sizeof (WavpackHeader));
@@ -125,24 +156,24 @@ int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample)
                 return FALSE;
             }
 
-            wps->block2buff = (unsigned char *)malloc (wps->wphdr.ckSize + 8);
-            memcpy (wps->block2buff, &wps->wphdr, sizeof (WavpackHeader));
+            wps->block2buff = read_block_buffer (wpc, wpc->wvc_in, &wps->wphdr, &wps->block2buff_size);
 
-            if (wpc->reader->read_bytes (wpc->wvc_in, wps->block2buff + sizeof (WavpackHeader), wps->wphdr.ckSize - 24) !=
-                wps->wphdr.ckSize - 24) {
-                    free_streams (wpc);
-                    return FALSE;
+            if (!wps->block2buff) {
+                free_streams (wpc);
+                return FALSE;
             }
 
             // render corrupt blocks harmless
             if (!WavpackVerifySingleBlock (wps->block2buff, !(wpc->open_flags & OPEN_NO_CHECKSUM))) {
                 wps->wphdr.ckSize = sizeof (WavpackHeader) - 8;
                 wps->wphdr.block_samples = 0;
-                memcpy (wps->block2buff, &wps->wphdr, 32);
             }
 
             SET_BLOCK_INDEX (wps->wphdr, GET_BLOCK_INDEX (wps->wphdr) - wpc->initial_index);
-            memcpy (wps->block2buff, &wps->wphdr, sizeof (WavpackHeader));
+            store_block_header (wpc, &wps->block2buff, &wps->block2buff_size, &wps->wphdr);
+
+            if (wps->wphdr.block_samples && (wps->wphdr.flags & INITIAL_BLOCK))
+                block_index_add (&wpc->wvc_index, GET_BLOCK_INDEX (wps->wphdr), wpc->file2pos, wps->wphdr.block_samples);
         }
 
         if (!wps->init_done && !unpack_init (wpc, stream_index)) {
@@ -153,7 +184,9 @@ int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample)
         wps->init_done = TRUE;
     }
 
-    while (!wpc->reduced_channels && !(wps->wphdr.flags & FINAL_BLOCK)) {
+    while ((!wpc->reduced_channels || wpc->channel_map) && !(wps->wphdr.flags & FINAL_BLOCK)) {
+        offset += (wps->wphdr.flags & MONO_FLAG) ? 1 : 2;      // first channel of the next stream
+
         if (++stream_index == wpc->num_streams) {
 
             if (wpc->num_streams == wpc->max_streams) {
@@ -172,20 +205,29 @@ int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample)
                 return FALSE;
             }
 
-            wps->blockbuff = (unsigned char *)malloc (wps->wphdr.ckSize + 8);
-            memcpy (wps->blockbuff, &wps->wphdr, 32);
+            // streams with none of their channels selected are skipped (see WavpackSelectChannels())
 
-            if (wpc->reader->read_bytes (wpc->wv_in, wps->blockbuff + 32, wps->wphdr.ckSize - 24) !=
-                wps->wphdr.ckSize - 24) {
+            if (wpc->channel_map && !stream_selected (wpc, offset, wps->wphdr.flags)) {
+                if (!skip_stream_block (wpc, stream_index)) {
                     free_streams (wpc);
                     return FALSE;
+                }
+
+                continue;
+            }
+
+            wps->blockbuff = read_block_buffer (wpc, wpc->wv_in, &wps->wphdr, &wps->blockbuff_size);
+
+            if (!wps->blockbuff) {
+                free_streams (wpc);
+                return FALSE;
             }
 
             // render corrupt blocks harmless
             if (!WavpackVerifySingleBlock (wps->blockbuff, !(wpc->open_flags & OPEN_NO_CHECKSUM))) {
                 wps->wphdr.ckSize = sizeof (WavpackHeader) - 8;
                 wps->wphdr.block_samples = 0;
-                memcpy (wps->blockbuff, &wps->wphdr, 32);
+                store_block_header (wpc, &wps->blockbuff, &wps->blockbuff_size, &wps->wphdr);
             }
 
             wps->init_done = FALSE;
@@ -206,14 +248,25 @@ int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample)
             wps = wpc->streams [stream_index];
     }
 
-    if (sample < wps->sample_index) {
+    // with the block cache we decode the whole block, so we might have to back up to its start
+
+    if (sample < wps->sample_index || (wpc->block_cache.max_bytes && wps->sample_index != GET_BLOCK_INDEX (wps->wphdr))) {
         for (stream_index = 0; stream_index < wpc->num_streams; stream_index++)
-            if (!unpack_init (wpc, stream_index))
+            if (!wpc->streams [stream_index]->blockbuff)     // skipped stream (see skip_stream_block())
+                wpc->streams [stream_index]->sample_index = GET_BLOCK_INDEX (wpc->streams [stream_index]->wphdr);
+            else if (!unpack_init (wpc, stream_index))
                 return FALSE;
             else
                 wpc->streams [stream_index]->init_done = TRUE;
     }
 
+    if (wpc->block_cache.max_bytes) {
+        CachedBlock *block = block_cache_alloc (wpc, wps->wphdr.block_samples);
+
+        if (block)
+            return block_cache_fill (wpc, block, sample);
+    }
+
     samples_to_skip = (uint32_t) (sample - wps->sample_index);
 
     if (samples_to_skip > 131072) {
@@ -225,11 +278,13 @@ int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample)
         buffer = (int32_t *)malloc (samples_to_skip * 8);
 
         for (stream_index = 0; stream_index < wpc->num_streams; stream_index++)
+            if (!wpc->streams [stream_index]->blockbuff)
+                wpc->streams [stream_index]->sample_index += samples_to_skip;
 #ifdef ENABLE_DSD
-            if (wpc->streams [stream_index]->wphdr.flags & DSD_FLAG)
+            else if (wpc->streams [stream_index]->wphdr.flags & DSD_FLAG)
                 unpack_dsd_samples (wpc->streams [stream_index], buffer, samples_to_skip);
-            else
 #endif
+            else
                 unpack_samples (wpc->streams [stream_index], buffer, samples_to_skip);
 
         free (buffer);
@@ -252,6 +307,274 @@ int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample)
     return TRUE;
 }
 
+// Build a complete index of the initial blocks in the WavPack file (and the correction file, if
+// open) so that all subsequent seeks go directly to the correct blocks with no searching. This
+// reads just the header of each block, skipping over the rest, and restores the file positions
+// when done. Entries remembered from decoding and seeking are merged (but are rarely needed
+// because it's much faster to import a previously exported index). Returns TRUE on success.
+
+int WavpackBuildBlockIndex (WavpackContext *wpc)
+{
+    if (wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TOTAL_SAMPLES);
+
+    if (wpc->total_samples == -1 || !wpc->reader->can_seek (wpc->wv_in) || (wpc->open_flags & OPEN_STREAMING) ||
+        (wpc->wvc_flag && !wpc->reader->can_seek (wpc->wvc_in)))
+            return FALSE;
+
+#ifdef ENABLE_LEGACY
+    if (wpc->stream3)
+        return FALSE;
+#endif
+
+    if (!wpc->wv_index.complete && !block_index_scan (wpc, wpc->wv_in, &wpc->wv_index))
+        return FALSE;
+
+    if (wpc->wvc_flag && !wpc->wvc_index.complete && !block_index_scan (wpc, wpc->wvc_in, &wpc->wvc_index))
+        return FALSE;
+
+    return TRUE;
+}
+
+// The block index is exported and imported as a simple binary image (all little-endian) so that
+// it can be stored as a "sidecar" with the file. It starts with this header, followed by the
+// entries for the WavPack file and then for the correction file, each stored as 24 bytes.
+
+typedef struct {
+    char ckID [4];                  // "wvIX"
+    int16_t version, flags;         // version = 1, flags indicate complete indexes
+    uint32_t wv_count, wvc_count;   // number of entries for .wv and .wvc
+    int64_t total_samples, wv_length, wvc_length;
+} BlockIndexHeader;
+
+#define BlockIndexHeaderFormat "4SSLLDDD"
+#define BlockIndexEntryFormat "DDLL"
+#define BLOCK_INDEX_ENTRY_SIZE 24
+#define BLOCK_INDEX_VERSION 1
+#define BLOCK_INDEX_WV_COMPLETE 0x1
+#define BLOCK_INDEX_WVC_COMPLETE 0x2
+
+// Export the current block index to the specified buffer (normally after calling
+// WavpackBuildBlockIndex()). The number of bytes required is returned, and the data
+// is only written if it fits in the specified size (so passing a size of zero can be
+// used to find the required size).
+
+int32_t WavpackExportBlockIndex (WavpackContext *wpc, void *data, int32_t size)
+{
+    int32_t required = sizeof (BlockIndexHeader) + (wpc->wv_index.count + wpc->wvc_index.count) * BLOCK_INDEX_ENTRY_SIZE;
+    unsigned char *dptr = data;
+    BlockIndexHeader header;
+    int pass, i;
+
+    if (wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TOTAL_SAMPLES);
+
+    if (!data || size < required)
+        return required;
+
+    memcpy (header.ckID, "wvIX", 4);
+    header.version = BLOCK_INDEX_VERSION;
+    header.flags = (wpc->wv_index.complete ? BLOCK_INDEX_WV_COMPLETE : 0) | (wpc->wvc_index.complete ? BLOCK_INDEX_WVC_COMPLETE : 0);
+    header.wv_count = wpc->wv_index.count;
+    header.wvc_count = wpc->wvc_index.count;
+    header.total_samples = wpc->total_samples;
+    header.wv_length = wpc->reader->get_length (wpc->wv_in);
+    header.wvc_length = wpc->wvc_flag ? wpc->reader->get_length (wpc->wvc_in) : 0;
+    WavpackNativeToLittleEndian (&header, BlockIndexHeaderFormat);
+    memcpy (dptr, &header, sizeof (header));
+    dptr += sizeof (header);
+
+    for (pass = 0; pass < 2; ++pass) {
+        BlockIndex *index = pass ? &wpc->wvc_index : &wpc->wv_index;
+
+        for (i = 0; i < index->count; ++i) {
+            struct { int64_t block_index, file_pos; uint32_t block_samples, reserved; } entry;
+
+            entry.block_index = index->entries [i].block_index;
+            entry.file_pos = index->entries [i].file_pos;
+            entry.block_samples = index->entries [i].block_samples;
+            entry.reserved = 0;
+            WavpackNativeToLittleEndian (&entry, BlockIndexEntryFormat);
+            memcpy (dptr, &entry, BLOCK_INDEX_ENTRY_SIZE);
+            dptr += BLOCK_INDEX_ENTRY_SIZE;
+        }
+    }
+
+    return required;
+}
+
+// Import a block index previously exported with WavpackExportBlockIndex(). The index is
+// only accepted if it matches the open file(s) in total samples and length, and if the
+// entries are properly sorted. The entries replace any that were already remembered.
+// Returns TRUE if the index was accepted.
+
+int WavpackImportBlockIndex (WavpackContext *wpc, const void *data, int32_t size)
+{
+    const unsigned char *sptr = (const unsigned char *) data + sizeof (BlockIndexHeader);
+    BlockIndex indexes [2];
+    BlockIndexHeader header;
+    int pass, i;
+
+    if (wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TOTAL_SAMPLES);
+
+    if (!data || size < (int32_t) sizeof (BlockIndexHeader))
+        return FALSE;
+
+    memcpy (&header, data, sizeof (header));
+    WavpackLittleEndianToNative (&header, BlockIndexHeaderFormat);
+
+    if (strncmp (header.ckID, "wvIX", 4) || header.version != BLOCK_INDEX_VERSION ||
+        header.wv_count > (uint32_t) (size - sizeof (BlockIndexHeader)) / BLOCK_INDEX_ENTRY_SIZE ||
+        header.wvc_count > (uint32_t) (size - sizeof (BlockIndexHeader)) / BLOCK_INDEX_ENTRY_SIZE - header.wv_count ||
+        header.total_samples != wpc->total_samples || header.wv_length != wpc->reader->get_length (wpc->wv_in) ||
+        header.wvc_length != (wpc->wvc_flag ? wpc->reader->get_length (wpc->wvc_in) : 0))
+            return FALSE;
+
+    CLEARA (indexes);
+
+    for (pass = 0; pass < 2; ++pass) {
+        BlockIndex *index = indexes + pass;
+
+        index->count = index->max = pass ? header.wvc_count : header.wv_count;
+        index->complete = (header.flags & (pass ? BLOCK_INDEX_WVC_COMPLETE : BLOCK_INDEX_WV_COMPLETE)) ? TRUE : FALSE;
+
+        if (index->count && !(index->entries = malloc (index->count * sizeof (BlockIndexEntry)))) {
+            free (indexes [0].entries);
+            return FALSE;
+        }
+
+        for (i = 0; i < index->count; ++i) {
+            struct { int64_t block_index, file_pos; uint32_t block_samples, reserved; } entry;
+
+            memcpy (&entry, sptr, BLOCK_INDEX_ENTRY_SIZE);
+            WavpackLittleEndianToNative (&entry, BlockIndexEntryFormat);
+            sptr += BLOCK_INDEX_ENTRY_SIZE;
+
+            if (!entry.block_samples || entry.block_index < 0 || entry.file_pos < 0 ||
+                (i && entry.block_index < index->entries [i - 1].block_index + index->entries [i - 1].block_samples)) {
+                    free (indexes [0].entries);
+                    free (indexes [1].entries);
+                    return FALSE;
+            }
+
+            index->entries [i].block_index = entry.block_index;
+            index->entries [i].file_pos = entry.file_pos;
+            index->entries [i].block_samples = entry.block_samples;
+        }
+    }
+
+    free (wpc->wv_index.entries);
+    free (wpc->wvc_index.entries);
+    wpc->wv_index = indexes [0];
+    wpc->wvc_index = indexes [1];
+    return TRUE;
+}
+
+// Return the file position of the indexed block that contains the specified sample,
+// or -1 if that block has not been indexed.
+
+static int64_t block_index_find (BlockIndex *index, int64_t sample)
+{
+    int low = 0, high = index->count;
+
+    while (low < high) {
+        int mid = (low + high) >> 1;
+
+        if (index->entries [mid].block_index <= sample)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low && sample < index->entries [low - 1].block_index + index->entries [low - 1].block_samples)
+        return index->entries [low - 1].file_pos;
+
+    return -1;
+}
+
+// If the file has a seek table, then an indexed block is never more than one table interval before
+// any sample, so for samples not in an indexed block we walk forward through the block headers from
+// the closest indexed block (adding blocks to the index as we go) rather than searching the file.
+// Return the file position of the block containing the specified sample, or -1 if not found.
+
+static int64_t block_index_walk (WavpackContext *wpc, void *infile, BlockIndex *index, int64_t sample)
+{
+    int low = 0, high = index->count;
+    WavpackHeader wphdr;
+
+    if (!wpc->seek_interval)
+        return -1;
+
+    while (low < high) {
+        int mid = (low + high) >> 1;
+
+        if (index->entries [mid].block_index <= sample)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (!low || sample >= index->entries [low - 1].block_index + index->entries [low - 1].block_samples + wpc->seek_interval ||
+        wpc->reader->set_pos_abs (infile, index->entries [low - 1].file_pos))
+            return -1;
+
+    while (1) {
+        int64_t header_pos = wpc->reader->get_pos (infile), block_index;
+        uint32_t bcount = read_next_header (wpc->reader, infile, &wphdr);
+
+        if (bcount == (uint32_t) -1)
+            break;
+
+        block_index = GET_BLOCK_INDEX (wphdr) - wpc->initial_index;
+
+        if (wphdr.block_samples && (wphdr.flags & INITIAL_BLOCK)) {
+            if (block_index > sample)
+                break;
+
+            block_index_add (index, block_index, header_pos + bcount, wphdr.block_samples);
+
+            if (sample < block_index + wphdr.block_samples)
+                return header_pos + bcount;
+        }
+
+        if (wpc->reader->set_pos_rel (infile, wphdr.ckSize - 24, SEEK_CUR))
+            break;
+    }
+
+    return -1;
+}
+
+// Scan the specified file from the beginning, adding every initial block with audio to the
+// specified index. Only the headers are read, and the file position is restored when done.
+
+static int block_index_scan (WavpackContext *wpc, void *infile, BlockIndex *index)
+{
+    int64_t restore_pos = wpc->reader->get_pos (infile);
+    WavpackHeader wphdr;
+
+    if (wpc->reader->set_pos_abs (infile, 0))
+        return FALSE;
+
+    while (1) {
+        int64_t header_pos = wpc->reader->get_pos (infile);
+        uint32_t bcount = read_next_header (wpc->reader, infile, &wphdr);
+
+        if (bcount == (uint32_t) -1)
+            break;
+
+        if (wphdr.block_samples && (wphdr.flags & INITIAL_BLOCK))
+            block_index_add (index, GET_BLOCK_INDEX (wphdr) - wpc->initial_index, header_pos + bcount, wphdr.block_samples);
+
+        if (wpc->reader->set_pos_rel (infile, wphdr.ckSize - 24, SEEK_CUR))
+            break;
+    }
+
+    index->complete = TRUE;
+    wpc->reader->set_pos_abs (infile, restore_pos);
+    return TRUE;
+}
+
 // Find a valid WavPack header, searching either from the current file position
 // (or from the specified position if not -1) and store it (endian corrected)
 // at the specified pointer. The return value is the exact file position of the
@@ -387,5 +710,505 @@ static int64_t find_sample (WavpackContext *wpc, void *infile, int64_t header_po
     }
 }
 
+// Enable a cache of decoded blocks with the specified maximum size in bytes (or disable it with
+// zero, which also frees any cached blocks). When enabled, the block containing the target of
+// every seek is decoded in its entirety and cached, and seeks into cached blocks then require no
+// file access or decoding at all (and the samples are simply copied out by the unpack functions).
+// This makes repeated access to the same areas of a file (e.g., loop playback, rendering waveforms,
+// or extracting overlapping clips) much faster. The least recently used blocks are discarded to
+// stay under the size limit. FALSE is returned if the file can't be seeked (which includes DSD
+// files opened with OPEN_DSD_AS_PCM) or for legacy (pre-4.0) files.
+
+static void block_cache_free (BlockCache *cache);
+
+int WavpackSetBlockCache (WavpackContext *wpc, uint32_t max_bytes)
+{
+    BlockCache *cache = &wpc->block_cache;
+
+    if (wpc->lazy_pending)
+        finish_lazy_open (wpc, LAZY_TOTAL_SAMPLES);
+
+    if (wpc->total_samples == -1 || !wpc->reader->can_seek (wpc->wv_in) || (wpc->open_flags & OPEN_STREAMING) ||
+        (wpc->wvc_flag && !wpc->reader->can_seek (wpc->wvc_in)) || wpc->decimation_context)
+            return FALSE;
+
+#ifdef ENABLE_LEGACY
+    if (wpc->stream3)
+        return FALSE;
+#endif
+
+    // when disabling, we must put the decoder where the application thinks it is before discarding
+    // the block currently being read from (there's nothing to do at the end of the file, though)
+
+    if (!max_bytes) {
+        int64_t sample = cache->current ? cache->current->block_index + cache->current_pos : -1;
+        int reposition = cache->current && (cache->reposition || cache->current_pos < cache->current->block_samples);
+
+        block_cache_free (cache);
+        cache->max_bytes = 0;
+
+        if (reposition && sample < wpc->total_samples)
+            return WavpackSeekSample64 (wpc, sample);
+
+        return TRUE;
+    }
+
+    cache->max_bytes = max_bytes;
+
+    // if the cache has shrunk, discard the least recently used blocks (but not the current one)
+
+    while (cache->bytes > cache->max_bytes) {
+        CachedBlock *lru = NULL;
+        int i;
+
+        for (i = 0; i < cache->count; ++i)
+            if (cache->blocks + i != cache->current && (!lru || cache->blocks [i].last_used < lru->last_used))
+                lru = cache->blocks + i;
+
+        if (!lru)
+            break;
+
+        cache->bytes -= lru->bytes;
+        free (lru->samples);
+
+        if (cache->current == cache->blocks + cache->count - 1)
+            cache->current = lru;
+
+        *lru = cache->blocks [--cache->count];
+    }
+
+    return TRUE;
+}
+
+// Return the number of seeks that were satisfied from the block cache, and the number that were not
+// (in which case the block was decoded and added to the cache).
+
+void WavpackGetBlockCacheStats (WavpackContext *wpc, int64_t *hits, int64_t *misses)
+{
+    if (hits)
+        *hits = wpc ? wpc->block_cache.hits : 0;
+
+    if (misses)
+        *misses = wpc ? wpc->block_cache.misses : 0;
+}
+
+// Unpack samples from the current cached block. When the block is exhausted we continue with the
+// regular decoder, which may first have to seek to the end of the block (which might find the next
+// block in the cache). At the end of the file we stay on the exhausted block so nothing is returned.
+
+uint32_t unpack_samples_cached (WavpackContext *wpc, int32_t *buffer, uint32_t samples)
+{
+    int num_channels = wpc->reduced_channels ? wpc->reduced_channels : wpc->config.num_channels;
+    BlockCache *cache = &wpc->block_cache;
+    uint32_t samples_unpacked = 0;
+
+    while (samples && cache->current) {
+        CachedBlock *block = cache->current;
+        uint32_t samples_to_copy = block->block_samples - cache->current_pos;
+
+        if (samples_to_copy > samples)
+            samples_to_copy = samples;
+
+        memcpy (buffer, block->samples + cache->current_pos * num_channels, samples_to_copy * num_channels * sizeof (int32_t));
+        cache->current_pos += samples_to_copy;
+        buffer += samples_to_copy * num_channels;
+        samples_unpacked += samples_to_copy;
+        samples -= samples_to_copy;
+
+        if (cache->current_pos == block->block_samples) {
+            int64_t next_sample = block->block_index + block->block_samples;
+
+            if (next_sample >= wpc->total_samples)
+                return samples_unpacked;
+
+            cache->current = NULL;
+
+            if (cache->reposition && !WavpackSeekSample64 (wpc, next_sample))
+                return samples_unpacked;
+        }
+    }
+
+    if (samples)
+        samples_unpacked += WavpackUnpackSamples (wpc, buffer, samples);
+
+    return samples_unpacked;
+}
+
+// Look for a cached block containing the specified sample and, if found, make it the current block
+// and return TRUE. Note that the regular decoder is not touched, so we'll have to seek it later.
+
+static int block_cache_find (WavpackContext *wpc, int64_t sample)
+{
+    BlockCache *cache = &wpc->block_cache;
+    int i;
+
+    for (i = 0; i < cache->count; ++i)
+        if (sample >= cache->blocks [i].block_index && sample < cache->blocks [i].block_index + cache->blocks [i].block_samples) {
+            cache->current = cache->blocks + i;
+            cache->current_pos = (uint32_t) (sample - cache->current->block_index);
+            cache->current->last_used = ++cache->clock;
+            cache->reposition = TRUE;
+            cache->hits++;
+            return TRUE;
+        }
+
+    cache->current = NULL;
+    cache->misses++;
+    return FALSE;
+}
+
+// Allocate a new (unfilled) entry in the block cache for a block with the specified number of samples,
+// discarding the least recently used entries to make room. NULL is returned if the block can't be
+// cached (because it's empty or too big or the memory isn't available).
+
+static CachedBlock *block_cache_alloc (WavpackContext *wpc, uint32_t block_samples)
+{
+    int num_channels = wpc->reduced_channels ? wpc->reduced_channels : wpc->config.num_channels;
+    uint32_t bytes = block_samples * num_channels * sizeof (int32_t);
+    BlockCache *cache = &wpc->block_cache;
+    CachedBlock *block;
+
+    if (!block_samples || block_samples > cache->max_bytes / num_channels / sizeof (int32_t))
+        return NULL;
+
+    while (cache->count && cache->bytes + bytes > cache->max_bytes) {
+        CachedBlock *lru = cache->blocks;
+        int i;
+
+        for (i = 1; i < cache->count; ++i)
+            if (cache->blocks [i].last_used < lru->last_used)
+                lru = cache->blocks + i;
+
+        cache->bytes -= lru->bytes;
+        free (lru->samples);
+        *lru = cache->blocks [--cache->count];
+    }
+
+    if (cache->count == cache->max) {
+        int new_max = cache->max ? cache->max * 2 : 16;
+        CachedBlock *new_blocks = realloc (cache->blocks, new_max * sizeof (CachedBlock));
+
+        if (!new_blocks)
+            return NULL;
+
+        cache->blocks = new_blocks;
+        cache->max = new_max;
+    }
+
+    block = cache->blocks + cache->count;
+    block->samples = malloc (bytes);
+
+    if (!block->samples)
+        return NULL;
+
+    block->block_samples = block_samples;
+    block->bytes = bytes;
+    return block;
+}
+
+// The regular decoder has been positioned at the start of the block containing the specified sample,
+// so decode the whole block into the new cache entry and make it the current block. Afterward, the
+// regular decoder is at the end of the block, which is exactly where it has to be when the cached
+// block is exhausted. Returns FALSE on error (which means the target sample was not decoded).
+
+static int block_cache_fill (WavpackContext *wpc, CachedBlock *block, int64_t sample)
+{
+    BlockCache *cache = &wpc->block_cache;
+
+    block->block_index = wpc->streams [0]->sample_index;
+    block->block_samples = WavpackUnpackSamples (wpc, block->samples, block->block_samples);
+
+    if (sample >= block->block_index + block->block_samples) {
+        free (block->samples);
+        return FALSE;
+    }
+
+    block->last_used = ++cache->clock;
+    cache->bytes += block->bytes;
+    cache->count++;
+
+    cache->current = block;
+    cache->current_pos = (uint32_t) (sample - block->block_index);
+    cache->reposition = FALSE;
+    return TRUE;
+}
+
+static void block_cache_free (BlockCache *cache)
+{
+    while (cache->count--)
+        free (cache->blocks [cache->count].samples);
+
+    if (cache->blocks)
+        free (cache->blocks);
+
+    cache->blocks = cache->current = NULL;
+    cache->count = cache->max = 0;
+    cache->bytes = 0;
+}
+
+// The WavpackReadRange() function decodes through a private context that shares the caller's reader,
+// so these are the reader functions that context uses. Each "file" has its own position and every read
+// goes to the shared reader at that position (restoring the shared position afterward) while holding the
+// context's reader mutex. Files in memory (WavpackOpenFileInputMemory()) are simply read directly.
+
+typedef struct {
+    WavpackContext *wpc;
+    void *id;
+    unsigned char *data;
+    int64_t pos, length;
+} RangeFile;
+
+static int32_t range_read_bytes (void *id, void *data, int32_t bcount)
+{
+    RangeFile *file = (RangeFile *) id;
+    WavpackContext *wpc = file->wpc;
+    int32_t bytes_read = 0;
+
+    if (file->data) {
+        if (bcount > 0 && file->pos >= 0 && file->pos < file->length) {
+            bytes_read = file->length - file->pos < bcount ? (int32_t) (file->length - file->pos) : bcount;
+            memcpy (data, file->data + file->pos, bytes_read);
+        }
+    }
+    else {
+        int64_t shared_pos;
+
+#ifdef ENABLE_THREADS
+        wp_mutex_obtain (wpc->reader_mutex);
 #endif
+        shared_pos = wpc->reader->get_pos (file->id);
+
+        if (!wpc->reader->set_pos_abs (file->id, file->pos))
+            bytes_read = wpc->reader->read_bytes (file->id, data, bcount);
+
+        wpc->reader->set_pos_abs (file->id, shared_pos);
+#ifdef ENABLE_THREADS
+        wp_mutex_release (wpc->reader_mutex);
+#endif
+    }
+
+    if (bytes_read > 0)
+        file->pos += bytes_read;
+
+    return bytes_read;
+}
+
+static int64_t range_get_pos (void *id)
+{
+    return ((RangeFile *) id)->pos;
+}
 
+static int range_set_pos_abs (void *id, int64_t pos)
+{
+    ((RangeFile *) id)->pos = pos;
+    return 0;
+}
+
+static int range_set_pos_rel (void *id, int64_t delta, int mode)
+{
+    RangeFile *file = (RangeFile *) id;
+
+    if (mode == SEEK_SET)
+        file->pos = delta;
+    else if (mode == SEEK_CUR)
+        file->pos += delta;
+    else if (mode == SEEK_END)
+        file->pos = file->length + delta;
+    else
+        return -1;
+
+    return 0;
+}
+
+static int range_push_back_byte (void *id, int c)
+{
+    ((RangeFile *) id)->pos--;      // the byte is still there, of course
+    return c;
+}
+
+static int64_t range_get_length (void *id)
+{
+    return ((RangeFile *) id)->length;
+}
+
+static int range_can_seek (void *id)
+{
+    return 1;
+}
+
+static WavpackStreamReader64 range_reader = {
+    range_read_bytes, NULL, range_get_pos, range_set_pos_abs, range_set_pos_rel,
+    range_push_back_byte, range_get_length, range_can_seek, NULL, NULL
+};
+
+// Copy the index entry for the block containing (or closest before) the specified sample. A seek
+// starting from this either goes directly to the block or walks forward from it (with a seek table).
+
+static void block_index_copy_entry (BlockIndex *index, BlockIndex *dest, int64_t sample)
+{
+    int low = 0, high = index->count;
+
+    while (low < high) {
+        int mid = (low + high) >> 1;
+
+        if (index->entries [mid].block_index <= sample)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low)
+        block_index_add (dest, index->entries [low - 1].block_index, index->entries [low - 1].file_pos, index->entries [low - 1].block_samples);
+}
+
+static void block_index_merge (BlockIndex *index, BlockIndex *source)
+{
+    int i;
+
+    for (i = 0; i < source->count; ++i)
+        block_index_add (index, source->entries [i].block_index, source->entries [i].file_pos, source->entries [i].block_samples);
+}
+
+// Create the private context used by WavpackReadRange(). This gets a copy of the parsed information
+// and its own stream, but the channel identities and selection are shared (and must not be freed with
+// the context).
+
+static WavpackContext *range_context_create (WavpackContext *wpc, RangeFile *wv_file, RangeFile *wvc_file)
+{
+    WavpackContext *rwpc = (WavpackContext *)malloc (sizeof (WavpackContext));
+
+    if (!rwpc)
+        return NULL;
+
+    CLEAR (*rwpc);
+#ifdef ENABLE_THREADS
+    wp_mutex_init (rwpc->reader_mutex);
+#endif
+    copy_context_info (rwpc, wpc);
+    rwpc->reader = &range_reader;
+    rwpc->filepos = wpc->filepos;
+    rwpc->open_flags &= ~(OPEN_WRAPPER | OPEN_THREADS_MASK | OPEN_THREADS_HIGH_MASK);
+    rwpc->channel_identities = wpc->channel_identities;
+    rwpc->channel_map = wpc->channel_map;
+    rwpc->wv_data = wpc->wv_data;
+    rwpc->wv_data_size = wpc->wv_data_size;
+
+    wv_file->wpc = wpc;
+    wv_file->id = wpc->wv_in;
+    wv_file->data = wpc->wv_data;
+    wv_file->length = wpc->wv_data ? wpc->wv_data_size : wpc->filelen;
+    wv_file->pos = 0;
+    rwpc->wv_in = wv_file;
+
+#ifdef ENABLE_THREADS
+    rwpc->num_workers = 0;
+#endif
+
+    if (wpc->wvc_flag) {
+        rwpc->file2pos = wpc->file2pos;
+        rwpc->wvc_data = wpc->wvc_data;
+        rwpc->wvc_data_size = wpc->wvc_data_size;
+
+        wvc_file->wpc = wpc;
+        wvc_file->id = wpc->wvc_in;
+        wvc_file->data = wpc->wvc_data;
+        wvc_file->length = wpc->wvc_data ? wpc->wvc_data_size : wpc->file2len;
+        wvc_file->pos = 0;
+        rwpc->wvc_in = wvc_file;
+    }
+
+#ifdef ENABLE_DSD
+    if (wpc->decimation_context)
+        rwpc->decimation_context = decimate_dsd_init (wpc->reduced_channels ? wpc->reduced_channels : wpc->config.num_channels);
+#endif
+
+    rwpc->streams = (WavpackStream **)malloc ((rwpc->num_streams = 1) * sizeof (rwpc->streams [0]));
+
+    if (rwpc->streams && (rwpc->streams [0] = (WavpackStream *)calloc (1, sizeof (WavpackStream))))
+        rwpc->streams [0]->wpc = rwpc;
+    else {
+        rwpc->channel_identities = NULL;
+        rwpc->channel_map = NULL;
+        return WavpackCloseFile (rwpc);
+    }
+
+    return rwpc;
+}
+
+// Decode the specified range of samples (in the same format as WavpackUnpackSamples()) without
+// changing the context's current position. Unlike all the other functions, this may be called
+// from multiple threads at once on the same context (but not during any other calls on it), and
+// this is much cheaper than opening the file again for each thread. Each call decodes using its
+// own lightweight stream state while sharing the parsed configuration and the block index (and
+// the reader, which is locked for each read, so the reader itself need not be thread-safe). The
+// locking requires ENABLE_THREADS, so without it concurrent calls are NOT safe and must be
+// serialized by the caller (just like all the other calls on a context). The
+// number of samples decoded is returned, which is less than requested only at the end of the file
+// or on error (decoding errors are added to the count returned by WavpackGetNumErrors()).
+
+uint32_t WavpackReadRange (WavpackContext *wpc, int64_t start_sample, uint32_t samples, int32_t *buffer)
+{
+    uint32_t samples_read = 0;
+    RangeFile wv_file, wvc_file;
+    WavpackContext *rwpc;
+
+#ifdef ENABLE_THREADS
+    wp_mutex_obtain (wpc->reader_mutex);     // another thread might be finishing a lazy open
+#endif
+    finish_lazy_open (wpc, LAZY_TOTAL_SAMPLES);
+#ifdef ENABLE_THREADS
+    wp_mutex_release (wpc->reader_mutex);
+#endif
+
+    if (wpc->total_samples == -1 || start_sample < 0 || start_sample >= wpc->total_samples || !samples ||
+        !wpc->reader->can_seek (wpc->wv_in) || (wpc->open_flags & OPEN_STREAMING) ||
+        (wpc->wvc_flag && !wpc->reader->can_seek (wpc->wvc_in)))
+            return 0;
+
+#ifdef ENABLE_LEGACY
+    if (wpc->stream3)
+        return 0;
+#endif
+
+    rwpc = range_context_create (wpc, &wv_file, &wvc_file);
+
+    if (!rwpc)
+        return 0;
+
+    // start with what the shared index knows about where we're going, and afterward
+    // add the blocks we found to the shared index so that other calls can use them
+
+#ifdef ENABLE_THREADS
+    wp_mutex_obtain (wpc->reader_mutex);
+#endif
+    block_index_copy_entry (&wpc->wv_index, &rwpc->wv_index, start_sample);
+
+    if (wpc->wvc_flag)
+        block_index_copy_entry (&wpc->wvc_index, &rwpc->wvc_index, start_sample);
+#ifdef ENABLE_THREADS
+    wp_mutex_release (wpc->reader_mutex);
+#endif
+
+    if (WavpackSeekSample64 (rwpc, start_sample))
+        samples_read = WavpackUnpackSamples (rwpc, buffer, samples);
+
+#ifdef ENABLE_THREADS
+    wp_mutex_obtain (wpc->reader_mutex);
+#endif
+    block_index_merge (&wpc->wv_index, &rwpc->wv_index);
+
+    if (wpc->wvc_flag)
+        block_index_merge (&wpc->wvc_index, &rwpc->wvc_index);
+
+    wpc->crc_errors += rwpc->crc_errors;
+#ifdef ENABLE_THREADS
+    wp_mutex_release (wpc->reader_mutex);
+#endif
+
+    rwpc->channel_identities = NULL;
+    rwpc->channel_map = NULL;
+    WavpackCloseFile (rwpc);
+    return samples_read;
+}
+
+#endif
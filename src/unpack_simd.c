@@ -0,0 +1,328 @@
+////////////////////////////////////////////////////////////////////////////
+//                           **** WAVPACK ****                            //
+//                  Hybrid Lossless Wavefile Compressor                   //
+//                Copyright (c) 1998 - 2024 David Bryant.                 //
+//                          All Rights Reserved.                          //
+//      Distributed under the BSD Software License (see license.txt)      //
+////////////////////////////////////////////////////////////////////////////
+
+// unpack_simd.c
+
+// This module provides SSE4.1 and AVX2 versions of the stereo decorrelation
+// pass used for decoding on x86-64. They are written with compiler intrinsics
+// and are built into every x86-64 binary (regardless of the target selected
+// for the rest of the library), with the best version for the host CPU being
+// selected at runtime by unpack_init_dispatch() in unpack.c.
+//
+// These are drop-in replacements for the assembly language versions in
+// unpack_x64.S (i.e., unpack_decorr_stereo_pass_cont_x64) and so follow the
+// same rules: up to 8 previous stereo samples must be visible and correct in
+// the buffer (for the positive terms), the history samples are returned to the
+// decorr_pass structure normalized, and the "long_math" argument is ignored
+// because the weights are always applied with 64-bit multiplies (which give
+// identical results to the apply_weight() macro).
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavpack_local.h"
+
+#ifdef OPT_SIMD_X64
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Return non-zero if the host CPU (and operating system) supports the specified
+// instruction set extension (CPU_FEATURE_SSE41 or CPU_FEATURE_AVX2).
+
+int cpu_has_feature_simd (int findex)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int regs [4];
+
+    __cpuid (regs, 0);
+
+    if (regs [0] < 1)
+        return FALSE;
+
+    __cpuid (regs, 1);
+
+    if (findex == CPU_FEATURE_SSE41)
+        return (regs [2] >> 19) & 1;
+
+    // for AVX2 we need the OS to be saving the YMM registers (OSXSAVE and XCR0 bits 1 & 2)
+
+    if (findex != CPU_FEATURE_AVX2 || !((regs [2] >> 27) & 1) || (_xgetbv (0) & 6) != 6)
+        return FALSE;
+
+    __cpuid (regs, 0);
+
+    if (regs [0] < 7)
+        return FALSE;
+
+    __cpuidex (regs, 7, 0);
+    return (regs [1] >> 5) & 1;
+#else
+    __builtin_cpu_init ();
+
+    if (findex == CPU_FEATURE_SSE41)
+        return __builtin_cpu_supports ("sse4.1");
+    else if (findex == CPU_FEATURE_AVX2)
+        return __builtin_cpu_supports ("avx2");
+    else
+        return FALSE;
+#endif
+}
+
+// The stereo samples and weights are held with the left channel in the low 32 bits of
+// the first 64-bit lane and the right channel in the low 32 bits of the second 64-bit
+// lane so that _mm_mul_epi32() can generate the full 64-bit products. The upper halves
+// of the lanes are ignored (apart from _mm_mul_epi32() nothing crosses a 32-bit lane).
+
+#define LOAD_STEREO(ptr) _mm_shuffle_epi32 (_mm_loadl_epi64 ((const __m128i *)(ptr)), 0x50)
+#define STORE_STEREO(ptr,v) _mm_storel_epi64 ((__m128i *)(ptr), _mm_shuffle_epi32 ((v), 0x08))
+
+// apply_weight() for both channels: ((weight * sample) + 512) >> 10, where we only need
+// the low 32 bits of the result so a logical shift of the 64-bit value is fine
+
+#define APPLY_WEIGHT_SSE(weight,sam,round) \
+    _mm_srli_epi64 (_mm_add_epi64 (_mm_mul_epi32 ((sam), (weight)), (round)), 10)
+
+// update_weight() for both channels: add delta to the weight if the sample and the
+// input value have the same sign, subtract it if they differ, and leave it alone if
+// either one is zero
+
+#define WEIGHT_ADJUST_SSE(sam,input,delta,zero) ( \
+    sign = _mm_srai_epi32 (_mm_xor_si128 ((sam), (input)), 31), \
+    adjust = _mm_andnot_si128 (_mm_or_si128 (_mm_cmpeq_epi32 ((sam), (zero)), _mm_cmpeq_epi32 ((input), (zero))), (delta)), \
+    _mm_sub_epi32 (_mm_xor_si128 (adjust, sign), sign))
+
+// update_weight_clip() for both channels; this is used with the negative terms and
+// limits the weights to +/-1024
+
+static __m128i TARGET_SSE41 update_weight_clip_sse (__m128i weight, __m128i sam, __m128i input, __m128i delta, __m128i zero)
+{
+    __m128i sign = _mm_srai_epi32 (_mm_xor_si128 (sam, input), 31);
+    __m128i skip = _mm_or_si128 (_mm_cmpeq_epi32 (sam, zero), _mm_cmpeq_epi32 (input, zero));
+    __m128i up = _mm_min_epi32 (_mm_add_epi32 (weight, delta), _mm_set1_epi32 (1024));
+    __m128i down = _mm_max_epi32 (_mm_sub_epi32 (weight, delta), _mm_set1_epi32 (-1024));
+
+    return _mm_blendv_epi8 (_mm_blendv_epi8 (up, down, sign), weight, skip);
+}
+
+// Return the weights and history samples to the decorr_pass structure. For positive terms
+// the history comes straight from the (now decoded) buffer, which ends at eptr.
+
+static void store_history (struct decorr_pass *dpp, int32_t *eptr)
+{
+    int k;
+
+    if (dpp->term > MAX_TERM) {
+        dpp->samples_A [0] = eptr [-2];
+        dpp->samples_B [0] = eptr [-1];
+        dpp->samples_A [1] = eptr [-4];
+        dpp->samples_B [1] = eptr [-3];
+    }
+    else if (dpp->term > 0)
+        for (k = 0; k < dpp->term; ++k) {
+            dpp->samples_A [k] = eptr [(k - dpp->term) * 2];
+            dpp->samples_B [k] = eptr [(k - dpp->term) * 2 + 1];
+        }
+}
+
+// Perform a single pass of stereo decorrelation on the provided buffer, handling both
+// channels at once in SSE registers. Terms -1 and -2 can't be done this way because
+// each channel depends on the result of the other channel for the same sample, so
+// these are done with regular scalar code.
+
+void ASMCALL TARGET_SSE41 unpack_decorr_stereo_pass_cont_sse41 (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count, int32_t long_math)
+{
+    int32_t *bptr, *eptr = buffer + (sample_count * 2);
+    __m128i weight, delta, round, zero, sam, input, output, sign, adjust;
+
+    if (sample_count <= 0)
+        return;
+
+    if (dpp->term == -1) {
+        for (bptr = buffer; bptr < eptr; bptr += 2) {
+            int32_t sam;
+
+            sam = bptr [0] + apply_weight (dpp->weight_A, dpp->samples_A [0]);
+            update_weight_clip (dpp->weight_A, dpp->delta, dpp->samples_A [0], bptr [0]);
+            bptr [0] = sam;
+            dpp->samples_A [0] = bptr [1] + apply_weight (dpp->weight_B, sam);
+            update_weight_clip (dpp->weight_B, dpp->delta, sam, bptr [1]);
+            bptr [1] = dpp->samples_A [0];
+        }
+
+        return;
+    }
+
+    if (dpp->term == -2) {
+        for (bptr = buffer; bptr < eptr; bptr += 2) {
+            int32_t sam;
+
+            sam = bptr [1] + apply_weight (dpp->weight_B, dpp->samples_B [0]);
+            update_weight_clip (dpp->weight_B, dpp->delta, dpp->samples_B [0], bptr [1]);
+            bptr [1] = sam;
+            dpp->samples_B [0] = bptr [0] + apply_weight (dpp->weight_A, sam);
+            update_weight_clip (dpp->weight_A, dpp->delta, sam, bptr [0]);
+            bptr [0] = dpp->samples_B [0];
+        }
+
+        return;
+    }
+
+    weight = _mm_set_epi32 (0, dpp->weight_B, 0, dpp->weight_A);
+    delta = _mm_set1_epi32 (dpp->delta);
+    round = _mm_set1_epi64x (512);
+    zero = _mm_setzero_si128 ();
+
+    switch (dpp->term) {
+        case 17: {
+            __m128i sam1 = LOAD_STEREO (buffer - 2), sam2 = LOAD_STEREO (buffer - 4);
+
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                sam = _mm_sub_epi32 (_mm_add_epi32 (sam1, sam1), sam2);
+                input = LOAD_STEREO (bptr);
+                output = _mm_add_epi32 (APPLY_WEIGHT_SSE (weight, sam, round), input);
+                weight = _mm_add_epi32 (weight, WEIGHT_ADJUST_SSE (sam, input, delta, zero));
+                STORE_STEREO (bptr, output);
+                sam2 = sam1;
+                sam1 = output;
+            }
+
+            break;
+        }
+
+        case 18: {
+            __m128i sam1 = LOAD_STEREO (buffer - 2), sam2 = LOAD_STEREO (buffer - 4);
+
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                sam = _mm_add_epi32 (sam1, _mm_srai_epi32 (_mm_sub_epi32 (sam1, sam2), 1));
+                input = LOAD_STEREO (bptr);
+                output = _mm_add_epi32 (APPLY_WEIGHT_SSE (weight, sam, round), input);
+                weight = _mm_add_epi32 (weight, WEIGHT_ADJUST_SSE (sam, input, delta, zero));
+                STORE_STEREO (bptr, output);
+                sam2 = sam1;
+                sam1 = output;
+            }
+
+            break;
+        }
+
+        case 1:
+            for (sam = LOAD_STEREO (buffer - 2), bptr = buffer; bptr < eptr; bptr += 2) {
+                input = LOAD_STEREO (bptr);
+                output = _mm_add_epi32 (APPLY_WEIGHT_SSE (weight, sam, round), input);
+                weight = _mm_add_epi32 (weight, WEIGHT_ADJUST_SSE (sam, input, delta, zero));
+                STORE_STEREO (bptr, output);
+                sam = output;
+            }
+
+            break;
+
+        // term -3 works in SSE because each channel uses the previous sample of the other channel
+
+        case -3:
+            for (sam = _mm_set_epi32 (0, dpp->samples_B [0], 0, dpp->samples_A [0]), bptr = buffer; bptr < eptr; bptr += 2) {
+                input = LOAD_STEREO (bptr);
+                output = _mm_add_epi32 (APPLY_WEIGHT_SSE (weight, sam, round), input);
+                weight = update_weight_clip_sse (weight, sam, input, delta, zero);
+                STORE_STEREO (bptr, output);
+                sam = _mm_shuffle_epi32 (output, 0x4e);     // swap channels
+            }
+
+            dpp->samples_A [0] = eptr [-1];
+            dpp->samples_B [0] = eptr [-2];
+            break;
+
+        default: {
+            int offset = -dpp->term * 2;
+
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                sam = LOAD_STEREO (bptr + offset);
+                input = LOAD_STEREO (bptr);
+                output = _mm_add_epi32 (APPLY_WEIGHT_SSE (weight, sam, round), input);
+                weight = _mm_add_epi32 (weight, WEIGHT_ADJUST_SSE (sam, input, delta, zero));
+                STORE_STEREO (bptr, output);
+            }
+
+            break;
+        }
+    }
+
+    dpp->weight_A = _mm_cvtsi128_si32 (weight);
+    dpp->weight_B = _mm_extract_epi32 (weight, 2);
+    store_history (dpp, eptr);
+}
+
+// The AVX2 version decodes two stereo samples at once in the four 64-bit lanes. This is
+// possible with terms 2 through 8 because the history sample for the second sample is
+// already decoded, and because the weight adjustment for the first sample depends only on
+// the input and the history sample, so the weights for the second sample can be found at
+// the same time. However, the decoding is limited by the latency of each sample's history
+// and not by throughput, so in practice this is only faster than SSE4.1 for term 8 (and
+// is actually much slower for terms 2 & 3). The other terms are handed over to the SSE4.1
+// version.
+
+void ASMCALL TARGET_AVX2 unpack_decorr_stereo_pass_cont_avx2 (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count, int32_t long_math)
+{
+    int32_t *bptr, *eptr = buffer + (sample_count & ~1) * 2, offset = -dpp->term * 2;
+    __m256i delta, round, zero, sam, input, output, sign, adjust, pack;
+    __m128i weight;
+
+    if (dpp->term != MAX_TERM || sample_count < 2) {
+        unpack_decorr_stereo_pass_cont_sse41 (dpp, buffer, sample_count, long_math);
+        return;
+    }
+
+    weight = _mm_set_epi32 (0, dpp->weight_B, 0, dpp->weight_A);
+    delta = _mm256_set1_epi32 (dpp->delta);
+    round = _mm256_set1_epi64x (512);
+    zero = _mm256_setzero_si256 ();
+    pack = _mm256_set_epi32 (7, 5, 3, 1, 6, 4, 2, 0);
+
+    for (bptr = buffer; bptr < eptr; bptr += 4) {
+        __m256i weights, adjust_first;
+
+        // the history samples are loaded separately because each one is usually still in a store
+        // buffer, and a single load that spans two stores can't be forwarded (a big stall)
+
+        sam = _mm256_cvtepi32_epi64 (_mm_unpacklo_epi64 (_mm_loadl_epi64 ((const __m128i *)(bptr + offset)),
+            _mm_loadl_epi64 ((const __m128i *)(bptr + offset + 2))));
+        input = _mm256_cvtepi32_epi64 (_mm_loadu_si128 ((const __m128i *) bptr));
+
+        sign = _mm256_srai_epi32 (_mm256_xor_si256 (sam, input), 31);
+        adjust = _mm256_andnot_si256 (_mm256_or_si256 (_mm256_cmpeq_epi32 (sam, zero), _mm256_cmpeq_epi32 (input, zero)), delta);
+        adjust = _mm256_sub_epi32 (_mm256_xor_si256 (adjust, sign), sign);
+
+        // the weights for the second sample include the adjustment from the first
+
+        adjust_first = _mm256_inserti128_si256 (_mm256_setzero_si256 (), _mm256_castsi256_si128 (adjust), 1);
+        weights = _mm256_add_epi32 (_mm256_broadcastsi128_si256 (weight), adjust_first);
+        weight = _mm_add_epi32 (weight, _mm_add_epi32 (_mm256_castsi256_si128 (adjust), _mm256_extracti128_si256 (adjust, 1)));
+
+        output = _mm256_srli_epi64 (_mm256_add_epi64 (_mm256_mul_epi32 (sam, weights), round), 10);
+        output = _mm256_add_epi32 (output, input);
+        _mm_storeu_si128 ((__m128i *) bptr, _mm256_castsi256_si128 (_mm256_permutevar8x32_epi32 (output, pack)));
+    }
+
+    dpp->weight_A = _mm_cvtsi128_si32 (weight);
+    dpp->weight_B = _mm_extract_epi32 (weight, 2);
+
+    if (sample_count & 1)
+        unpack_decorr_stereo_pass_cont_sse41 (dpp, eptr, 1, long_math);
+    else
+        store_history (dpp, eptr);
+}
+
+#endif
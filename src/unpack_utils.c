@@ -18,25 +18,106 @@
 
 #include "wavpack_local.h"
 
+// WavpackUnpackSamplesFormat() decodes this many 32-bit values at a time (for all
+// channels) into a context buffer and then converts them to the requested format.
+// This is small enough that the values will still be in the cache for conversion.
+
+#ifndef UNPACK_FORMAT_SAMPLES
+#define UNPACK_FORMAT_SAMPLES 8192
+#endif
+
+static uint32_t unpack_samples_direct (WavpackContext *wpc, int32_t *buffer, int32_t **planes, uint32_t samples);
+static uint32_t unpack_samples_deinterleave (WavpackContext *wpc, int32_t **planes, uint32_t samples);
+static unsigned char *store_integer_samples (unsigned char *dst, int32_t *src, uint32_t count, int format, int bytes_per_sample, float scaler);
+static unsigned char *store_float_samples (unsigned char *dst, int32_t *src, uint32_t count, int format, int delta_exp, float scaler);
+
 #ifdef ENABLE_THREADS
-static void unpack_samples_enqueue (WavpackStream *wps, int32_t *outbuf, int offset, uint32_t samcnt, int free_wps);
+static uint32_t unpack_samples_readahead (WavpackContext *wpc, int32_t *buffer, uint32_t samples);
+static void unpack_samples_enqueue (WavpackStream *wps, int32_t *outbuf, int32_t **outplanes, int offset, uint32_t samcnt, int free_wps);
 static void worker_threads_finish (WavpackContext *wpc);
 static void worker_threads_create (WavpackContext *wpc);
 static int worker_available (WavpackContext *wpc);
+static void unpack_stream_job (WorkerInfo *cxt, StreamJob *job);
 #endif
 
 ///////////////////////////// executable code ////////////////////////////////
 
 // This function unpacks the specified number of samples from the given stream (which must be
 // completely loaded and initialized). The samples are written (interleaved) into the given
-// buffer at the specified offset. This function is threadsafe across streams, so it may be
-// called directly from the main unpack code or from the worker threads.
+// buffer at the specified offset or, if an array of channel planes is specified instead, into
+// the plane(s) starting at the specified offset. This function is threadsafe across streams, so
+// it may be called directly from the main unpack code or from the worker threads.
 
-static void unpack_samples_interleave (WavpackStream *wps, int32_t *outbuf, int offset, int32_t *tmpbuf, uint32_t samcnt)
+static void unpack_samples_interleave (WavpackStream *wps, int32_t *outbuf, int32_t **outplanes, int offset, int32_t *tmpbuf, uint32_t samcnt)
 {
     int num_channels = wps->wpc->config.num_channels;
     int32_t *src = tmpbuf, *dst = outbuf + offset;
 
+    // for planar output, mono blocks are rendered directly into their plane and stereo blocks
+    // are rendered into the temp buffer and then split into their two planes
+
+    if (outplanes) {
+        int32_t *dst_A = outplanes [offset], *dst_B = offset < num_channels - 1 ? outplanes [offset + 1] : NULL;
+
+#ifdef ENABLE_DSD
+        if (wps->wphdr.flags & DSD_FLAG)
+            unpack_dsd_samples (wps, (wps->wphdr.flags & MONO_FLAG) ? dst_A : tmpbuf, samcnt);
+        else
+#endif
+            unpack_samples (wps, (wps->wphdr.flags & MONO_FLAG) ? dst_A : tmpbuf, samcnt);
+
+        if (wps->wphdr.flags & MONO_FLAG)
+            return;
+
+        if (dst_B)
+            while (samcnt--) {
+                *dst_A++ = *src++;
+                *dst_B++ = *src++;
+            }
+        else
+            while (samcnt--) {
+                *dst_A++ = *src;
+                src += 2;
+            }
+
+        return;
+    }
+
+    // with a channel selection (see WavpackSelectChannels()) we use the temp buffer and copy only the
+    // selected channel(s) of the stream to their positions among the selected channels
+
+    if (wps->wpc->channel_map) {
+        int *channel_map = wps->wpc->channel_map, out_channels = wps->wpc->reduced_channels;
+        int chan_A = channel_map [offset], chan_B = -1;
+
+#ifdef ENABLE_DSD
+        if (wps->wphdr.flags & DSD_FLAG)
+            unpack_dsd_samples (wps, tmpbuf, samcnt);
+        else
+#endif
+            unpack_samples (wps, tmpbuf, samcnt);
+
+        if (wps->wphdr.flags & MONO_FLAG) {
+            for (dst = outbuf + chan_A; samcnt--; dst += out_channels)
+                *dst = *src++;
+
+            return;
+        }
+
+        if (offset < num_channels - 1)
+            chan_B = channel_map [offset + 1];
+
+        for (dst = outbuf; samcnt--; dst += out_channels, src += 2) {
+            if (chan_A >= 0)
+                dst [chan_A] = src [0];
+
+            if (chan_B >= 0)
+                dst [chan_B] = src [1];
+        }
+
+        return;
+    }
+
     // if the number of channels in the stream exactly matches the channels in the file, we
     // don't actually have to interleave and can render directly without the temp buffer
 
@@ -107,11 +188,68 @@ static void unpack_samples_interleave (WavpackStream *wps, int32_t *outbuf, int
 
 uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t samples)
 {
-    int num_channels = wpc->config.num_channels, file_done = FALSE;
-    uint32_t bcount, samples_unpacked = 0, samples_to_unpack;
-    int32_t *bptr = buffer;
+#ifdef ENABLE_THREADS
+    if (wpc->num_workers && !wpc->workers)
+        worker_threads_create (wpc);
 
-    memset (buffer, 0, (wpc->reduced_channels ? wpc->reduced_channels : num_channels) * samples * sizeof (int32_t));
+    wpc->worker_errors = 0;
+#endif
+
+#ifdef ENABLE_LEGACY
+    if (wpc->stream3) {
+        memset (buffer, 0, (wpc->reduced_channels ? wpc->reduced_channels : wpc->config.num_channels) * samples * sizeof (int32_t));
+        return unpack_samples3 (wpc, buffer, samples);
+    }
+#endif
+
+#ifndef NO_SEEKING
+    if (wpc->block_cache.current)
+        return unpack_samples_cached (wpc, buffer, samples);
+#endif
+
+#ifdef ENABLE_THREADS
+    // For mono and stereo files, the only multithreading possible is temporal (i.e., decoding successive
+    // blocks in parallel) and that only works when the request spans multiple blocks. So, if workers
+    // are available, we decode ahead into a context buffer and satisfy smaller requests from that.
+
+    if (wpc->workers && !wpc->reduced_channels && wpc->config.num_channels <= 2)
+        return unpack_samples_readahead (wpc, buffer, samples);
+#endif
+
+    return unpack_samples_direct (wpc, buffer, NULL, samples);
+}
+
+// Unpack the specified number of samples from the current file position into separate buffers
+// for each channel (i.e., planar) instead of interleaving them. The "buffers" parameter points
+// to an array of pointers, one for each channel (or each of the reduced channels if OPEN_2CH_MAX
+// was used), and each must have room for the specified number of samples. The format of the
+// samples and the return value are exactly the same as for WavpackUnpackSamples(). For
+// multichannel files each stream is decoded straight into its own channel planes (mono streams
+// with no copying at all), and otherwise the samples are decoded in pieces and split into planes.
+
+uint32_t WavpackUnpackSamplesPlanar (WavpackContext *wpc, int32_t **buffers, uint32_t samples)
+{
+    int num_channels = wpc->config.num_channels;
+
+    if (!buffers)
+        return 0;
+
+#ifdef ENABLE_LEGACY
+    if (wpc->stream3)
+        return unpack_samples_deinterleave (wpc, buffers, samples);
+#endif
+
+    if (wpc->reduced_channels || num_channels <= 2 || wpc->decimation_context || wpc->block_cache.current)
+        return unpack_samples_deinterleave (wpc, buffers, samples);
+
+    if (!wpc->plane_pointers) {
+        wpc->plane_pointers = malloc (num_channels * sizeof (int32_t *));
+
+        if (!wpc->plane_pointers) {
+            strcpy (wpc->error_message, "can't allocate memory for planar unpacking!");
+            return 0;
+        }
+    }
 
 #ifdef ENABLE_THREADS
     if (wpc->num_workers && !wpc->workers)
@@ -120,15 +258,318 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
     wpc->worker_errors = 0;
 #endif
 
+    return unpack_samples_direct (wpc, NULL, buffers, samples);
+}
+
+// Implement WavpackUnpackSamplesPlanar() for the cases where the streams don't map to the
+// channel planes (or the output must be interleaved for post-processing) by decoding
+// interleaved samples in pieces into a context buffer and splitting them into the planes.
+
+static uint32_t unpack_samples_deinterleave (WavpackContext *wpc, int32_t **planes, uint32_t samples)
+{
+    int num_channels = wpc->reduced_channels ? wpc->reduced_channels : wpc->config.num_channels;
+    uint32_t chunk_samples = UNPACK_FORMAT_SAMPLES / num_channels, samples_unpacked = 0;
+    int chan;
+
+    if (!chunk_samples)
+        chunk_samples = 1;
+
+    if (!wpc->format_buffer) {
+        wpc->format_buffer = malloc (chunk_samples * num_channels * sizeof (int32_t));
+
+        if (!wpc->format_buffer) {
+            strcpy (wpc->error_message, "can't allocate memory for planar unpacking!");
+            return 0;
+        }
+    }
+
+    while (samples) {
+        uint32_t samples_to_unpack = samples < chunk_samples ? samples : chunk_samples, count, i;
+
+        count = WavpackUnpackSamples (wpc, wpc->format_buffer, samples_to_unpack);
+
+        if (!count)
+            break;
+
+        for (chan = 0; chan < num_channels; ++chan) {
+            int32_t *src = wpc->format_buffer + chan, *dst = planes [chan] + samples_unpacked;
+
+            for (i = 0; i < count; ++i, src += num_channels)
+                *dst++ = *src;
+        }
+
+        samples_unpacked += count;
+        samples -= count;
+
+        if (count < samples_to_unpack)
+            break;
+    }
+
+    if (samples)
+        for (chan = 0; chan < num_channels; ++chan)
+            memset (planes [chan] + samples_unpacked, 0, samples * sizeof (int32_t));
+
+    return samples_unpacked;
+}
+
+// Select a subset of the channels of a multichannel file to be returned by WavpackUnpackSamples() (and
+// the other unpacking functions). The channels are specified by their (0-based) indices in the file and
+// are returned in their original order, so the samples then contain WavpackGetReducedChannels() channels.
+// The streams that contain none of the selected channels are skipped over in the file without being
+// decoded (a stereo stream with only one selected channel is decoded, but only that channel returned).
+// A NULL list (or a count of zero) restores all the channels. This may be called at any time, but if
+// a multichannel block is partially decoded (or decoded samples are waiting in the read-ahead buffer)
+// then the file must be seekable so that it can be decoded again from the current position. FALSE is
+// returned (with an error message) for invalid channels, for files with a single stream, with
+// OPEN_2CH_MAX or legacy files, or if the block cache is enabled.
+
+int WavpackSelectChannels (WavpackContext *wpc, const int *channels, int count)
+{
+    int num_channels = wpc->config.num_channels, selected = 0, reposition, chan, i;
+    WavpackStream *wps = wpc->streams [0];
+    int *channel_map = NULL;
+#ifdef ENABLE_DSD
+    void *decimation_context = NULL;
+#endif
+
 #ifdef ENABLE_LEGACY
-    if (wpc->stream3)
-        return unpack_samples3 (wpc, buffer, samples);
+    if (wpc->stream3) {
+        strcpy (wpc->error_message, "can't select channels of legacy files!");
+        return FALSE;
+    }
 #endif
 
+    if ((wpc->reduced_channels && !wpc->channel_map) || (wps->wphdr.flags & FINAL_BLOCK)) {
+        strcpy (wpc->error_message, "can't select channels of a single stream!");
+        return FALSE;
+    }
+
+    // if any stream beyond the first is loaded in the middle of its block, then we'll have to reload
+    // the block (because newly selected streams have not been read) by seeking to where we are, and
+    // the same goes for samples waiting in the read-ahead buffer (which have all the channels)
+
+    reposition = wpc->num_streams > 1 && wps->wphdr.block_samples &&
+        wps->sample_index < GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples;
+
+#ifdef ENABLE_THREADS
+    if (wpc->readahead_pos < wpc->readahead_count)
+        reposition = TRUE;
+#endif
+
+#ifndef NO_SEEKING
+    if (wpc->block_cache.max_bytes) {
+        strcpy (wpc->error_message, "can't select channels with the block cache enabled!");
+        return FALSE;
+    }
+
+    if (reposition && (!wpc->reader->can_seek (wpc->wv_in) || (wpc->open_flags & OPEN_STREAMING) ||
+        (wpc->wvc_flag && !wpc->reader->can_seek (wpc->wvc_in))))
+#else
+    if (reposition)
+#endif
+    {
+        strcpy (wpc->error_message, "can't change the channel selection here!");
+        return FALSE;
+    }
+
+    if (channels && count > 0) {
+        channel_map = (int *)malloc (num_channels * sizeof (int));
+
+        if (!channel_map) {
+            strcpy (wpc->error_message, "can't allocate memory for channel selection!");
+            return FALSE;
+        }
+
+        for (chan = 0; chan < num_channels; ++chan)
+            channel_map [chan] = -1;
+
+        for (i = 0; i < count; ++i)
+            if (channels [i] < 0 || channels [i] >= num_channels) {
+                strcpy (wpc->error_message, "invalid channel selected!");
+                free (channel_map);
+                return FALSE;
+            }
+            else
+                channel_map [channels [i]] = 0;
+
+        for (chan = 0; chan < num_channels; ++chan)
+            if (!channel_map [chan])
+                channel_map [chan] = selected++;
+
+        if (selected == num_channels) {     // selecting everything is the same as no selection
+            free (channel_map);
+            channel_map = NULL;
+        }
+    }
+
+#ifdef ENABLE_DSD
+    if (wpc->decimation_context && !(decimation_context = decimate_dsd_init (channel_map ? selected : num_channels))) {
+        strcpy (wpc->error_message, "can't allocate memory for channel selection!");
+        free (channel_map);
+        return FALSE;
+    }
+
+    if (decimation_context) {
+        decimate_dsd_destroy (wpc->decimation_context);
+        wpc->decimation_context = decimation_context;
+    }
+#endif
+
+    free (wpc->channel_map);
+    wpc->channel_map = channel_map;
+    wpc->reduced_channels = channel_map ? selected : 0;
+
+    if (wpc->format_buffer) {       // this is sized for the number of channels returned
+        free (wpc->format_buffer);
+        wpc->format_buffer = NULL;
+    }
+
+#ifndef NO_SEEKING
+    if (reposition) {
+        int64_t sample = WavpackGetSampleIndex64 (wpc);    // the stream may be ahead (read-ahead)
+
+        free_streams (wpc);
+        return WavpackSeekSample64 (wpc, sample);
+    }
+#endif
+
+    return TRUE;
+}
+
+// Return TRUE if any channel of the stream that starts at the specified channel offset (one channel
+// for mono streams, otherwise two) is selected for decoding (see WavpackSelectChannels()).
+
+int stream_selected (WavpackContext *wpc, int offset, uint32_t flags)
+{
+    int num_channels = wpc->config.num_channels;
+
+    if (offset >= num_channels)
+        return FALSE;
+
+    return wpc->channel_map [offset] >= 0 ||
+        (!(flags & MONO_FLAG) && offset < num_channels - 1 && wpc->channel_map [offset + 1] >= 0);
+}
+
+// Unpack the specified number of samples from the current file position, like WavpackUnpackSamples(),
+// but return them in the caller's final sample format instead of 32-bit integers. The format is one of:
+//
+//   UNPACK_INT16      16-bit signed integers (native endian)
+//   UNPACK_INT24_LE   24-bit signed integers packed into 3 bytes (little-endian)
+//   UNPACK_INT24_BE   24-bit signed integers packed into 3 bytes (big-endian)
+//   UNPACK_FLOAT32    32-bit IEEE floats (native endian)
+//
+// Integer audio is shifted to the requested width (truncating, no dither). Float audio is scaled
+// to full scale and clipped when integers are requested. When floats are requested, integer audio
+// is returned as unscaled integer values and float audio is returned as decoded, unless the
+// UNPACK_NORMALIZE flag is also specified, in which case both are scaled to +/- 1.0 (just like
+// WavpackFloatNormalize() does). Float audio from a file opened with OPEN_NORMALIZE has already been
+// normalized (including any norm_offset specified at open), so it is never scaled again here and
+// UNPACK_NORMALIZE has no effect on it. Samples are decoded in cache-sized pieces into a context buffer and
+// each piece is converted while still in cache, so the caller never needs a full-size 32-bit buffer.
+// DSD audio returned as bitstreams (OPEN_DSD_NATIVE) can't be converted and so returns zero samples.
+
+uint32_t WavpackUnpackSamplesFormat (WavpackContext *wpc, void *buffer, uint32_t samples, int format)
+{
+    int num_channels = wpc->reduced_channels ? wpc->reduced_channels : wpc->config.num_channels;
+    int bytes_per_sample = WavpackGetBytesPerSample (wpc), float_data = (wpc->config.float_norm_exp != 0);
+    int output_bytes = (format & UNPACK_FORMAT_MASK) == UNPACK_INT16 ? 2 : (format & UNPACK_FORMAT_MASK) == UNPACK_FLOAT32 ? 4 : 3;
+    uint32_t chunk_samples = UNPACK_FORMAT_SAMPLES / num_channels, samples_unpacked = 0;
+    unsigned char *dptr = buffer;
+    float scaler = 1.0;
+    int delta_exp = 0;
+
+    if ((format & UNPACK_FORMAT_MASK) < UNPACK_INT16 || (format & UNPACK_FORMAT_MASK) > UNPACK_FLOAT32) {
+        strcpy (wpc->error_message, "invalid unpack format specified!");
+        return 0;
+    }
+
+    if ((WavpackGetQualifyMode (wpc) & QMODE_DSD_AUDIO) && !(wpc->open_flags & OPEN_DSD_AS_PCM)) {
+        strcpy (wpc->error_message, "can't unpack DSD bitstreams to other formats!");
+        return 0;
+    }
+
+    if (!chunk_samples)
+        chunk_samples = 1;
+
+    if (!wpc->format_buffer) {
+        wpc->format_buffer = malloc (chunk_samples * num_channels * sizeof (int32_t));
+
+        if (!wpc->format_buffer) {
+            strcpy (wpc->error_message, "can't allocate memory for unpack format conversion!");
+            return 0;
+        }
+    }
+
+    // for float audio, delta_exp scales the values as decoded to +/- 1.0 (unless OPEN_NORMALIZE
+    // already did that), and for integer outputs the scaler then takes them to full scale; for
+    // integer audio being returned as normalized floats, the scaler takes full scale to +/- 1.0
+
+    if (float_data) {
+        if (!(wpc->open_flags & OPEN_NORMALIZE))
+            delta_exp = 127 - wpc->config.float_norm_exp;
+
+        if ((format & UNPACK_FORMAT_MASK) == UNPACK_INT16)
+            scaler = 32768.0;
+        else if ((format & UNPACK_FORMAT_MASK) != UNPACK_FLOAT32)
+            scaler = 8388608.0;
+        else if (!(format & UNPACK_NORMALIZE))
+            delta_exp = 0;
+    }
+    else if ((format & UNPACK_FORMAT_MASK) == UNPACK_FLOAT32 && (format & UNPACK_NORMALIZE))
+        scaler = 1.0f / (float) (1U << (bytes_per_sample * 8 - 1));
+
+    while (samples) {
+        uint32_t samples_to_unpack = samples < chunk_samples ? samples : chunk_samples, count;
+
+        count = WavpackUnpackSamples (wpc, wpc->format_buffer, samples_to_unpack);
+
+        if (!count)
+            break;
+
+        if (float_data)
+            dptr = store_float_samples (dptr, wpc->format_buffer, count * num_channels, format, delta_exp, scaler);
+        else
+            dptr = store_integer_samples (dptr, wpc->format_buffer, count * num_channels, format, bytes_per_sample, scaler);
+
+        samples_unpacked += count;
+        samples -= count;
+
+        if (count < samples_to_unpack)
+            break;
+    }
+
+    if (samples)
+        memset (dptr, 0, (size_t) samples * num_channels * output_bytes);
+
+    return samples_unpacked;
+}
+
+// This is the actual implementation of WavpackUnpackSamples(), decoding the specified number of
+// samples from the current file position into the given buffer. Temporal and spatial multithreading
+// occur here when worker threads are available. If an array of channel planes is specified instead
+// of a buffer (only for multichannel files without reduced channels or decimation), the samples are
+// written there instead, using the context's plane_pointers[] to track the current position.
+
+static uint32_t unpack_samples_direct (WavpackContext *wpc, int32_t *buffer, int32_t **planes, uint32_t samples)
+{
+    int num_channels = wpc->config.num_channels, file_done = FALSE, chan;
+    uint32_t bcount, samples_unpacked = 0, samples_to_unpack;
+    int32_t *bptr = buffer;
+
+    if (buffer)
+        memset (buffer, 0, (wpc->reduced_channels ? wpc->reduced_channels : num_channels) * samples * sizeof (int32_t));
+    else
+        for (chan = 0; chan < num_channels; ++chan)
+            memset (planes [chan], 0, samples * sizeof (int32_t));
+
     while (samples) {
         WavpackStream *wps = wpc->streams [0];
         int stream_index = 0;
 
+        if (planes)
+            for (chan = 0; chan < num_channels; ++chan)
+                wpc->plane_pointers [chan] = planes [chan] + samples_unpacked;
+
         // if the current block has no audio, or it's not the first block of a multichannel
         // sequence, or the sample we're on is past the last sample in this block...we need
         // to free up the streams and read the next block
@@ -149,28 +590,21 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
 
                 wpc->filepos = nexthdrpos + bcount;
 
-                // allocate the memory for the entire raw block and read it in
+                // get the entire raw block (either read into a buffer or directly from memory)
 
-                wps->blockbuff = (unsigned char *)malloc (wps->wphdr.ckSize + 8);
+                wps->blockbuff = read_block_buffer (wpc, wpc->wv_in, &wps->wphdr, &wps->blockbuff_size);
 
-                if (!wps->blockbuff)
+                if (!wps->blockbuff) {
+                    strcpy (wpc->error_message, "can't read all of last block!");
+                    wps->wphdr.block_samples = 0;
+                    wps->wphdr.ckSize = 24;
                     break;
-
-                memcpy (wps->blockbuff, &wps->wphdr, 32);
-
-                if (wpc->reader->read_bytes (wpc->wv_in, wps->blockbuff + 32, wps->wphdr.ckSize - 24) !=
-                    wps->wphdr.ckSize - 24) {
-                        strcpy (wpc->error_message, "can't read all of last block!");
-                        wps->wphdr.block_samples = 0;
-                        wps->wphdr.ckSize = 24;
-                        break;
                 }
 
                 // render corrupt blocks harmless
                 if (!WavpackVerifySingleBlock (wps->blockbuff, !(wpc->open_flags & OPEN_NO_CHECKSUM))) {
                     wps->wphdr.ckSize = sizeof (WavpackHeader) - 8;
                     wps->wphdr.block_samples = 0;
-                    memcpy (wps->blockbuff, &wps->wphdr, 32);
                 }
 
                 // potentially adjusting block_index must be done AFTER verifying block
@@ -180,12 +614,19 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
                 else
                     SET_BLOCK_INDEX (wps->wphdr, GET_BLOCK_INDEX (wps->wphdr) - wpc->initial_index);
 
-                memcpy (wps->blockbuff, &wps->wphdr, 32);
+                store_block_header (wpc, &wps->blockbuff, &wps->blockbuff_size, &wps->wphdr);
                 wps->init_done = FALSE;     // we have not yet called unpack_init() for this block
 
+#ifndef NO_SEEKING
+                // remember where verified blocks are so that seeking back to them won't require a search
+
+                if (wps->wphdr.block_samples && (wps->wphdr.flags & INITIAL_BLOCK) && !(wpc->open_flags & OPEN_STREAMING))
+                    block_index_add (&wpc->wv_index, GET_BLOCK_INDEX (wps->wphdr), wpc->filepos, wps->wphdr.block_samples);
+#endif
+
                 // if this block has audio, but not the sample index we were expecting, flag an error
 
-                if (!wpc->reduced_channels && wps->wphdr.block_samples && wps->sample_index != GET_BLOCK_INDEX (wps->wphdr))
+                if ((!wpc->reduced_channels || wpc->channel_map) && wps->wphdr.block_samples && wps->sample_index != GET_BLOCK_INDEX (wps->wphdr))
                     wpc->crc_errors++;
 
                 // if this block has audio, and we're in hybrid lossless mode, read the matching wvc block
@@ -233,6 +674,18 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
             samples_unpacked += samples_to_unpack;
             samples -= samples_to_unpack;
 
+            if (planes) {
+                for (chan = 0; chan < num_channels; ++chan) {
+                    int32_t *zptr = wpc->plane_pointers [chan];
+                    uint32_t zcount = samples_to_unpack;
+
+                    while (zcount--)
+                        *zptr++ = zvalue;
+                }
+
+                continue;
+            }
+
             samples_to_unpack *= (wpc->reduced_channels ? wpc->reduced_channels : num_channels);
 
             while (samples_to_unpack--)
@@ -257,7 +710,7 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
         // if this block is not the final block of a multichannel sequence (and we're not truncating
         // to stereo), then enter this conditional block...otherwise we just unpack the samples directly
 
-        if (!wpc->reduced_channels && !(wps->wphdr.flags & FINAL_BLOCK)) {
+        if ((!wpc->reduced_channels || wpc->channel_map) && !(wps->wphdr.flags & FINAL_BLOCK)) {
             int32_t *temp_buffer = (int32_t *)calloc (1, samples_to_unpack * 8);
             uint32_t offset = 0;     // offset to next channel in sequence (0 to num_channels - 1)
 
@@ -289,64 +742,75 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
                         break;
                     }
 
-                    wps->blockbuff = (unsigned char *)malloc (wps->wphdr.ckSize + 8);
-
-                    if (!wps->blockbuff)
-                        break;
+                    // if none of this stream's channels are selected, we skip its block (and its wvc block)
+                    // without reading or initializing them
 
-                    memcpy (wps->blockbuff, &wps->wphdr, 32);
-
-                    if (wpc->reader->read_bytes (wpc->wv_in, wps->blockbuff + 32, wps->wphdr.ckSize - 24) !=
-                        wps->wphdr.ckSize - 24) {
+                    if (wpc->channel_map && !stream_selected (wpc, offset, wps->wphdr.flags)) {
+                        if (!skip_stream_block (wpc, stream_index)) {
                             wpc->streams [0]->wphdr.block_samples = 0;
                             wpc->streams [0]->wphdr.ckSize = 24;
                             file_done = TRUE;
                             break;
+                        }
                     }
+                    else {
+                        wps->blockbuff = read_block_buffer (wpc, wpc->wv_in, &wps->wphdr, &wps->blockbuff_size);
 
-                    // render corrupt blocks harmless
-                    if (!WavpackVerifySingleBlock (wps->blockbuff, !(wpc->open_flags & OPEN_NO_CHECKSUM))) {
-                        wps->wphdr.ckSize = sizeof (WavpackHeader) - 8;
-                        wps->wphdr.block_samples = 0;
-                        memcpy (wps->blockbuff, &wps->wphdr, 32);
-                    }
+                        if (!wps->blockbuff) {
+                            wpc->streams [0]->wphdr.block_samples = 0;
+                            wpc->streams [0]->wphdr.ckSize = 24;
+                            file_done = TRUE;
+                            break;
+                        }
 
-                    // potentially adjusting block_index must be done AFTER verifying block
+                        // render corrupt blocks harmless
+                        if (!WavpackVerifySingleBlock (wps->blockbuff, !(wpc->open_flags & OPEN_NO_CHECKSUM))) {
+                            wps->wphdr.ckSize = sizeof (WavpackHeader) - 8;
+                            wps->wphdr.block_samples = 0;
+                        }
 
-                    if (wpc->open_flags & OPEN_STREAMING)
-                        SET_BLOCK_INDEX (wps->wphdr, wps->sample_index = 0);
-                    else
-                        SET_BLOCK_INDEX (wps->wphdr, GET_BLOCK_INDEX (wps->wphdr) - wpc->initial_index);
+                        // potentially adjusting block_index must be done AFTER verifying block
 
-                    memcpy (wps->blockbuff, &wps->wphdr, 32);
+                        if (wpc->open_flags & OPEN_STREAMING)
+                            SET_BLOCK_INDEX (wps->wphdr, wps->sample_index = 0);
+                        else
+                            SET_BLOCK_INDEX (wps->wphdr, GET_BLOCK_INDEX (wps->wphdr) - wpc->initial_index);
 
-                    // if this block has audio, and we're in hybrid lossless mode, read the matching wvc block
+                        store_block_header (wpc, &wps->blockbuff, &wps->blockbuff_size, &wps->wphdr);
 
-                    if (wpc->wvc_flag)
-                        read_wvc_block (wpc, stream_index);
+                        // if this block has audio, and we're in hybrid lossless mode, read the matching wvc block
 
-                    // initialize the unpacker for this block
+                        if (wpc->wvc_flag)
+                            read_wvc_block (wpc, stream_index);
 
-                    if (!unpack_init (wpc, stream_index))
-                        wpc->crc_errors++;
+                        // initialize the unpacker for this block
 
-                    wps->init_done = TRUE;
+                        if (!unpack_init (wpc, stream_index))
+                            wpc->crc_errors++;
+
+                        wps->init_done = TRUE;
+                    }
                 }
                 else
                     wps = wpc->streams [stream_index];
 
+                // streams with none of their channels selected are not decoded, but must stay in step
+
+                if (wpc->channel_map && !stream_selected (wpc, offset, wps->wphdr.flags))
+                    wps->sample_index += samples_to_unpack;
+
 #ifdef ENABLE_THREADS
-                // If there is a worker thread available, and there have been no errors, and this is not
-                // the final block of the multichannel stream, then give it to a worker thread to decode.
-                // To reduce context switches, we do the final block in the foreground because we have to
-                // wait around anyway for all the workers to complete.
+                // If there are worker threads, and there have been no errors, then add this stream to the
+                // jobs for this block, which are run by the workers (and this thread) once all the streams
+                // have been read (see run_stream_jobs()). Otherwise (or if that fails) we decode it here.
 
-                if (worker_available (wpc) && !wps->mute_error && !(wps->wphdr.flags & FINAL_BLOCK))
-                    unpack_samples_enqueue (wps, bptr, offset, samples_to_unpack, FALSE);
+                else if (!wpc->workers || wps->mute_error ||
+                    !add_stream_job (wpc, wps, bptr, planes ? wpc->plane_pointers : NULL, offset, samples_to_unpack))
+#else
                 else
 #endif
                 {
-                    unpack_samples_interleave (wps, bptr, offset, temp_buffer, samples_to_unpack);
+                    unpack_samples_interleave (wps, bptr, planes ? wpc->plane_pointers : NULL, offset, temp_buffer, samples_to_unpack);
 
                     if (wps->sample_index == GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples && wps->mute_error)
                         wpc->crc_errors++;
@@ -370,6 +834,11 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
             }
 
 #ifdef ENABLE_THREADS
+            if (wpc->num_stream_jobs) {
+                run_stream_jobs (wpc, unpack_stream_job, temp_buffer, samples_to_unpack);
+                wpc->num_stream_jobs = 0;
+            }
+
             worker_threads_finish (wpc);    // for multichannel, wait for all threads to finish before freeing anything
 #endif
 
@@ -377,16 +846,31 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
 
             // if we didn't get all the channels we expected, mute the buffer and flag an error
 
-            if (offset != num_channels) {
+            if (offset != num_channels && planes) {
+                int32_t zvalue = (wps->wphdr.flags & DSD_FLAG) ? 0x55 : 0;
+
+                for (chan = 0; chan < num_channels; ++chan) {
+                    int32_t *zptr = wpc->plane_pointers [chan];
+                    uint32_t zcount = samples_to_unpack;
+
+                    while (zcount--)
+                        *zptr++ = zvalue;
+                }
+
+                wpc->crc_errors++;
+            }
+            else if (offset != num_channels) {
+                int out_channels = wpc->reduced_channels ? wpc->reduced_channels : num_channels;
+
                 if (wps->wphdr.flags & DSD_FLAG) {
-                    int samples_to_zero = samples_to_unpack * num_channels;
+                    int samples_to_zero = samples_to_unpack * out_channels;
                     int32_t *zptr = bptr;
 
                     while (samples_to_zero--)
                         *zptr++ = 0x55;
                 }
                 else
-                    memset (bptr, 0, samples_to_unpack * num_channels * 4);
+                    memset (bptr, 0, samples_to_unpack * out_channels * 4);
 
                 wpc->crc_errors++;
             }
@@ -409,7 +893,7 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
         // decode to completion. Because we are going to continue decoding the next block in this stream before this
         // one completes, we must make a copy of the stream that can decode in isolation, and we instruct the worker
         // thread to free everything associated with the stream context when it's done.
-        else if (worker_available (wpc) && !wps->mute_error &&
+        else if (!planes && worker_available (wpc) && !wps->mute_error &&
             wps->sample_index + samples_to_unpack == GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples &&
             wps->sample_index + samples > GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples) {
                 WavpackStream *wps_copy = malloc (sizeof (WavpackStream));
@@ -432,9 +916,24 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
                 wps->dsd.ptable = NULL;
 #endif
 
-                unpack_samples_enqueue (wps_copy, bptr, 0, samples_to_unpack, TRUE);
+                unpack_samples_enqueue (wps_copy, bptr, NULL, 0, samples_to_unpack, TRUE);
         }
 #endif
+        else if (planes) {
+            // with planar output, a lone block (which can only happen with a corrupt multichannel
+            // file) goes into the first channel plane(s) via a temp buffer
+            int32_t *temp_buffer = (int32_t *)calloc (1, samples_to_unpack * 8);
+
+            if (temp_buffer) {
+                unpack_samples_interleave (wps, NULL, wpc->plane_pointers, 0, temp_buffer, samples_to_unpack);
+                free (temp_buffer);
+            }
+            else
+                wps->sample_index += samples_to_unpack;
+
+            if (wps->sample_index == GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples && wps->mute_error)
+                wpc->crc_errors++;
+        }
         else {
 #ifdef ENABLE_DSD
             if (wps->wphdr.flags & DSD_FLAG)
@@ -452,10 +951,8 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
             break;
         }
 
-        if (wpc->reduced_channels)
-            bptr += samples_to_unpack * wpc->reduced_channels;
-        else
-            bptr += samples_to_unpack * num_channels;
+        if (!planes)    // (planes are advanced at the top of the loop)
+            bptr += samples_to_unpack * (wpc->reduced_channels ? wpc->reduced_channels : num_channels);
 
         samples_unpacked += samples_to_unpack;
         samples -= samples_to_unpack;
@@ -469,20 +966,273 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
 #endif
 
 #ifdef ENABLE_DSD
-    if (wpc->decimation_context)    // TODO: this could be parallelized too
+    if (wpc->decimation_context && !planes)     // TODO: this could be parallelized too
         decimate_dsd_run (wpc->decimation_context, buffer, samples_unpacked);
 #endif
 
     return samples_unpacked;
 }
 
+// Convert integer audio, right-justified in 32-bit words with the given bytes per sample, to the format
+// specified for WavpackUnpackSamplesFormat(). The scaler is only used for floating-point output.
+// Returns a pointer to the end of the converted data.
+
+static unsigned char *store_integer_samples (unsigned char *dst, int32_t *src, uint32_t count, int format, int bytes_per_sample, float scaler)
+{
+    int shift = (format & UNPACK_FORMAT_MASK) == UNPACK_INT16 ? 16 - bytes_per_sample * 8 : 24 - bytes_per_sample * 8;
+    int32_t temp;
+
+    switch (format & UNPACK_FORMAT_MASK) {
+        case UNPACK_INT16: {
+            int16_t *sptr = (int16_t *) dst;
+
+            if (shift >= 0)
+                while (count--)
+                    *sptr++ = (int16_t) ((uint32_t) *src++ << shift);
+            else
+                while (count--)
+                    *sptr++ = (int16_t) (*src++ >> -shift);
+
+            return (unsigned char *) sptr;
+        }
+
+        case UNPACK_INT24_LE:
+            while (count--) {
+                temp = shift >= 0 ? (int32_t) ((uint32_t) *src++ << shift) : *src++ >> -shift;
+                *dst++ = (unsigned char) temp;
+                *dst++ = (unsigned char) (temp >> 8);
+                *dst++ = (unsigned char) (temp >> 16);
+            }
+
+            return dst;
+
+        case UNPACK_INT24_BE:
+            while (count--) {
+                temp = shift >= 0 ? (int32_t) ((uint32_t) *src++ << shift) : *src++ >> -shift;
+                *dst++ = (unsigned char) (temp >> 16);
+                *dst++ = (unsigned char) (temp >> 8);
+                *dst++ = (unsigned char) temp;
+            }
+
+            return dst;
+
+        default: {
+            float *fptr = (float *) dst;
+
+            while (count--)
+                *fptr++ = *src++ * scaler;
+
+            return (unsigned char *) fptr;
+        }
+    }
+}
+
+// Round a float value to the nearest integer, clipping to the range -(max_value + 1) to max_value
+// (NaNs become zero).
+
+static int32_t float_to_integer (float value, int32_t max_value)
+{
+    if (value >= 0.0) {
+        if (value >= max_value)
+            return max_value;
+
+        return (int32_t) (value + 0.5);
+    }
+    else if (value < 0.0) {
+        if (value <= -max_value - 1.0)
+            return -max_value - 1;
+
+        return -(int32_t) (0.5 - value);
+    }
+
+    return 0;
+}
+
+// Convert float audio (as decoded) to the format specified for WavpackUnpackSamplesFormat(). Note
+// that the source buffer is modified. The delta_exp value normalizes the audio to +/- 1.0 and the
+// scaler then takes that to full scale for integer output (with rounding and clipping). Returns a
+// pointer to the end of the converted data.
+
+static unsigned char *store_float_samples (unsigned char *dst, int32_t *src, uint32_t count, int format, int delta_exp, float scaler)
+{
+    float *fptr = (float *) src;
+    int32_t temp;
+
+    WavpackFloatNormalize (src, count, delta_exp);
+
+    switch (format & UNPACK_FORMAT_MASK) {
+        case UNPACK_INT16: {
+            int16_t *sptr = (int16_t *) dst;
+
+            while (count--) {
+                temp = float_to_integer (*fptr++ * scaler, 32767);
+                *sptr++ = (int16_t) temp;
+            }
+
+            return (unsigned char *) sptr;
+        }
+
+        case UNPACK_INT24_LE:
+            while (count--) {
+                temp = float_to_integer (*fptr++ * scaler, 8388607);
+                *dst++ = (unsigned char) temp;
+                *dst++ = (unsigned char) (temp >> 8);
+                *dst++ = (unsigned char) (temp >> 16);
+            }
+
+            return dst;
+
+        case UNPACK_INT24_BE:
+            while (count--) {
+                temp = float_to_integer (*fptr++ * scaler, 8388607);
+                *dst++ = (unsigned char) (temp >> 16);
+                *dst++ = (unsigned char) (temp >> 8);
+                *dst++ = (unsigned char) temp;
+            }
+
+            return dst;
+
+        default:
+            memcpy (dst, src, count * sizeof (float));
+            return dst + count * sizeof (float);
+    }
+}
+
 ///////////////////////////// multithreading code ////////////////////////////////
 
 #ifdef ENABLE_THREADS
 
-// This is the worker thread function for unpacking support, essentially allowing
+// Unpack samples from a mono or stereo file using a read-ahead buffer. When the buffer is empty, we
+// decode enough samples to finish the current block plus one additional block for each worker thread,
+// which allows unpack_samples_direct() to hand each of those blocks to a worker. The caller is then
+// served from this buffer. Requests large enough to span the whole read-ahead window are decoded
+// directly into the caller's buffer because they already get full temporal multithreading.
+
+static uint32_t unpack_samples_readahead (WavpackContext *wpc, int32_t *buffer, uint32_t samples)
+{
+    int num_channels = wpc->config.num_channels;
+    uint32_t samples_unpacked = 0;
+
+    while (samples) {
+        uint32_t samples_to_copy;
+
+        if (wpc->readahead_pos == wpc->readahead_count) {
+            WavpackStream *wps = wpc->streams [0];
+            uint32_t block_samples = wps->wphdr.block_samples, readahead_samples, remaining = 0;
+
+            wpc->readahead_pos = wpc->readahead_count = 0;
+
+            if (!block_samples)
+                block_samples = wpc->readahead_block_samples;
+            else
+                wpc->readahead_block_samples = block_samples;
+
+            // if we're partway through a block, the first read-ahead "block" is just the rest of that one
+
+            if (wps->wphdr.block_samples && (wps->wphdr.flags & INITIAL_BLOCK) &&
+                wps->sample_index >= GET_BLOCK_INDEX (wps->wphdr) &&
+                wps->sample_index < GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples)
+                    remaining = (uint32_t) (GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples - wps->sample_index);
+
+            readahead_samples = block_samples * wpc->num_workers + (remaining ? remaining : block_samples);
+
+            if (!block_samples || samples >= readahead_samples)
+                return samples_unpacked + unpack_samples_direct (wpc, buffer, NULL, samples);
+
+            if (readahead_samples > wpc->readahead_size) {
+                free (wpc->readahead_buffer);
+                wpc->readahead_buffer = malloc (readahead_samples * num_channels * sizeof (int32_t));
+                wpc->readahead_size = wpc->readahead_buffer ? readahead_samples : 0;
+
+                if (!wpc->readahead_buffer)
+                    return samples_unpacked + unpack_samples_direct (wpc, buffer, NULL, samples);
+            }
+
+            wpc->readahead_count = unpack_samples_direct (wpc, wpc->readahead_buffer, NULL, readahead_samples);
+
+            if (!wpc->readahead_count) {
+                memset (buffer, 0, num_channels * samples * sizeof (int32_t));
+                break;
+            }
+        }
+
+        samples_to_copy = wpc->readahead_count - wpc->readahead_pos;
+
+        if (samples_to_copy > samples)
+            samples_to_copy = samples;
+
+        memcpy (buffer, wpc->readahead_buffer + wpc->readahead_pos * num_channels, samples_to_copy * num_channels * sizeof (int32_t));
+        wpc->readahead_pos += samples_to_copy;
+        buffer += samples_to_copy * num_channels;
+        samples_unpacked += samples_to_copy;
+        samples -= samples_to_copy;
+    }
+
+    return samples_unpacked;
+}
+
+// This is the job performed by the workers for unpacking support, essentially allowing
 // unpack_samples_interleave() to be running for multiple streams simultaneously.
 
+static int32_t *worker_temp_buffer (WorkerInfo *cxt, uint32_t samcnt);
+
+static void unpack_samples_job (WorkerInfo *cxt)
+{
+    int32_t *temp_buffer = worker_temp_buffer (cxt, cxt->samcnt);
+
+    // this is where the work is done
+    if (temp_buffer)
+        unpack_samples_interleave (cxt->wps, cxt->outbuf, cxt->outplanes, cxt->offset, temp_buffer, cxt->samcnt);
+
+    if (!temp_buffer || cxt->wps->mute_error) {     // this is where we pass back decoding errors
+        wp_mutex_obtain (*cxt->mutex);
+        (*cxt->worker_errors)++;
+        wp_mutex_release (*cxt->mutex);
+    }
+
+    if (cxt->free_wps) {                            // if instructed, free the WavpackStream context
+        free_single_stream (cxt->wps);
+        free (cxt->wps);
+    }
+}
+
+// This is the job function for decoding one stream of a multichannel block (see run_stream_jobs()).
+// For the final stream we only count an error once the whole block is decoded, as we always have.
+
+static void unpack_stream_job (WorkerInfo *cxt, StreamJob *job)
+{
+    int32_t *temp_buffer = worker_temp_buffer (cxt, job->samcnt);
+    WavpackStream *wps = job->wps;
+
+    if (temp_buffer)
+        unpack_samples_interleave (wps, job->outbuf, job->outplanes, job->offset, temp_buffer, job->samcnt);
+
+    if (!temp_buffer || (wps->mute_error && (!(wps->wphdr.flags & FINAL_BLOCK) ||
+        wps->sample_index == GET_BLOCK_INDEX (wps->wphdr) + wps->wphdr.block_samples))) {
+            wp_mutex_obtain (*cxt->mutex);
+            (*cxt->worker_errors)++;
+            wp_mutex_release (*cxt->mutex);
+    }
+}
+
+// Return the worker's temp buffer, reallocated if not big enough for the specified samples
+// (NULL if that fails)
+
+static int32_t *worker_temp_buffer (WorkerInfo *cxt, uint32_t samcnt)
+{
+    if (samcnt > cxt->temp_samples) {
+        free (cxt->temp_buffer);
+        cxt->temp_buffer = (int32_t *) calloc (cxt->temp_samples = samcnt, 8);
+
+        if (!cxt->temp_buffer)
+            cxt->temp_samples = 0;
+    }
+
+    return cxt->temp_buffer;
+}
+
+// This is the worker thread function for unpacking support (when the context has its own threads)
+
 #ifdef _WIN32
 static unsigned WINAPI unpack_samples_worker_thread (LPVOID param)
 #else
@@ -490,8 +1240,6 @@ static void *unpack_samples_worker_thread (void *param)
 #endif
 {
     WorkerInfo *cxt = param;
-    int32_t *temp_buffer = NULL;
-    uint32_t temp_samples = 0;
 
     while (1) {
         wp_mutex_obtain (*cxt->mutex);
@@ -507,45 +1255,20 @@ static void *unpack_samples_worker_thread (void *param)
         if (cxt->state == Quit)                     // break out if we're done
             break;
 
-        if (cxt->samcnt > temp_samples) {           // reallocate temp buffer if not big enough
-            temp_buffer = (int32_t *) realloc (temp_buffer, (temp_samples = cxt->samcnt) * 8);
-
-            if (!temp_buffer) {                     // handle NULL return to satisfy Copilot
-                wp_mutex_obtain (*cxt->mutex);
-                (*cxt->worker_errors)++;
-                wp_mutex_release (*cxt->mutex);
-                break;
-            }
-
-            memset (temp_buffer, 0, temp_samples * 8);
-        }
-
-        // this is where the work is done
-        unpack_samples_interleave (cxt->wps, cxt->outbuf, cxt->offset, temp_buffer, cxt->samcnt);
-
-        if (cxt->wps->mute_error) {                 // this is where we pass back decoding errors
-            wp_mutex_obtain (*cxt->mutex);
-            (*cxt->worker_errors)++;
-            wp_mutex_release (*cxt->mutex);
-        }
-
-        if (cxt->free_wps) {                        // if instructed, free the WavpackStream context
-            free_single_stream (cxt->wps);
-            free (cxt->wps);
-        }
+        cxt->job (cxt);
     }
 
-    free (temp_buffer);
     wp_thread_exit (0);
     return 0;
 }
 
 // Send the given stream to an available worker thread. In the background, the stream will be
-// unpacked and written (interleaved) to the given buffer at the specified offset. The "free_wps"
+// unpacked and written (interleaved) to the given buffer at the specified offset, or to the
+// channel plane(s) at the specified offset if an array of planes is given. The "free_wps"
 // flag indicates that the WavpackStream structure should be freed once the unpack operation is
 // complete because it is a copy of the original created for this operation only.
 
-static void unpack_samples_enqueue (WavpackStream *wps, int32_t *outbuf, int offset, uint32_t samcnt, int free_wps)
+static void unpack_samples_enqueue (WavpackStream *wps, int32_t *outbuf, int32_t **outplanes, int offset, uint32_t samcnt, int free_wps)
 {
     WavpackContext *wpc = (WavpackContext *) wps->wpc;  // this is safe here because single-threaded
     int i;
@@ -560,10 +1283,17 @@ static void unpack_samples_enqueue (WavpackStream *wps, int32_t *outbuf, int off
             wpc->workers [i].wps = wps;
             wpc->workers [i].state = Running;
             wpc->workers [i].outbuf = outbuf;
+            wpc->workers [i].outplanes = outplanes;
             wpc->workers [i].offset = offset;
             wpc->workers [i].samcnt = samcnt;
             wpc->workers [i].free_wps = free_wps;
-            wp_condvar_signal (wpc->workers [i].worker_cond);
+            wpc->workers [i].job = unpack_samples_job;
+
+            if (wpc->thread_pool)
+                thread_pool_submit (wpc->thread_pool, &wpc->workers [i]);
+            else
+                wp_condvar_signal (wpc->workers [i].worker_cond);
+
             wpc->workers_ready--;
             break;
         }
@@ -588,8 +1318,9 @@ static void worker_threads_finish (WavpackContext *wpc)
     }
 }
 
-// Create the worker thread contexts and start the threads
-// (which should all quickly go to the ready state)
+// Create the worker thread contexts and start the threads (which should all quickly go
+// to the ready state). If a shared thread pool is installed, the workers are simply
+// marked ready and their jobs are run by the pool's threads instead.
 
 static void worker_threads_create (WavpackContext *wpc)
 {
@@ -600,13 +1331,24 @@ static void worker_threads_create (WavpackContext *wpc)
         wp_condvar_init (wpc->global_cond);
 
         wpc->workers = calloc (wpc->num_workers, sizeof (WorkerInfo));
+        wpc->thread_pool = thread_pool_attach ();
 
         for (i = 0; i < wpc->num_workers; ++i) {
             wpc->workers [i].mutex = &wpc->mutex;
             wpc->workers [i].global_cond = &wpc->global_cond;
             wpc->workers [i].workers_ready = &wpc->workers_ready;
             wpc->workers [i].worker_errors = &wpc->worker_errors;
+            wpc->workers [i].done_state = Ready;
+            wpc->workers [i].wpc = wpc;
+            wpc->workers [i].index = i;
             wp_condvar_init (wpc->workers [i].worker_cond);
+
+            if (wpc->thread_pool) {
+                wpc->workers [i].state = Ready;
+                wpc->workers_ready++;
+                continue;
+            }
+
             wp_thread_create (wpc->workers [i].thread, unpack_samples_worker_thread, &wpc->workers [i]);
 
             // gracefully handle failures in creating worker threads
@@ -60,7 +60,9 @@ typedef __int8  int8_t;
 // This implements portable multithreading via typedefs and macros for either
 // pthreads or native Windows threads. This is easy since the synchronization
 // constructs we are using (condition variables and mutexes / critical
-// sections) are available on both platforms with similar behavior.
+// sections) are available on both platforms with similar behavior. There is
+// also one-time initialization (for wp_call_once()), which without threads
+// is just a flag.
 
 #ifdef ENABLE_THREADS
 
@@ -81,6 +83,7 @@ typedef __int8  int8_t;
 typedef CONDITION_VARIABLE      wp_condvar_t;
 #define wp_condvar_init(x)      InitializeConditionVariable(&x)
 #define wp_condvar_signal(x)    WakeConditionVariable(&x)
+#define wp_condvar_broadcast(x) WakeAllConditionVariable(&x)
 #define wp_condvar_wait(x,y)    SleepConditionVariableCS(&x,&y,INFINITE)
 #define wp_condvar_delete(x)
 
@@ -96,6 +99,9 @@ typedef HANDLE                  wp_thread_t;
 #define wp_thread_delete(x)     CloseHandle(x);
 #define wp_thread_exit(x)       _endthreadex(x);
 
+typedef INIT_ONCE               wp_once_t;
+#define WP_ONCE_INIT            INIT_ONCE_STATIC_INIT
+
 #else
 
 #include <pthread.h>
@@ -103,6 +109,7 @@ typedef HANDLE                  wp_thread_t;
 typedef pthread_cond_t          wp_condvar_t;
 #define wp_condvar_init(x)      pthread_cond_init(&x,NULL);
 #define wp_condvar_signal(x)    pthread_cond_signal(&x)
+#define wp_condvar_broadcast(x) pthread_cond_broadcast(&x)
 #define wp_condvar_wait(x,y)    pthread_cond_wait(&x,&y)
 #define wp_condvar_delete(x)    pthread_cond_destroy(&x)
 
@@ -118,8 +125,16 @@ typedef pthread_t               wp_thread_t;
 #define wp_thread_delete(x)
 #define wp_thread_exit(x)       pthread_exit(x);
 
+typedef pthread_once_t          wp_once_t;
+#define WP_ONCE_INIT            PTHREAD_ONCE_INIT
+
 #endif
 
+#else
+
+typedef int                     wp_once_t;
+#define WP_ONCE_INIT            0
+
 #endif
 
 // Because the C99 specification states that "The order of allocation of
@@ -214,7 +229,7 @@ typedef struct {
  * very important because once the file has been encoded, the config bits are
  * just for information purposes (i.e., they do not affect decoding),
  *
-#define CONFIG_ADOBE_MODE       0x100   // "adobe" mode for 32-bit floats
+#define CONFIG_ADOBE_MODE       0x100   // "adobe" mode for 32-bit floats (now CONFIG_SEEK_TABLE)
 #define CONFIG_VERY_FAST_FLAG   0x400   // double fast
 #define CONFIG_COPY_TIME        0x20000 // copy file-time from source
 #define CONFIG_QUALITY_MODE     0x200000 // psychoacoustic quality mode
@@ -306,9 +321,10 @@ typedef struct {
 
     unsigned char *blockbuff, *blockend;
     unsigned char *block2buff, *block2end;
+    uint32_t blockbuff_size, block2buff_size;   // non-zero only if buffers came from the context pool
     int32_t *sample_buffer, *pre_sample_buffer;
     uint32_t num_pre_samples;
-    int discontinuous;
+    int discontinuous, parallel_search;   // "parallel_search" means extra modes may use idle workers
 
     int64_t sample_index;
     int bits, num_terms, mute_error, joint_stereo, false_stereo, shift, lossy_blocks;
@@ -326,7 +342,7 @@ typedef struct {
         int32_t shaping_acc [2], shaping_delta [2], error [2];
         double noise_sum, noise_ave, noise_max;
         int16_t *shaping_data, *shaping_array;
-        int32_t shaping_samples;
+        int32_t shaping_samples, shaping_done;
     } dc;
 
     struct decorr_pass decorr_passes [MAX_NTERMS], analysis_pass;
@@ -359,23 +375,133 @@ typedef struct {
 
 #ifdef ENABLE_THREADS
 
+// This is the total number of worker threads specified in the open flags (see OPEN_THREADS()),
+// and the most that are used for temporal multithreading of mono and stereo files (because for
+// those, more workers just means more blocks in flight and not more speed)
+
+#define OPEN_FLAGS_THREADS(f) ((((f) & OPEN_THREADS_MASK) >> OPEN_THREADS_SHFT) | \
+    (((f) & OPEN_THREADS_HIGH_MASK) >> (OPEN_THREADS_HIGH_SHFT - 4)))
+
+#define MAX_TEMPORAL_WORKERS 15
+
 // Each worker thread owns one of these contexts during its lifetime
 
 typedef enum { Uninit, Ready, Running, Done, Quit } WorkerState;
 
-typedef struct {
+typedef struct workerinfo {
     WavpackStream *wps;
     WorkerState state;
     int *workers_ready, *worker_errors;
-    int32_t *outbuf;
-    uint32_t samcnt, offset;
+    int32_t *outbuf, **outplanes, *temp_buffer;
+    uint32_t samcnt, offset, temp_samples;
     int result, free_wps;
 
     wp_condvar_t *global_cond, worker_cond;
     wp_mutex_t *mutex;
     wp_thread_t thread;
+
+    // when the context uses a shared thread pool there is no thread, and instead the
+    // job is queued to the pool, which moves the worker to "done_state" on completion
+
+    void (*job) (struct workerinfo *cxt);
+    struct workerinfo *next_job;
+    WorkerState done_state;
+
+    WavpackContext *wpc;            // for running stream jobs (see run_stream_jobs())
+    int index;
 } WorkerInfo;
 
+// For multichannel blocks, each stream is a job that is run by the workers and the calling thread
+// together. Each of them starts with a range of jobs and then steals from the others (see
+// run_stream_jobs()). The output parameters are only used for decoding, and the result only
+// for encoding.
+
+typedef struct {
+    WavpackStream *wps;
+    int32_t *outbuf, **outplanes;
+    uint32_t offset, samcnt;
+    int result;
+} StreamJob;
+
+typedef struct {
+    int head, tail;
+} StreamJobRange;
+
+// This is a pool of worker threads that can be shared by all contexts (instead of each
+// starting its own) and consists of a queue of pending jobs serviced by "num_threads"
+// threads. The pool is freed when it has been destroyed and has no more users ("users" and
+// "destroyed" are protected by the global thread pool mutex, not the pool's own mutex).
+
+struct WavpackThreadPool {
+    WorkerInfo *queue_head, *queue_tail;
+    int num_threads, users, quit, destroyed;
+    wp_thread_t *threads;
+
+    wp_condvar_t cond;
+    wp_mutex_t mutex;
+};
+
+#endif
+
+// This is an entry in the pool of block buffers that are reused during decoding. Block
+// buffers that point directly into the caller's data (see WavpackOpenFileInputMemory())
+// are not from the pool and are indicated with a special size.
+
+typedef struct {
+    unsigned char *buffer;
+    uint32_t size;
+} BlockBuffer;
+
+#define BLOCK_BUFFER_BORROWED ((uint32_t) -1)
+
+// This is an index of the file positions of the initial blocks in a WavPack file (or a
+// correction file), sorted by sample index, that is used to seek without searching the file
+// (see unpack_seek.c). Entries are added as blocks are verified during decoding and seeking,
+// and "complete" indicates that the whole file has been indexed.
+
+typedef struct {
+    int64_t block_index, file_pos;
+    uint32_t block_samples;
+} BlockIndexEntry;
+
+typedef struct {
+    BlockIndexEntry *entries;
+    int count, max, complete;
+} BlockIndex;
+
+// This is a cache of recently decoded blocks, stored exactly as WavpackUnpackSamples() returns them,
+// so that seeks into these blocks (and the reads that follow) are simple copies (see unpack_seek.c).
+// The "current" block is the one that reads are coming from, and "reposition" indicates that the
+// decoder must seek to the end of that block before decoding again (i.e., it's somewhere else).
+
+typedef struct {
+    int64_t block_index;
+    uint32_t block_samples, bytes, last_used;
+    int32_t *samples;
+} CachedBlock;
+
+typedef struct {
+    CachedBlock *blocks, *current;
+    int count, max, reposition;
+    uint32_t bytes, max_bytes, current_pos, clock;
+    int64_t hits, misses;
+} BlockCache;
+
+// The optional seek table (ID_SEEK_TABLE) is reserved in the first audio block by the encoder and
+// filled in by WavpackUpdateNumSamples() when the first block is rewritten. It starts with a flags
+// byte, a reserved byte, the 32-bit sample interval (zero if never filled in), and the 32-bit count
+// of entries. Each entry is the 64-bit sample index and 32-bit sample count of an initial block,
+// followed by the 64-bit offset of the block from the first audio block of the .wv file (and then
+// the offset in the .wvc file, if the table has those). All values are little-endian. Each entry is
+// the block that contains the next multiple of the interval, so consecutive entries are never more
+// than one interval (plus one block) apart.
+
+#define SEEK_TABLE_WVC          0x1     // entries include the .wvc file offsets
+#define SEEK_TABLE_HEADER_BYTES 10
+#define SEEK_TABLE_ENTRY_BYTES(flags) (((flags) & SEEK_TABLE_WVC) ? 28 : 20)
+
+#ifndef SEEK_TABLE_MAX_ENTRIES
+#define SEEK_TABLE_MAX_ENTRIES  4096    // limits the size of the table to about 112K bytes
 #endif
 
 struct WavpackContext {
@@ -414,11 +540,60 @@ struct WavpackContext {
 #ifdef ENABLE_THREADS
     // these items support multithreaded operations on multichannel streams
     WorkerInfo *workers;
+    WavpackThreadPool *thread_pool;
     int num_workers, workers_ready, worker_errors;
     wp_condvar_t global_cond;
     wp_mutex_t mutex;
+
+    // these items hold the stream jobs for the current multichannel block (see run_stream_jobs())
+    StreamJob *stream_jobs;
+    StreamJobRange *stream_job_ranges;
+    int num_stream_jobs, max_stream_jobs, num_stream_job_ranges;
+    void (*stream_job_func) (WorkerInfo *cxt, StreamJob *job);
+
+    // these items hold the independent jobs currently being run by run_parallel_jobs()
+    void (*parallel_job_func) (void *data, int job);
+    void *parallel_job_data;
+    int parallel_jobs_next, parallel_jobs_total;
+
+    // these items support read-ahead (temporal) multithreaded decoding of mono and stereo streams
+    int32_t *readahead_buffer;
+    uint32_t readahead_size, readahead_count, readahead_pos, readahead_block_samples;
+
+    // this serializes access to the reader (and the block index) by WavpackReadRange() calls
+    wp_mutex_t reader_mutex;
 #endif
 
+    // these items support decoding directly from data in memory (or memory-mapped)
+    unsigned char *wv_data, *wvc_data;
+    int64_t wv_data_size, wvc_data_size;
+
+    // these items implement the pool of block buffers reused while decoding
+    BlockBuffer *block_pool;
+    int block_pool_count, block_pool_max;
+    uint32_t block_pool_bytes;
+    int64_t block_pool_allocs, block_pool_reuses;
+
+    // these items are the indexes of block positions used for seeking (when encoding with a seek
+    // table, these record the blocks written), the number of seek table entries reserved in the
+    // first block (encoding only), and the interval of a seek table that was read (decoding only)
+    BlockIndex wv_index, wvc_index;
+    uint32_t seek_table_entries, seek_interval;
+
+    // these are the steps of opening the file that were deferred with OPEN_LAZY (see finish_lazy_open())
+    int lazy_pending;
+
+    // this is the optional cache of decoded blocks (see WavpackSetBlockCache())
+    BlockCache block_cache;
+
+    // this buffer holds 32-bit samples for conversion by WavpackUnpackSamplesFormat() (or for
+    // splitting into planes by WavpackUnpackSamplesPlanar()), and these track the planes' positions
+    int32_t *format_buffer, **plane_pointers;
+
+    // this maps each channel to its position among the channels selected with WavpackSelectChannels()
+    // (or -1 if not selected), and reduced_channels holds the count; NULL means all channels are decoded
+    int *channel_map;
+
     void (*close_callback)(void *wpc);
     char error_message [80];
 };
@@ -480,6 +655,8 @@ struct WavpackContext {
     }
 
 void pack_init (WavpackStream *wps);
+int pack_block_shaping (WavpackStream *wps);
+int pack_block_merge (WavpackStream *wps);
 int pack_block (WavpackStream *wps, int32_t *buffer);
 void send_general_metadata (WavpackStream *wps);
 void send_pending_metadata (WavpackStream *wps);
@@ -492,12 +669,16 @@ int read_decorr_weights (WavpackStream *wps, WavpackMetadata *wpmd);
 int read_decorr_samples (WavpackStream *wps, WavpackMetadata *wpmd);
 int read_shaping_info (WavpackStream *wps, WavpackMetadata *wpmd);
 int32_t unpack_samples (WavpackStream *wps, int32_t *buffer, uint32_t sample_count);
+int stream_selected (WavpackContext *wpc, int offset, uint32_t flags);
+void unpack_init_dispatch (void);
 int scan_float_data (WavpackStream *wps, f32 *values, int32_t num_values);
 void send_float_data (WavpackStream *wps, f32 *values, int32_t num_values);
 void float_values (WavpackStream *wps, int32_t *values, int32_t num_values);
 void dynamic_noise_shaping (WavpackStream *wps, const int32_t *buffer, int shortening_allowed);
 void execute_stereo (WavpackStream *wps, int32_t *samples, int no_history, int do_samples);
 void execute_mono (WavpackStream *wps, int32_t *samples, int no_history, int do_samples);
+void extra_stereo_init_dispatch (void);
+void extra_mono_init_dispatch (void);
 
 ////////////////////////// DSD related (including decimation) //////////////////////////
 // modules: pack_dsd.c unpack_dsd.c
@@ -519,6 +700,26 @@ int ASMCALL pack_cpu_has_feature_x86 (int findex);
 
 #define CPU_FEATURE_MMX     23
 
+// On x86-64, SSE4.1 and AVX2 versions of the stereo decorrelation used for decoding are
+// built with compiler intrinsics (module unpack_simd.c) and selected at runtime, as are
+// AVX2 versions of the functions used by the "extra" encoding modes (module pack_simd.c).
+// Define NO_SIMD to disable this.
+
+#if !defined(NO_SIMD) && (defined(__x86_64__) || defined(_M_X64)) && (defined(_MSC_VER) || defined(__clang__) || \
+    (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define OPT_SIMD_X64
+
+#define CPU_FEATURE_SSE41   1
+#define CPU_FEATURE_AVX2    2
+
+int cpu_has_feature_simd (int findex);
+void ASMCALL unpack_decorr_stereo_pass_cont_sse41 (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count, int32_t long_math);
+void ASMCALL unpack_decorr_stereo_pass_cont_avx2 (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count, int32_t long_math);
+void ASMCALL pack_decorr_stereo_pass_cont_avx2 (struct decorr_pass *dpp, int32_t *in_buffer, int32_t *out_buffer, int32_t sample_count);
+void ASMCALL pack_decorr_stereo_pass_cont_rev_avx2 (struct decorr_pass *dpp, int32_t *in_buffer, int32_t *out_buffer, int32_t sample_count);
+uint32_t ASMCALL log2buffer_avx2 (int32_t *samples, uint32_t num_samples, int limit);
+#endif
+
 ///////////////////////////// pre-4.0 version decoding ////////////////////////////
 // modules: unpack3.c, unpack3_open.c, unpack3_seek.c
 
@@ -665,6 +866,7 @@ void update_error_limit (WavpackStream *wps);
 extern const uint32_t bitset [32];
 extern const uint32_t bitmask [32];
 extern const char nbits_table [256];
+extern const unsigned char log2_table [256 + 3];
 
 int wp_log2s (int32_t value);
 int32_t wp_exp2s (int log);
@@ -681,6 +883,8 @@ int FASTCALL wp_log2 (uint32_t avalue);
 #endif
 
 uint32_t ASMCALL LOG2BUFFER (int32_t *samples, uint32_t num_samples, int limit);
+uint32_t crc_mono_samples (uint32_t crc, const int32_t *samples, uint32_t num_samples);
+uint32_t crc_stereo_samples (uint32_t crc, const int32_t *samples, uint32_t num_samples);
 
 signed char store_weight (int weight);
 int restore_weight (signed char weight);
@@ -695,6 +899,17 @@ void WavpackFloatNormalize (int32_t *values, int32_t num_values, int delta_exp);
 WavpackContext *WavpackOpenFileInputEx64 (WavpackStreamReader64 *reader, void *wv_id, void *wvc_id, char *error, int flags, int norm_offset);
 WavpackContext *WavpackOpenFileInputEx (WavpackStreamReader *reader, void *wv_id, void *wvc_id, char *error, int flags, int norm_offset);
 WavpackContext *WavpackOpenFileInput (const char *infilename, char *error, int flags, int norm_offset);
+WavpackContext *WavpackOpenFileInputMemory (void *wv_data, int64_t wv_size, void *wvc_data, int64_t wvc_size, char *error, int flags, int norm_offset);
+int WavpackProbeFile (const char *infilename, WavpackProbeInfo *info, char *error, int flags);
+int WavpackProbeBuffer (void *wv_data, int64_t wv_size, void *wvc_data, int64_t wvc_size, WavpackProbeInfo *info, char *error, int flags);
+int WavpackProbeFiles (char **infilenames, int num_files, WavpackProbeInfo *info, int flags);
+WavpackContext *WavpackOpenFileInputMapped (const char *infilename, char *error, int flags, int norm_offset);
+WavpackStreamDecoder *WavpackCreateDecoder (int flags, int norm_offset);
+int WavpackDecoderFeed (WavpackStreamDecoder *dec, const void *data, int32_t bcount);
+uint32_t WavpackDecoderDrain (WavpackStreamDecoder *dec, int32_t *buffer, uint32_t samples);
+WavpackContext *WavpackDecoderGetContext (WavpackStreamDecoder *dec);
+char *WavpackDecoderGetErrorMessage (WavpackStreamDecoder *dec);
+WavpackStreamDecoder *WavpackDestroyDecoder (WavpackStreamDecoder *dec);
 
 #define OPEN_WVC        0x1     // open/read "correction" file
 #define OPEN_TAGS       0x2     // read ID3v1 / APEv2 tags (seekable file)
@@ -720,13 +935,41 @@ int WavpackGetMode (WavpackContext *wpc);
 int WavpackGetQualifyMode (WavpackContext *wpc);
 int WavpackGetVersion (WavpackContext *wpc);
 uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t samples);
+uint32_t WavpackUnpackSamplesFormat (WavpackContext *wpc, void *buffer, uint32_t samples, int format);
+uint32_t WavpackUnpackSamplesPlanar (WavpackContext *wpc, int32_t **buffers, uint32_t samples);
+int WavpackSelectChannels (WavpackContext *wpc, const int *channels, int count);
+
+#define UNPACK_INT16        0x1     // 16-bit signed integers (native endian)
+#define UNPACK_INT24_LE     0x2     // 24-bit signed integers, packed little-endian
+#define UNPACK_INT24_BE     0x3     // 24-bit signed integers, packed big-endian
+#define UNPACK_FLOAT32      0x4     // 32-bit floats (native endian)
+#define UNPACK_FORMAT_MASK  0xff
+#define UNPACK_NORMALIZE    0x100   // return floats normalized to +/- 1.0
+
 int WavpackSeekSample (WavpackContext *wpc, uint32_t sample);
 int WavpackSeekSample64 (WavpackContext *wpc, int64_t sample);
+int WavpackBuildBlockIndex (WavpackContext *wpc);
+int32_t WavpackExportBlockIndex (WavpackContext *wpc, void *data, int32_t size);
+int WavpackImportBlockIndex (WavpackContext *wpc, const void *data, int32_t size);
+int WavpackSetBlockCache (WavpackContext *wpc, uint32_t max_bytes);
+void WavpackGetBlockCacheStats (WavpackContext *wpc, int64_t *hits, int64_t *misses);
+uint32_t unpack_samples_cached (WavpackContext *wpc, int32_t *buffer, uint32_t samples);
+uint32_t WavpackReadRange (WavpackContext *wpc, int64_t start_sample, uint32_t samples, int32_t *buffer);
+WavpackContext *WavpackCloneContext (WavpackContext *wpc, WavpackStreamReader64 *reader, void *wv_id, void *wvc_id, char *error);
 int WavpackGetMD5Sum (WavpackContext *wpc, unsigned char data [16]);
 
 int WavpackVerifySingleBlock (unsigned char *buffer, int verify_checksum);
 uint32_t read_next_header (WavpackStreamReader64 *reader, void *id, WavpackHeader *wphdr);
+unsigned char *read_block_buffer (WavpackContext *wpc, void *id, WavpackHeader *wphdr, uint32_t *size);
+void store_block_header (WavpackContext *wpc, unsigned char **buffer, uint32_t *size, WavpackHeader *wphdr);
 int read_wvc_block (WavpackContext *wpc, int stream);
+int skip_stream_block (WavpackContext *wpc, int stream);
+void copy_context_info (WavpackContext *dest, WavpackContext *source);
+void finish_lazy_open (WavpackContext *wpc, int steps);
+int probe_file (WavpackStreamReader64 *reader, void *wv_id, void *wvc_id, WavpackProbeInfo *info, char *error, int flags);
+
+#define LAZY_TOTAL_SAMPLES  0x1     // scan end of file for total samples
+#define LAZY_TAGS           0x2     // read ID3v1 / APEv2 tags
 
 /////////////////////////// high-level packing API and support ////////////////////////////
 // modules: pack_utils.c, pack_floats.c
@@ -747,6 +990,9 @@ void *WavpackGetWrapperLocation (void *first_block, uint32_t *size);
 // module: common_utils.c
 
 extern const uint32_t sample_rates [16];
+WavpackThreadPool *WavpackCreateThreadPool (int num_threads);
+void WavpackSetThreadPool (WavpackThreadPool *pool);
+void WavpackDestroyThreadPool (WavpackThreadPool *pool);
 uint32_t WavpackGetLibraryVersion (void);
 const char *WavpackGetLibraryVersionString (void);
 uint32_t WavpackGetSampleRate (WavpackContext *wpc);
@@ -762,6 +1008,7 @@ uint32_t WavpackGetSampleIndex (WavpackContext *wpc);
 int64_t WavpackGetSampleIndex64 (WavpackContext *wpc);
 char *WavpackGetErrorMessage (WavpackContext *wpc);
 int WavpackGetNumErrors (WavpackContext *wpc);
+void WavpackGetBlockBufferStats (WavpackContext *wpc, int64_t *allocations, int64_t *reuses);
 int WavpackLossyBlocks (WavpackContext *wpc);
 uint32_t WavpackGetWrapperBytes (WavpackContext *wpc);
 unsigned char *WavpackGetWrapperData (WavpackContext *wpc);
@@ -782,6 +1029,17 @@ void install_close_callback (WavpackContext *wpc, void cb_func (void *wpc));
 void free_single_stream (WavpackStream *wps);
 void free_dsd_tables (WavpackStream *wps);
 void free_streams (WavpackContext *wpc);
+unsigned char *block_buffer_obtain (WavpackContext *wpc, uint32_t bytes, uint32_t *size);
+void block_buffer_release (WavpackContext *wpc, unsigned char *buffer, uint32_t size);
+void block_index_add (BlockIndex *index, int64_t block_index, int64_t file_pos, uint32_t block_samples);
+void wp_call_once (wp_once_t *once, void (*init_func) (void));
+#ifdef ENABLE_THREADS
+WavpackThreadPool *thread_pool_attach (void);
+void thread_pool_submit (WavpackThreadPool *pool, WorkerInfo *cxt);
+int add_stream_job (WavpackContext *wpc, WavpackStream *wps, int32_t *outbuf, int32_t **outplanes, uint32_t offset, uint32_t samcnt);
+void run_stream_jobs (WavpackContext *wpc, void (*job_func) (WorkerInfo *cxt, StreamJob *job), int32_t *temp_buffer, uint32_t temp_samples);
+void run_parallel_jobs (WavpackContext *wpc, void (*job_func) (void *data, int job), void *data, int num_jobs);
+#endif
 
 /////////////////////////////////// tag utilities ////////////////////////////////////
 // modules: tags.c, tag_utils.c
@@ -797,6 +1055,7 @@ int WavpackAppendBinaryTagItem (WavpackContext *wpc, const char *item, const cha
 int WavpackDeleteTagItem (WavpackContext *wpc, const char *item);
 int WavpackWriteTag (WavpackContext *wpc);
 int load_tag (WavpackContext *wpc);
+int locate_tag (WavpackContext *wpc);
 void free_tag (M_Tag *m_tag);
 int valid_tag (M_Tag *m_tag);
 int editable_tag (M_Tag *m_tag);